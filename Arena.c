@@ -0,0 +1,146 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "Arena.h"
+#include "nfq_wf_private.h"
+
+/**
+* @ingroup Arena
+* @{
+*/
+
+#define ARENA_ALIGN 8
+
+/** smallest heap block */
+#define ARENA_CHUNK_SIZE 4096
+
+struct ArenaChunk {
+	struct ArenaChunk *next;
+	size_t size;
+	unsigned char data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+/**
+* @arg buf   first block, may be NULL, must outlive the arena
+* @arg size  bytes of buf
+*/
+void Arena_init(struct Arena *arena, void *buf, size_t size)
+{
+	arena->first = buf;
+	arena->first_size = buf ? size : 0;
+	arena->base = arena->first;
+	arena->size = arena->first_size;
+	arena->used = 0;
+	arena->chunks = NULL;
+}
+
+/** Free the heap blocks */
+void Arena_free(struct Arena *arena)
+{
+	struct ArenaChunk *chunk;
+
+	while ((chunk = arena->chunks)) {
+		arena->chunks = chunk->next;
+		free(chunk);
+	}
+
+	arena->base = arena->first;
+	arena->size = arena->first_size;
+	arena->used = 0;
+}
+
+/**
+* Forget every object.  The last heap block is kept, if the first block
+* was too small once it probably will be again.
+*/
+void Arena_reset(struct Arena *arena)
+{
+	struct ArenaChunk *keep = arena->chunks;
+
+	if (!keep) {
+		arena->used = 0;
+		return;
+	}
+
+	arena->chunks = keep->next;
+	Arena_free(arena);
+	keep->next = NULL;
+	arena->chunks = keep;
+	arena->base = keep->data;
+	arena->size = keep->size;
+}
+
+static void *__alloc(struct Arena *arena, size_t len, size_t align)
+{
+	struct ArenaChunk *chunk;
+	size_t off = (arena->used + align - 1) & ~(align - 1);
+	size_t size;
+
+	if (arena->base && off + len <= arena->size) {
+		arena->used = off + len;
+		return arena->base + off;
+	}
+
+	size = len > ARENA_CHUNK_SIZE ? len : ARENA_CHUNK_SIZE;
+	chunk = malloc(sizeof(struct ArenaChunk) + size);
+	if (!chunk)
+		return NULL;
+
+	DBG(6, "arena %p new block of %zu bytes for %zu\n", arena, size, len);
+	chunk->size = size;
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+	arena->base = chunk->data;
+	arena->size = size;
+	arena->used = len;
+	return chunk->data;
+}
+
+/**
+* @return len bytes, aligned for any scalar, or NULL if out of memory
+*/
+void *Arena_alloc(struct Arena *arena, size_t len)
+{
+	return __alloc(arena, len, ARENA_ALIGN);
+}
+
+/**
+* Copy a string that may not be NULL terminated
+* @return NULL terminated copy, or NULL if out of memory
+*/
+char *Arena_strndup(struct Arena *arena, const void *str, size_t len)
+{
+	char *s = __alloc(arena, len + 1, 1);
+
+	if (!s)
+		return NULL;
+
+	memcpy(s, str, len);
+	s[len] = 0;
+	return s;
+}
+
+/** @}  */
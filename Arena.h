@@ -0,0 +1,61 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef ARENA_H
+#define ARENA_H 1
+
+#include <stddef.h>
+
+/**
+* @defgroup Arena  Bump pointer allocator
+* @brief Many small objects with one owner, all freed at once.
+*
+* Allocation moves a pointer through the current block.  The first
+* block is given by the owner, usually embedded in it, so an owner that
+* stays within it never calls malloc().  Larger needs chain blocks from
+* the heap, which go back on Arena_reset() or Arena_free().
+* There is no free of a single object and no locking.
+* @{
+*/
+
+/** heap block, chained so they can be freed */
+struct ArenaChunk;
+
+struct Arena {
+	unsigned char *base; /**< current block */
+	size_t size;
+	size_t used;
+	unsigned char *first; /**< owner's block, never freed here */
+	size_t first_size;
+	struct ArenaChunk *chunks;
+};
+
+void Arena_init(struct Arena *arena, void *buf, size_t size);
+void Arena_reset(struct Arena *arena);
+void Arena_free(struct Arena *arena);
+
+void *Arena_alloc(struct Arena *arena, size_t len);
+char *Arena_strndup(struct Arena *arena, const void *str, size_t len);
+
+/** @}  */
+
+#endif
@@ -159,14 +159,14 @@ static int virus_cache_compare(const void *item1, const void *item2)
 */
 static void add_virus_to_cache(struct HttpReq *req, const char *virus_name)
 {
-	DBG(5, "virus %d '%s' at %s\n", virus_cache_count, virus_name, req->url);
+	DBG(5, "virus %d '%s' at %s\n", virus_cache_count, virus_name, req->url.str);
 	pthread_rwlock_wrlock(&cache_lock);
 
 	virus_cache = realloc(virus_cache, sizeof(struct virus_cache_item) * (virus_cache_count+1));
 	if (!virus_cache) {
 		ERROR_FATAL("realloc error \n");
 	}
-	virus_cache[virus_cache_count].url = strdup(req->url);
+	virus_cache[virus_cache_count].url = strdup(req->url.str);
 	virus_cache[virus_cache_count].virus_name = strdup(virus_name);
 	virus_cache[virus_cache_count].last_access = time(NULL);
 	virus_cache_count++;
@@ -185,14 +185,14 @@ static int search_virus_cache(struct HttpReq *req)
 	if (!virus_cache)
 		return Action_nomatch;
 
-	search_key.url = req->url;
+	search_key.url = (char *) req->url.str;
 
 	pthread_rwlock_rdlock(&cache_lock);
 	result = bsearch(&search_key, virus_cache, virus_cache_count,
 			sizeof(struct virus_cache_item), virus_cache_compare);
 	if (result) {
 		verdict = Action_virus;
-		DBG(2, "Cached Virus %s at url %s\n", result->virus_name, req->url);
+		DBG(2, "Cached Virus %s at url %s\n", result->virus_name, req->url.str);
 		HttpReq_setRejectReason(req, result->virus_name);
 	}
 	pthread_rwlock_unlock(&cache_lock);
@@ -461,7 +461,7 @@ static int ClamAvFilter_initClamdCtx(struct Filter *fobj, struct HttpReq *req)
 	if (req->server_resp_msg.content_length > fo->skip_size)
 		return Action_nomatch;
 
-	ctx = (struct clamd_ctx *) PrivData_newData(req->priv_data,
+	ctx = (struct clamd_ctx *) PrivData_newData(&req->priv_data,
 		Filter_getObjId(fobj), sizeof(struct clamd_ctx), clamd_ctx_free);
 
 	if (!ctx) {
@@ -485,7 +485,7 @@ static int ClamAvFilter_streamFilter(struct Filter *fobj, struct HttpReq *req,
 	int ret;
 	bool end_of_stream = false;
 
-	ctx = (struct clamd_ctx *) PrivData_getData(req->priv_data, Filter_getObjId(fobj));
+	ctx = (struct clamd_ctx *) PrivData_getData(&req->priv_data, Filter_getObjId(fobj));
 	if (!ctx) {
 		DBG(5, "No private data for this req, not filtering \n");
 		return Action_nomatch;
@@ -568,7 +568,7 @@ static int ClamAvFilter_fileFilter(struct Filter *fobj, struct HttpReq *req)
 	struct ClamAvFilter *fo = (struct ClamAvFilter *) fobj; /* filter object */
 	DBG(5, "req =%p filter=%p\n", req, fobj);
 	if ((req->server_resp_msg.content_length > fo->skip_size) ||
-		(req->server_resp_msg.chunk_recieved > fo->skip_size) )
+		(req->server_resp_msg.chunk.body_len > fo->skip_size) )
 		return Action_nomatch;
 
 	clamd_fd = clamd_connect(fo);
@@ -25,6 +25,7 @@ THE SOFTWARE.
 #include <string.h>
 #include <syslog.h>
 #include <sys/time.h>
+#include <arpa/inet.h>
 
 #ifdef HAVE_CONFIG_H
 #include "nfq-web-filter-config.h"
@@ -56,6 +57,8 @@ struct ContentFilter
 	struct FilterList *obj_list; /** List of objects used */
 	bool has_stream_filter;
 	bool has_file_filter;
+	/** leading rules that are decided from the IP/TCP tuple alone */
+	unsigned int tuple_rule_count;
 };
 
 void ContentFilter_get(struct ContentFilter *cf) {
@@ -411,6 +414,23 @@ static void check_for_file_filter(struct ContentFilter* cf)
 		cf->has_file_filter = true;
 }
 
+/**
+* Count the rules, from the first one, that only use filters able to
+* match the IP/TCP tuple.  Past the first other rule, a verdict depends
+* on the HTTP request.
+*/
+static void check_for_tuple_rules(struct ContentFilter* cf)
+{
+	unsigned int i;
+
+	for (i = 0; i < cf->rule_list_count; i++) {
+		if (!Rule_isTupleOnly(cf->rule_list[i]))
+			break;
+	}
+	cf->tuple_rule_count = i;
+	DBG(1, "%u of %u rules decided from the IP/TCP tuple\n",
+		cf->tuple_rule_count, cf->rule_list_count);
+}
 
 int ContentFilter_loadConfig(struct ContentFilter* cf, xmlNode *start_node)
 {
@@ -441,6 +461,7 @@ int ContentFilter_loadConfig(struct ContentFilter* cf, xmlNode *start_node)
 	}
 	check_for_file_filter(cf);
 	check_for_stream_filter(cf);
+	check_for_tuple_rules(cf);
 	return 0;
 }
 
@@ -489,6 +510,78 @@ int ContentFilter_getRequestVerdict(struct ContentFilter* cf, struct HttpReq *re
 	return cf->default_action;
 }
 
+/**
+* Get the verdict of a new connection if it can be decided from its
+* IP/TCP tuple, before any HTTP request.
+* An accept is only decided when no stream or file filter has to see the content.
+* @param tuple client to server tuple
+* @param rule  set to the rule matched, NULL for the default action
+* @return Action_accept or Action_reject with any other bits of the rule,
+*  Action_nomatch if the HTTP request is needed
+*/
+enum Action ContentFilter_getTupleVerdict(struct ContentFilter* cf,
+	const struct Ipv4TcpTuple *tuple, time_t now, struct Rule **rule)
+{
+	enum Action verdict = Action_nomatch;
+	unsigned int i;
+
+	*rule = NULL;
+	for (i = 0; i < cf->tuple_rule_count; i++) {
+		verdict = Rule_getTupleVerdict(cf->rule_list[i], tuple, now);
+		if (verdict != Action_nomatch) {
+			*rule = cf->rule_list[i];
+			break;
+		}
+	}
+
+	if (verdict == Action_nomatch) {
+		if (cf->tuple_rule_count < cf->rule_list_count)
+			return Action_nomatch;
+		verdict = cf->default_action;
+	}
+
+	if (verdict & (Action_virus | Action_malware | Action_phishing | Action_continue))
+		return Action_nomatch;
+	if (verdict & Action_reject)
+		return verdict;
+	// logging an accept needs the URL of each request
+	if ((verdict & (Action_accept | Action_trust))
+		&& !cf->has_stream_filter && !cf->has_file_filter
+		&& !(*rule && ((*rule)->log || (*rule)->notify)))
+		return verdict;
+
+	return Action_nomatch;
+}
+
+/**
+* Collect the destination networks of the IP only reject rules that come
+* before any rule with another action.  Dropping those in the kernel
+* changes no verdict, only the error page is lost.
+* @param nets  set to a malloc()ed array, or NULL. Caller must free()
+* @return networks in nets
+*/
+unsigned int ContentFilter_getRejectNets(struct ContentFilter* cf, struct Ipv4Net **nets)
+{
+	struct Rule *rule;
+	unsigned int count = 0;
+	unsigned int i;
+
+	*nets = NULL;
+	for (i = 0; i < cf->rule_list_count; i++) {
+		rule = cf->rule_list[i];
+
+		if (!(rule->action & Action_reject)
+			|| (rule->action & (Action_accept | Action_trust | Action_continue)))
+			break;
+
+		if (Rule_getDstNets(rule, nets, &count) >= 0) {
+			DBG(2, "Rule %d rejects in the kernel\n", Rule_getId(rule));
+		}
+	}
+
+	return count;
+}
+
 struct Rule * __get_first_rule_with_filter(struct ContentFilter* cf, struct Filter *fo)
 {
 	struct Rule *rule;
@@ -629,6 +722,25 @@ static void diff_timeval(struct timeval *t1, struct timeval *t2, struct timeval
 }
 
 
+/**
+* @brief Log a connection decided by ContentFilter_getTupleVerdict()
+**/
+void ContentFilter_logTuple(struct ContentFilter* cf, struct Rule *rule,
+	const struct Ipv4TcpTuple *tuple)
+{
+	char src[INET_ADDRSTRLEN];
+	char dst[INET_ADDRSTRLEN];
+
+	if (!rule || (!rule->log && !rule->notify))
+		return;
+
+	syslog(LOG_INFO, "WF matched rule id=%d connection %s:%hu -> %s:%hu verdict=%d",
+		Rule_getId(rule),
+		inet_ntop(AF_INET, &tuple->src_ip, src, sizeof(src)), tuple->src_port,
+		inet_ntop(AF_INET, &tuple->dst_ip, dst, sizeof(dst)), tuple->dst_port,
+		rule->action);
+}
+
 /**
 * @brief Log the request
 * @todo Think about making log plugin modules that we register like the filters
@@ -652,7 +764,7 @@ void ContentFilter_logReq(struct ContentFilter* cf, struct HttpReq *req)
 	diff_timeval(&now, &req->start_time, &delta_time);
 	//TODO for each log plugin.  Call log.
 	syslog(LOG_INFO, "WF matched rule id=%d url='%s' verdict=%d length=%llu received=%llu duration=%d.%04d",
-		Rule_getId(rule), req->url, rule->action, (long long) req->server_resp_msg.content_length,
+		Rule_getId(rule), req->url.str, rule->action, (long long) req->server_resp_msg.content_length,
 		(long long) req->server_resp_msg.content_received,
 		(int) delta_time.tv_sec, (int) delta_time.tv_usec/1000);
 }
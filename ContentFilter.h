@@ -61,5 +61,13 @@ bool ContentFilter_hasFileFilter(struct ContentFilter* cf);
 
 void ContentFilter_logReq(struct ContentFilter* cf, struct HttpReq *req);
 
+enum Action ContentFilter_getTupleVerdict(struct ContentFilter* cf,
+	const struct Ipv4TcpTuple *tuple, time_t now, struct Rule **rule);
+
+void ContentFilter_logTuple(struct ContentFilter* cf, struct Rule *rule,
+	const struct Ipv4TcpTuple *tuple);
+
+unsigned int ContentFilter_getRejectNets(struct ContentFilter* cf, struct Ipv4Net **nets);
+
 /** @} */
 #endif
@@ -27,6 +27,8 @@ THE SOFTWARE.
 #include "nfq-web-filter-config.h"
 #endif
 
+#include <time.h>
+#include <netinet/in.h>
 #include <libxml/tree.h>
 
 #include "nfq_wf_private.h"
@@ -62,6 +64,13 @@ struct Filter
 
 struct rule;
 struct HttpReq;
+struct Ipv4TcpTuple;
+
+/** IPv4 network, network byte order */
+struct Ipv4Net {
+	in_addr_t addr;
+	in_addr_t mask;
+};
 
 /**
 * @struct Filter_ops
@@ -102,6 +111,23 @@ struct Filter_ops
 	*/
 	int (*foo_matches_req)(struct Filter *obj, struct HttpReq *);
 
+	/** @brief OPTIONAL Check if filter object matches a connection from its
+	    IP/TCP tuple alone.  Rules made only of such filters are decided
+	    when the connection starts, before any HTTP is seen.
+	    @param obj   This filter object
+	    @param tuple client to server tuple
+	    @param now   time of the packet
+	    @returns 1 on match, 0 no match
+	*/
+	int (*foo_matches_tuple)(struct Filter *obj, const struct Ipv4TcpTuple *tuple,
+			time_t now);
+
+	/** @brief OPTIONAL Get the destination network this filter matches,
+	    when that is all it matches.  Used to enforce rules in the kernel.
+	    @returns 0 if net was set, -1 if the filter matches anything else
+	*/
+	int (*foo_dst_net)(struct Filter *obj, struct Ipv4Net *net);
+
 
 	// filter for AV or other kind of filter on data stream
 	int (*foo_stream_filter)(struct Filter *obj, struct HttpReq *,
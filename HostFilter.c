@@ -134,16 +134,16 @@ static int HostFilter_start_req(struct Filter *fobj, struct HttpReq *req)
 		DBG(7, "multiple requests to same host filter_id=%d\n", Filter_getObjId(fobj));
 		return 0;
 	}
-	data = PrivData_newData(con->priv_data, Filter_getObjId(fobj), sizeof(int), free);
+	data = PrivData_newData(&con->priv_data, Filter_getObjId(fobj), sizeof(int), free);
 	if (!data) {
 		ERROR_FATAL("Missing private data id=%d\n", Filter_getObjId(fobj));
 		return -1;
 	}
 
-	if (!req->host)
+	if (!req->host.str)
 		ERROR_FATAL("Host NULL, BUG\n");
 
-	if (fnmatch(fo->host, req->host, FNM_CASEFOLD))
+	if (fnmatch(fo->host, req->host.str, FNM_CASEFOLD))
 		(*(int *)data) = 0; // no match
 	else
 		(*(int *)data) = 1; // match
@@ -157,7 +157,7 @@ static int HostFilter_matches_req(struct Filter *fobj, struct HttpReq *req)
 	struct HttpConn *con = req->con;
 	void *data;
 	// every request in the same connection will be to the same host so use saved value.
-	data = PrivData_getData(con->priv_data, Filter_getObjId(fobj));
+	data = PrivData_getData(&con->priv_data, Filter_getObjId(fobj));
 	if (!data) {
 		WARN("Missing private data with id=%d\n", Filter_getObjId(fobj));
 		return 0;
@@ -167,11 +167,11 @@ static int HostFilter_matches_req(struct Filter *fobj, struct HttpReq *req)
 	#else
 	struct HostFilter *fo = (struct HostFilter *) fobj; /* Host filter object */
 
-	DBG(5, "check if req host='%s' contains = '%s'\n", req->host, fo->host);
-	if (!req->host)
+	DBG(5, "check if req host='%s' contains = '%s'\n", req->host.str, fo->host);
+	if (!req->host.str)
 		ERROR_FATAL("Host NULL, BUG\n");
 
-	if (!fnmatch(fo->host, req->host, FNM_CASEFOLD))
+	if (!fnmatch(fo->host, req->host.str, FNM_CASEFOLD))
 		return 1;
 
 	return 0;
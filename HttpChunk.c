@@ -0,0 +1,204 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "nfq-web-filter-config.h"
+#endif
+
+#include "HttpChunk.h"
+#include "nfq_wf_private.h"
+
+/**
+* @ingroup HttpChunk
+* @{
+*/
+
+/** more would overflow uint64_t, no real chunk comes close */
+#define HTTP_CHUNK_MAX_DIGITS 15
+
+void HttpChunk_init(struct HttpChunk *chunk)
+{
+	memset(chunk, 0, sizeof(struct HttpChunk));
+}
+
+static inline int __hex_value(unsigned char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	c |= 0x20;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+/** the line with a chunk size ended */
+static inline void __size_line_end(struct HttpChunk *chunk)
+{
+	if (chunk->remaining) {
+		chunk->state = http_chunk_data;
+	} else {
+		DBG(5, "last chunk, body %llu bytes\n", (long long) chunk->body_len);
+		chunk->state = http_chunk_trailer;
+	}
+}
+
+/**
+* Skip framing up to the next chunk data.
+* A bare LF is taken where a CRLF belongs, as RFC 7230 3.5 allows.
+* @arg data  in: input, out: first byte not yet used
+* @arg len   in: bytes of input, out: bytes left
+* @arg body  set to the chunk data found
+* @return bytes of chunk data at *body, already consumed from the input.
+*     0 when the input is used up, or the body is done or broken,
+*     see HttpChunk_done() and HttpChunk_error().
+*/
+unsigned int HttpChunk_parse(struct HttpChunk *chunk, const unsigned char **data,
+		unsigned int *len, const unsigned char **body)
+{
+	const unsigned char *p = *data;
+	const unsigned char *end = p + *len;
+	const unsigned char *eol;
+	unsigned int n = 0;
+	int v;
+
+	while (p < end && !n) {
+		switch (chunk->state) {
+			case http_chunk_size:
+				v = __hex_value(*p);
+				if (v >= 0) {
+					if (++chunk->digits > HTTP_CHUNK_MAX_DIGITS)
+						goto error;
+					chunk->remaining = (chunk->remaining << 4) | v;
+					p++;
+					break;
+				}
+				if (!chunk->digits)
+					goto error;
+				if (*p == '\r') {
+					chunk->state = http_chunk_size_lf;
+				} else if (*p == '\n') {
+					__size_line_end(chunk);
+				} else if (*p == ';' || *p == ' ' || *p == '\t') {
+					chunk->state = http_chunk_ext;
+				} else {
+					goto error;
+				}
+				p++;
+				break;
+
+			case http_chunk_ext:
+				eol = memchr(p, '\n', end - p);
+				if (!eol) {
+					p = end;
+					break;
+				}
+				p = eol + 1;
+				__size_line_end(chunk);
+				break;
+
+			case http_chunk_size_lf:
+				if (*p != '\n')
+					goto error;
+				p++;
+				__size_line_end(chunk);
+				break;
+
+			case http_chunk_data:
+				n = end - p;
+				if (n > chunk->remaining)
+					n = chunk->remaining;
+				*body = p;
+				p += n;
+				chunk->remaining -= n;
+				chunk->body_len += n;
+				if (!chunk->remaining)
+					chunk->state = http_chunk_data_cr;
+				break;
+
+			case http_chunk_data_cr:
+				if (*p == '\r') {
+					chunk->state = http_chunk_data_lf;
+				} else if (*p == '\n') {
+					chunk->state = http_chunk_size;
+					chunk->digits = 0;
+				} else {
+					goto error;
+				}
+				p++;
+				break;
+
+			case http_chunk_data_lf:
+				if (*p != '\n')
+					goto error;
+				p++;
+				chunk->state = http_chunk_size;
+				chunk->digits = 0;
+				break;
+
+			case http_chunk_trailer:
+				if (*p == '\r')
+					chunk->state = http_chunk_trailer_lf;
+				else if (*p == '\n')
+					chunk->state = http_chunk_done;
+				else
+					chunk->state = http_chunk_trailer_line;
+				p++;
+				break;
+
+			case http_chunk_trailer_line:
+				eol = memchr(p, '\n', end - p);
+				if (!eol) {
+					p = end;
+					break;
+				}
+				p = eol + 1;
+				chunk->state = http_chunk_trailer;
+				break;
+
+			case http_chunk_trailer_lf:
+				if (*p != '\n')
+					goto error;
+				p++;
+				chunk->state = http_chunk_done;
+				break;
+
+			case http_chunk_done:
+			case http_chunk_error:
+				goto out;
+		}
+	}
+
+out:
+	*len -= p - *data;
+	*data = p;
+	return n;
+
+error:
+	DBG(1, "bad chunked body at 0x%02x state=%d\n", *p, chunk->state);
+	chunk->state = http_chunk_error;
+	goto out;
+}
+
+/** @}  */
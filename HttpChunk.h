@@ -0,0 +1,78 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef HTTP_CHUNK_H
+#define HTTP_CHUNK_H 1
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+* @ingroup HttpReq
+* @defgroup HttpChunk  Chunked transfer coding
+* @brief Incremental decoder of a "Transfer-Encoding: chunked" body, RFC 7230 4.1
+*
+* Fed the body as it arrives, in pieces of any size.  The chunk sizes,
+* extensions, CRLFs and trailer are skipped and the chunk data is
+* handed back as spans of the input, nothing is copied.
+* @{
+*/
+
+enum http_chunk_state {
+	http_chunk_size = 0, /**< in the hex size, also the start */
+	http_chunk_ext,      /**< after the size, to the end of the line */
+	http_chunk_size_lf,
+	http_chunk_data,
+	http_chunk_data_cr,  /**< CRLF after the data of a chunk */
+	http_chunk_data_lf,
+	http_chunk_trailer,  /**< start of a trailer line, or of the final CRLF */
+	http_chunk_trailer_line,
+	http_chunk_trailer_lf,
+	http_chunk_done,     /**< whole body seen, following bytes are the next message */
+	http_chunk_error,
+};
+
+/** Decoder state, all zero is a new body */
+struct HttpChunk {
+	uint64_t remaining; /**< size being parsed, or data left in the chunk */
+	uint64_t body_len;  /**< decoded bytes so far */
+	uint8_t state;      /**< enum http_chunk_state */
+	uint8_t digits;     /**< hex digits of the size so far */
+};
+
+void HttpChunk_init(struct HttpChunk *chunk);
+unsigned int HttpChunk_parse(struct HttpChunk *chunk, const unsigned char **data,
+		unsigned int *len, const unsigned char **body);
+
+static inline bool HttpChunk_done(const struct HttpChunk *chunk)
+{
+	return chunk->state == http_chunk_done;
+}
+
+static inline bool HttpChunk_error(const struct HttpChunk *chunk)
+{
+	return chunk->state == http_chunk_error;
+}
+
+/** @}  */
+
+#endif
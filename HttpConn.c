@@ -45,12 +45,16 @@ THE SOFTWARE.
 #include "Rules.h"
 #include "ContentFilter.h"
 #include "WfConfig.h"
+#include "Slab.h"
 #include "PrivData.h"
 #include "nfq_wf_private.h"
 
 #define MAX(a, b) (a > b ? a : b)
 #define MIN(a, b) (a < b ? a : b)
 
+/// objects per slab chunk for connections and requests
+#define HTTP_CONN_SLAB_CHUNK 64
+
 
 
 // NOTE not going to protect this auto increment ID sequence by a mutex.
@@ -76,7 +80,7 @@ static struct HttpReq * __add_request_new_to_list(struct HttpConn *con)
 		ERROR_FATAL("No memory for HttpReq\n");
 	}
 
-	ubi_dlAddHead(con->request_list, req);
+	ubi_dlAddHead(&con->request_list, req);
 	req->id = con->cur_request;
 
 	return req;
@@ -87,7 +91,7 @@ static struct HttpReq * __find_request(struct HttpConn *con, unsigned id)
 	struct HttpReq* req = NULL;
 
 	/*for each object in list */
-	for (req = (struct HttpReq *)ubi_dlFirst(con->request_list);
+	for (req = (struct HttpReq *)ubi_dlFirst(&con->request_list);
 		req; req = (struct HttpReq *)ubi_dlNext(req)) {
 
 		if (req->id == id)
@@ -98,65 +102,161 @@ static struct HttpReq * __find_request(struct HttpConn *con, unsigned id)
 }
 
 
-struct HttpConn* HttpConn_new(struct WfConfig *config)
+/**
+* Create the per queue slabs for connections and requests
+* @return 0 on success
+*/
+int HttpConnCtx_init(struct HttpConnCtx *ctx)
 {
-	struct HttpConn *con;
+	memset(ctx, 0, sizeof(*ctx));
 
-	con = calloc(1, sizeof(struct HttpConn));
-	if (!con)
-		return NULL;
+	ctx->con_slab = Slab_new("HttpConn", sizeof(struct HttpConn),
+		HTTP_CONN_SLAB_CHUNK);
+	if (!ctx->con_slab)
+		return -1;
+
+	ctx->req_slab = Slab_new("HttpReq", sizeof(struct HttpReq),
+		HTTP_CONN_SLAB_CHUNK);
+	if (!ctx->req_slab)
+		goto free_con_slab;
+
+	ctx->seg_slab = Slab_new("SegNode", SegStore_nodeSize(),
+		HTTP_CONN_SLAB_CHUNK * 4);
+	if (!ctx->seg_slab)
+		goto free_req_slab;
 
-	con->request_list = malloc(sizeof(HttpReq_list_t));
-	if (!con->request_list)
-		goto free_con;
-	con->request_list = ubi_dlInitList(con->request_list);
+	return 0;
 
-	con->server_buffer = malloc(sizeof(ipv4_tcp_pkt_list_t));
-	if (!con->server_buffer)
-		goto free_req_list;
-	con->server_buffer = ubi_dlInitList(con->server_buffer);
+	free_req_slab:
+	Slab_del(&ctx->req_slab);
 
-	con->client_buffer = malloc(sizeof(ipv4_tcp_pkt_list_t));
-	if (!con->client_buffer)
-		goto free_server_buffer;
-	con->client_buffer = ubi_dlInitList(con->client_buffer);
+	free_con_slab:
+	Slab_del(&ctx->con_slab);
 
+	return -1;
+}
 
-	con->priv_data = PrivData_new();
+/**
+* Release the slabs, all connections using ctx must already be deleted.
+*/
+void HttpConnCtx_destroy(struct HttpConnCtx *ctx)
+{
+	if (ctx->seg_slab)
+		Slab_del(&ctx->seg_slab);
+	if (ctx->req_slab)
+		Slab_del(&ctx->req_slab);
+	if (ctx->con_slab)
+		Slab_del(&ctx->con_slab);
+}
+
+void HttpConnCtx_printStats(struct HttpConnCtx *ctx, FILE *stream)
+{
+	if (ctx->con_slab)
+		Slab_printStats(ctx->con_slab, stream);
+	if (ctx->req_slab)
+		Slab_printStats(ctx->req_slab, stream);
+	if (ctx->seg_slab)
+		Slab_printStats(ctx->seg_slab, stream);
+}
+
+/**
+* @param ctx allocation context, NULL to use the heap
+*/
+struct HttpConn* HttpConn_new(struct WfConfig *config, struct HttpConnCtx *ctx)
+{
+	struct HttpConn *con;
+
+	if (ctx)
+		con = Slab_zalloc(ctx->con_slab);
+	else
+		con = calloc(1, sizeof(struct HttpConn));
+	if (!con)
+		return NULL;
+
+	con->ctx = ctx;
+	ubi_dlInitList(&con->request_list);
+	SegStore_init(&con->server_buffer, ctx ? ctx->seg_slab : NULL);
+	SegStore_init(&con->client_buffer, ctx ? ctx->seg_slab : NULL);
+	ubi_dlInitList(&con->released);
+	PrivData_init(&con->priv_data);
+	Arena_init(&con->arena, con->arena_buf, sizeof(con->arena_buf));
 
 	con->client_state = TCP_CONNTRACK_NONE;
 	con->server_state = TCP_CONNTRACK_NONE;
 	con->id = ++id_seq;
 	con->config = config;
+	con->hash_slot = HTTP_CONN_NO_SLOT;
+	con->hold = WfConfig_getHoldOutOfOrder(config);
 
 	__add_request_new_to_list(con);
 
 	return con;
-	/* error cases */
-
-	free_server_buffer:
-	free(con->server_buffer);
+}
 
-	free_req_list:
-	free(con->request_list);
+/** memory a buffered packet accounts for in buffered_bytes */
+static inline unsigned int __pkt_buffered_size(struct Ipv4TcpPkt *pkt)
+{
+	/* a held packet's data stays in its receive buffer, the caller that
+	pins the buffer accounts for all of it */
+	if (pkt->held)
+		return sizeof(struct Ipv4TcpPkt);
 
-	free_con:
-	free(con);
+	return sizeof(struct Ipv4TcpPkt) + pkt->nl_buffer_size;
+}
 
-	return NULL;
+/** hand a held packet back for its verdict */
+static void __pkt_release(struct HttpConn *con, struct Ipv4TcpPkt *pkt)
+{
+	con->held_pkts--;
+	ubi_dlAddTail(&con->released, pkt);
 }
 
-static void __pkt_list_free(ipv4_tcp_pkt_list_t *pkt_list)
+static void __pkt_list_free(struct HttpConn *con, struct SegStore *pkt_list)
 {
 	struct Ipv4TcpPkt *pkt;
 
-	DBG(5,"packet list count=%lu\n",ubi_dlCount(pkt_list));
-	while ( (pkt = (struct Ipv4TcpPkt *) ubi_dlRemHead(pkt_list)) ) {
-		DBG(1, "Warning freeing packet %p in buffer count=%lu\n",
-			pkt, ubi_dlCount(pkt_list));
+	DBG(5,"packet list count=%u\n", SegStore_count(pkt_list));
+	while ( (pkt = SegStore_popFirst(pkt_list)) ) {
+		DBG(1, "Warning freeing packet %p in buffer count=%u\n",
+			pkt, SegStore_count(pkt_list));
+		con->buffered_bytes -= __pkt_buffered_size(pkt);
 		Ipv4TcpPkt_del(&pkt);
 	}
-	free(pkt_list);
+}
+
+/**
+* Give up on the gaps, move every held packet to the released list
+* with its verdict unchanged.  Copies of packets are freed.
+*/
+void HttpConn_releaseHeld(struct HttpConn* con)
+{
+	struct SegStore *stores[2] = { &con->server_buffer, &con->client_buffer };
+	struct Ipv4TcpPkt *pkt;
+	int i;
+
+	for (i = 0; i < 2 && con->held_pkts; i++) {
+		while ((pkt = SegStore_popFirst(stores[i]))) {
+			con->buffered_bytes -= __pkt_buffered_size(pkt);
+			if (pkt->held)
+				__pkt_release(con, pkt);
+			else
+				Ipv4TcpPkt_del(&pkt);
+		}
+	}
+}
+
+/**
+* Held packets get no verdict before the gap fills, so a reset of one
+* more held packet would not be sent either.  Refuse to hold past
+* pkt_buf_size and leave the connection to the caller to evict.
+*/
+static bool __pkt_list_hold_full(struct HttpConn *con, struct SegStore *pkt_list)
+{
+	if (!con->hold || SegStore_count(pkt_list) < WfConfig_getPktBuffSize(con->config))
+		return false;
+
+	con->hold_full = true;
+	return true;
 }
 
 /* insert packet into buffer for processing later
@@ -165,41 +265,25 @@ static void __pkt_list_free(ipv4_tcp_pkt_list_t *pkt_list)
 static void __pkt_list_insert(struct HttpConn *con, struct HttpReq *req,
 	struct Ipv4TcpPkt *pkt, bool from_server, int seq_delta)
 {
-	struct Ipv4TcpPkt *next_pkt;
-	struct Ipv4TcpPkt *cur_pkt = NULL;
 	struct Ipv4TcpPkt *new_pkt;
-	ipv4_tcp_pkt_list_t *pkt_list;
-	int i = 0;
+	struct Ipv4TcpPkt *old_pkt;
+	struct SegStore *pkt_list;
 	const int EXTRA_BUFF = 5000;
 
 	if (from_server)
-		pkt_list = con->server_buffer;
+		pkt_list = &con->server_buffer;
 	else
-		pkt_list = con->client_buffer;
-
-	DBG(2, "Saving packet pkt->seq_num=%u list=%p count=%lu\n",
-		pkt->seq_num, pkt_list, ubi_dlCount(pkt_list));
-	next_pkt = (struct Ipv4TcpPkt *) ubi_dlFirst(pkt_list);
-
-	/* find location to insert packet in list */
-	while(next_pkt) {
+		pkt_list = &con->client_buffer;
 
-		DBG(2, "cur_pkt->seq_num=%u pkt->seq_num=%u delta = %d payload_len=%u pos =%u/%lu data=%p\n",
-			next_pkt->seq_num, pkt->seq_num,
-			next_pkt->seq_num - pkt->seq_num,
-			next_pkt->tcp_payload_length,
-			i, ubi_dlCount(pkt_list), pkt->ip_data);
-
-		if (pkt->seq_num < next_pkt->seq_num)
-			break; // found location to insert
-		cur_pkt = next_pkt;
-
-		next_pkt = (struct Ipv4TcpPkt *) ubi_dlNext(cur_pkt);
-		i++;
-	}
+	DBG(2, "Saving packet pkt->seq_num=%u len=%u list=%p count=%u\n",
+		pkt->seq_num, pkt->tcp_payload_length, pkt_list, SegStore_count(pkt_list));
 
+	if (con->hold) {
+		// keep the original, its verdict waits until it can be parsed
+		new_pkt = pkt;
+		new_pkt->held = true;
 	// get a copy, because the original will be passed back to iptables/netfilter queue
-	if (from_server && req->server_resp_msg.state == msg_state_read_content
+	} else if (from_server && req->server_resp_msg.state == msg_state_read_content
 		&& req->server_resp_msg.content_length > EXTRA_BUFF
 		&& (!ContentFilter_hasFileFilter(req->cf)
 			|| req->server_resp_msg.content_length >
@@ -212,25 +296,35 @@ static void __pkt_list_insert(struct HttpConn *con, struct HttpReq *req,
 		new_pkt = Ipv4TcpPkt_clone(pkt, true);
 	}
 
-	// if list is empty this will insert at head
-	ubi_dlInsert(pkt_list, (ubi_dlNodePtr) new_pkt, (ubi_dlNodePtr) cur_pkt);
-
-	DBG(2, "Saving packet pkt->seq_num=%u list=%p position =%u/%lu d=%p\n",
-		pkt->seq_num, pkt_list, i, ubi_dlCount(pkt_list), pkt->ip_data);
+	if (!new_pkt) {
+		ERROR("No memory to save packet seq_num=%u\n", pkt->seq_num);
+		return;
+	}
 
-	// DEBUG only
-	while(next_pkt) {
+	con->buffered_bytes += __pkt_buffered_size(new_pkt);
 
-		DBG(2, "cur_pkt->seq_num=%u pkt->seq_num=%u delta=%d len=%u pos =%u/%lu d=%p\n",
-			next_pkt->seq_num, pkt->seq_num,
-			next_pkt->seq_num - pkt->seq_num,
-			next_pkt->tcp_payload_length,
-			i, ubi_dlCount(pkt_list), pkt->ip_data);
+	// retransmits of buffered data give back either the new or the old copy
+	old_pkt = SegStore_insert(pkt_list, new_pkt);
+	if (new_pkt->held && old_pkt != new_pkt) {
+		if (!con->held_pkts++)
+			con->held_since = con->last_pkt;
+	}
 
-			cur_pkt = next_pkt;
+	if (old_pkt) {
+		DBG(2, "Dropping covered packet seq_num=%u len=%u\n",
+			old_pkt->seq_num, old_pkt->tcp_payload_length);
+		con->buffered_bytes -= __pkt_buffered_size(old_pkt);
 
-			next_pkt = (struct Ipv4TcpPkt *) ubi_dlNext(cur_pkt);
-			i++;
+		if (!old_pkt->held) {
+			Ipv4TcpPkt_del(&old_pkt);
+		} else {
+			// the data is held in another packet, this one is not needed
+			Ipv4TcpPkt_setNlVerictDrop(old_pkt);
+			if (old_pkt == pkt)
+				pkt->held = false;
+			else
+				__pkt_release(con, old_pkt);
+		}
 	}
 }
 
@@ -239,10 +333,11 @@ void HttpConn_del(struct HttpConn **con_in)
 	struct HttpConn *con = *con_in;
 	struct HttpReq* req;
 	struct HttpReq* next_req = NULL;
+	struct Ipv4TcpPkt *pkt;
 
 	DBG(5, "Free http con %p id=%u\n", con, con->id);
 	/*for each object in list */
-	for (next_req = (struct HttpReq *)ubi_dlFirst(con->request_list);
+	for (next_req = (struct HttpReq *)ubi_dlFirst(&con->request_list);
 		next_req; ) {
 
 		req = next_req;
@@ -252,15 +347,20 @@ void HttpConn_del(struct HttpConn **con_in)
 		DBG(5, "Freed http req %p\n", req);
 
 	}
-	free (con->request_list);
 
-	__pkt_list_free(con->server_buffer);
-	__pkt_list_free(con->client_buffer);
+	__pkt_list_free(con, &con->server_buffer);
+	__pkt_list_free(con, &con->client_buffer);
+	while ((pkt = (struct Ipv4TcpPkt *) ubi_dlRemHead(&con->released)))
+		Ipv4TcpPkt_del(&pkt);
 
 	// free private data
-	PrivData_del(&con->priv_data);
+	PrivData_destroy(&con->priv_data);
+	Arena_free(&con->arena);
 
-	free (con);
+	if (con->ctx)
+		Slab_free(con->ctx->con_slab, con);
+	else
+		free (con);
 	*con_in = NULL;
 }
 
@@ -338,6 +438,7 @@ int __gen_error_packet(struct HttpReq *req, struct Ipv4TcpPkt *pkt,
 	uint16_t all_hdr_len;
 	unsigned char *new_ip_pkt;
 	uint16_t cksum;
+	uint16_t old_len;
 	unsigned short *sptr;
 	const char *reason = "Access denied";
 
@@ -411,15 +512,17 @@ int __gen_error_packet(struct HttpReq *req, struct Ipv4TcpPkt *pkt,
 		new_ip_pkt[8], new_ip_pkt[9]);
 
  	sptr = (unsigned short *) &new_ip_pkt[2];  // IP Packet size
+	old_len = *sptr;
  	*sptr = htons(new_pkt_size); // set new size
 
 	DBG(6, "new_pkt_size=%d sptr=0x%hx\n", new_pkt_size, *sptr);
 
-	sptr = (unsigned short *) &new_ip_pkt[10];  // IP header checksum8
-	*sptr = 0;
-	cksum = get_cksum16((unsigned short *)new_ip_pkt, pkt->ip_hdr_len, 0);
-	*sptr = cksum;
+	// only the length changed in the IP header
+	cksum = *(uint16_t *) &new_ip_pkt[10];
+	cksum = adjust_cksum16(cksum, old_len, *sptr);
+	*(uint16_t *) &new_ip_pkt[10] = cksum;
 
+	// the payload is new, only it and the headers are summed
 	Ipv4TcpPkt_resetTcpCksum(new_ip_pkt, new_pkt_size, pkt->ip_hdr_len);
 
 	DBG(5, "new calc cksum=%hu=0x%04hx new_pkt_size=%d pkt->ip_hdr_len=%d\n", cksum, cksum, new_pkt_size, pkt->ip_hdr_len);
@@ -490,6 +593,8 @@ static int __processs_req_payload(struct HttpConn* con, struct HttpReq *req, str
 	unsigned len;
 	unsigned int str_len;
 	int ret;
+	struct HttpScan scan;
+	struct HttpScan line_scan; // over a line joined from two packets
 	struct http_msg *msg;
 // 	char value_str[16];  // for parsing numbers
 
@@ -509,84 +614,19 @@ static int __processs_req_payload(struct HttpConn* con, struct HttpReq *req, str
 				break;
 			}
 
-			// to check begining of packet for GET/POST/PUT/OPTOINS
-			len = MIN(pkt->tcp_payload_length, 15);
-
-			if ( (p = memmem(pkt->tcp_payload, len, "GET ", 4)) ) {
-				req->method = http_method_get; /* RFC 2616   sect 9.3 */
-				DBG(4, "HTTP method GET\n");
-			} else if ( (p = memmem(pkt->tcp_payload, len, "OPTIONS ", 8)) ) {
-				req->method = http_method_options; /* RFC 2616   sect 9.2 */
-				DBG(4, "HTTP method OPTIONS\n");
-			} else if ( (p = memmem(pkt->tcp_payload, len, "HEAD ", 5)) ) {
-				/* HEAD response will not have any message body RFC 2616 Sect 9.4*/
-				req->method = http_method_head;
-				DBG(4, "HTTP method HEAD\n");
-			} else if ( (p = memmem(pkt->tcp_payload, len, "POST ", 5)) ) {
-				req->method = http_method_post;
-				DBG(4, "HTTP method POST\n");
-			} else if ( (p = memmem(pkt->tcp_payload, len, "PUT ", 4)) ) {
-				req->method = http_method_put;
-				DBG(4, "HTTP method PUT\n");
-			} else if ( (p = memmem(pkt->tcp_payload, len, "DELETE ", 6)) ) {
-				req->method = http_method_delete;
-				DBG(4, "HTTP method DELETE\n");
-			} else if ( (p = memmem(pkt->tcp_payload, len, "TRACE ", 6)) ) {
-				req->method = http_method_trace;
-				DBG(4, "HTTP method TRACE\n");
-			} else if ( (p = memmem(pkt->tcp_payload, len, "CONNECT ", 5)) ) {
-				req->method = http_method_connect;
-				DBG(4, "HTTP method CONNECT\n");
-			} else if ( (p = memmem(pkt->tcp_payload, len, "PROPFIND ", 8)) ) {
-				req->method = http_method_propfind;
-				DBG(4, "HTTP method PROPFIND\n");
-			} else if ( (p = memmem(pkt->tcp_payload, len, "PROPPATCH ", 9)) ) {
-				req->method = http_method_proppatch;
-				DBG(4, "HTTP method PROPPATCH\n");
-			} else if ( (p = memmem(pkt->tcp_payload, len, "COPY ", 5)) ) {
-				req->method = http_method_copy;
-				DBG(4, "HTTP method COPY\n");
-			} else if ( (p = memmem(pkt->tcp_payload, len, "MOVE ", 5)) ) {
-				req->method = http_method_move;
-				DBG(4, "HTTP method MOVE\n");
-			} else if ( (p = memmem(pkt->tcp_payload, len, "LOCK ", 5)) ) {
-				req->method = http_method_lock;
-				DBG(4, "HTTP method LOCK\n");
-			} else if ( (p = memmem(pkt->tcp_payload, len, "UNLOCK ", 7)) ) {
-				req->method = http_method_unlock;
-				DBG(4, "HTTP method UNLOCK\n");
-			} else if ( (p = memmem(pkt->tcp_payload, len, "REPORT ", 6)) ) {
-				req->method = http_method_report;
-				DBG(4, "HTTP method REPORT\n");
-			} else if ( (p = memmem(pkt->tcp_payload, len, "VERSION-CONTROL  ", 15)) ) {
-				req->method = http_method_version_control;
-				DBG(4, "HTTP method VERSION-CONTROL\n");
-			} else if ( (p = memmem(pkt->tcp_payload, len, "CHECKOUT ", 9)) ) {
-				req->method = http_method_checkout;
-				DBG(4, "HTTP method CHECKOUT\n");
-			} else if ( (p = memmem(pkt->tcp_payload, len, "CHECKIN  ", 8)) ) {
-				req->method = http_method_checkin;
-				DBG(4, "HTTP method CHECKIN\n");
-			} else if ( (p = memmem(pkt->tcp_payload, len, "UNCHECKOUT ", 11)) ) {
-				req->method = http_method_uncheckout;
-				DBG(4, "HTTP method UNCHECKOUT\n");
-			} else if ( (p = memmem(pkt->tcp_payload, len, "MKWORKSPACE ", 11)) ) {
-				req->method = http_method_mkworkspace;
-				DBG(4, "HTTP method MKWORKSPACE\n");
-			} else {
-				msg->state = msg_state_partial;
+			// check begining of packet for GET/POST/PUT/OPTIONS
+			ret = HttpMethod_parse(pkt->tcp_payload, pkt->tcp_payload_length, &req->method);
+			if (!ret) {
 				DBG(4, "HTTP method not detected\n");
-			}
-
-			if (!p) {
 				//TODO ignore invalid HTTP
 				WARN(" Invalid HTTP \n");
 				con->not_http = true;
 				__handle_non_http_pkt(con, pkt);
 				return 0;
 			}
-			p += 4; // 'GET ' is shortest
-			len = pkt->tcp_payload_length-4;
+			DBG(4, "HTTP method %s\n", HttpMethod_name(req->method));
+			p = (unsigned char*) pkt->tcp_payload + ret;
+			len = pkt->tcp_payload_length - ret;
 
 			// advance past any extra white space
 			while ((*p == ' ' || *p == '\t') && len > 0) {
@@ -601,10 +641,10 @@ static int __processs_req_payload(struct HttpConn* con, struct HttpReq *req, str
 			}
 			str_len = end-p;
 			DBG(4, "GET/POST request path len=%d remaining=%d\n", str_len, len);
-			req->path = malloc(str_len+1);
-			memcpy(req->path, p, str_len);
-			req->path[str_len] = 0; /* NULL term */
-			DBG(4, "REQEUEST path='%s'\n", req->path);
+			if (HttpReq_setStr(req, &req->path, p, str_len)) {
+				ERROR_FATAL("Out of memory\n");
+			}
+			DBG(4, "REQEUEST path='%s'\n", req->path.str);
 			while ((*end <= ' ' || *end > 126) && len > 0) {
 				if (*end == '\n') {
 					// If CRLFCRLF then end of request
@@ -619,18 +659,18 @@ static int __processs_req_payload(struct HttpConn* con, struct HttpReq *req, str
 			p = end;
 		// Fall through
 		case msg_state_partial:
+			HttpScan_init(&scan, p, len);
 
 			// check if we have left over data from previous packet to parse
 			if (unlikely(msg->buf_line != NULL)) {
 				DBG(6, "Data from previous packet to parse %d bytes \n", msg->buf_line_len);
 
-				end = p;
 				// advance to end of line
-				for (str_len = 0; len && (*end != '\r' && *end != '\n') ; ) {
-					len--; // consume current packet
-					end++;
-					str_len++;
-				}
+				end = (unsigned char *) HttpScan_findEol(&scan, p);
+				if (!end)
+					end = p + len;
+				str_len = end - p;
+				len -= str_len; // consume current packet
 
 				// include end of line markers
 				while (len && (*end == '\r' || *end == '\n')) {
@@ -643,7 +683,7 @@ static int __processs_req_payload(struct HttpConn* con, struct HttpReq *req, str
 					str_len, msg->buf_line_len);
 
 				// alloc line buffer to be size of previous part and current line
-				line = malloc(msg->buf_line_len + str_len);
+				line = Arena_alloc(&con->arena, msg->buf_line_len + str_len);
 				if (unlikely(!line)) {
 					ERROR_FATAL("Out of memory\n");
 				}
@@ -656,13 +696,12 @@ static int __processs_req_payload(struct HttpConn* con, struct HttpReq *req, str
 
 				// cleanup incase this data is part of a fragment and
 				// HttpReq_processHeaderLine() will need to save another partial packet
-				free(msg->buf_line);
 				msg->buf_line = NULL; // NULL to mark unused
 				msg->buf_line_len = 0;
 				p = end; // update p, this is where we will later continue at
-				end = line;  // tmp pointer so we don't loose ours, to later free line
-				ret = HttpReq_processHeaderLine(req, true, &end, &str_len);
-				free(line);
+				end = line;  // tmp pointer so we don't loose ours, line stays in the arena
+				HttpScan_init(&line_scan, line, str_len);
+				ret = HttpReq_processHeaderLine(req, true, &line_scan, &end, &str_len);
 
 				// if end of current request
 				if (ret == TWO_EOL) {
@@ -673,7 +712,7 @@ static int __processs_req_payload(struct HttpConn* con, struct HttpReq *req, str
 
 			DBG(7, "p=0x%hhx len=%d\n", *p, len);
 
-			while ( (ret = HttpReq_processHeaderLine(req, true, &p, &len)) == ONE_EOL && len > 0) {
+			while ( (ret = HttpReq_processHeaderLine(req, true, &scan, &p, &len)) == ONE_EOL && len > 0) {
 				// Processing request line by line
 			}
 
@@ -708,7 +747,7 @@ static int __processs_req_payload(struct HttpConn* con, struct HttpReq *req, str
 					&& pkt->tcp_payload_length > 2 && (*p == '\r'|| *p == '\n')) {
 
 					DBG(5, "save one EOL to buffer\n");
-					msg->buf_line = malloc(4);
+					msg->buf_line = Arena_alloc(&con->arena, 4);
 					str_len = 0;
 
 					do {
@@ -754,51 +793,46 @@ static int __processs_req_payload(struct HttpConn* con, struct HttpReq *req, str
 
 	msg->state = msg_state_complete;
 	con->cur_request++;
-	if (!req->path) {
+	if (!req->path.str) {
 		ERROR_FATAL("BUG parsing URL Path\n");
 	}
-	if (!strncmp(req->path,"http://",7)) {
-		req->url = strdup(req->path);
-	} else {
-		if (req->path[0] == '/')
-			ret = asprintf(&req->url,"http://%s%s", req->host, req->path);
-		else
-			ret = asprintf(&req->url,"http://%s/%s", req->host, req->path);
-		if (ret == -1) {
-			ERROR_FATAL("asprintf failed!\n");
-		}
-	}
+	HttpReq_buildUrl(req);
 
-	DBG(2, "path='%s' host='%s' url='%s'\n", req->path, req->host, req->url);
+	DBG(2, "path='%s' host='%s' url='%s'\n", req->path.str, req->host.str, req->url.str);
 	ContentFilter_requestStart(req->cf, req);
 	return 0;
 }
 
-/* FIXME BUG
-RFC2616  "Transfer-encoding: chunked" is not handled properly,
-and we only detect end of transfer when connection closes. Not a crash bug,
-but prevents blocking request numbers+1 on the same connections
+static int __processs_next_response(struct HttpConn* con, struct Ipv4TcpPkt *pkt,
+	unsigned char *p, unsigned int len);
+
+/*
+A response ends after Content-Length bytes of body, or at the last chunk
+of a "Transfer-Encoding: chunked" body, see HttpReq_consumeResponseContent().
+Without either it ends when the connection closes.
+p and len are the part of the packet payload that belongs to this response.
 */
-static int __processs_response_payload(struct HttpConn* con, struct HttpReq *req,  struct Ipv4TcpPkt *pkt)
+static int __processs_response_payload(struct HttpConn* con, struct HttpReq *req,
+	struct Ipv4TcpPkt *pkt, unsigned char *p, unsigned int len)
 {
 
-	unsigned int len;
 	char value_str[16];
-	unsigned char *p;
 	unsigned char *end;
 	enum Action verdict;
+	unsigned int rest;
 	int ret;
 	unsigned char *line = NULL;
 	unsigned int str_len;
+	struct HttpScan scan;
+	struct HttpScan line_scan; // over a line joined from two packets
 	struct http_msg *msg;
+	bool no_body;
 
 	DBG(5, "process http response cur_response= %d\n", con->cur_response);
 	DBG(5, "http response id=%d content_received=%llu content_length=%llu\n",
 			req->id, (long long)req->server_resp_msg.content_received,
 			(long long) req->server_resp_msg.content_length);
 
- 	p = (unsigned char*) pkt->tcp_payload;
- 	len = pkt->tcp_payload_length;
 	msg = &req->server_resp_msg;
 
 	switch (msg->state) {
@@ -836,18 +870,18 @@ static int __processs_response_payload(struct HttpConn* con, struct HttpReq *req
 
 		// fall through
 		case msg_state_partial:
+			HttpScan_init(&scan, p, len);
 
 			// check if we have left over data from previous packet to parse
 			if (unlikely(msg->buf_line != NULL)) {
 				DBG(6, "Data from previous packet to parse %d bytes \n", msg->buf_line_len);
 
-				end = p;
 				// advance to end of line
-				for (str_len = 0; len && (*end != '\r' && *end != '\n') ; ) {
-					len--; // consume current packet
-					end++;
-					str_len++;
-				}
+				end = (unsigned char *) HttpScan_findEol(&scan, p);
+				if (!end)
+					end = p + len;
+				str_len = end - p;
+				len -= str_len; // consume current packet
 
 				// include end of line markers
 				while (len && (*end == '\r' || *end == '\n')) {
@@ -860,7 +894,7 @@ static int __processs_response_payload(struct HttpConn* con, struct HttpReq *req
 					str_len, msg->buf_line_len);
 
 					// alloc line buffer to be size of previous part and current line
-					line = malloc(msg->buf_line_len + str_len);
+					line = Arena_alloc(&con->arena, msg->buf_line_len + str_len);
 					if (unlikely(!line)) {
 						ERROR_FATAL("Out of memory\n");
 					}
@@ -873,13 +907,12 @@ static int __processs_response_payload(struct HttpConn* con, struct HttpReq *req
 
 					// cleanup incase this data is part of a fragment and
 					// HttpReq_processHeaderLine() will need to save another partial packet
-					free(msg->buf_line);
 					msg->buf_line = NULL; // NULL to mark unused
 					msg->buf_line_len = 0;
 					p = end; // update p, this is where we will later continue at
-					end = line;  // tmp pointer so we don't loose ours, to later free line
-					ret = HttpReq_processHeaderLine(req, false, &end, &str_len);
-					free(line);
+					end = line;  // tmp pointer so we don't loose ours, line stays in the arena
+					HttpScan_init(&line_scan, line, str_len);
+					ret = HttpReq_processHeaderLine(req, false, &line_scan, &end, &str_len);
 
 					// if end of current request
 					if (ret == TWO_EOL) {
@@ -890,7 +923,7 @@ static int __processs_response_payload(struct HttpConn* con, struct HttpReq *req
 
 			DBG(7, "p=0x%hhx len=%d\n", *p, len);
 
-			while ( (ret = HttpReq_processHeaderLine(req, false, &p, &len)) == ONE_EOL && len > 0) {
+			while ( (ret = HttpReq_processHeaderLine(req, false, &scan, &p, &len)) == ONE_EOL && len > 0) {
 				// Processing request line by line
 			}
 
@@ -915,7 +948,7 @@ static int __processs_response_payload(struct HttpConn* con, struct HttpReq *req
 						&& pkt->tcp_payload_length > 2 && (*p == '\r'|| *p == '\n')) {
 
 							DBG(5, "save one EOL to buffer\n");
-							msg->buf_line = malloc(4);
+							msg->buf_line = Arena_alloc(&con->arena, 4);
 							str_len = 0;
 
 							do {
@@ -935,7 +968,7 @@ static int __processs_response_payload(struct HttpConn* con, struct HttpReq *req
 
 		case msg_state_read_content:
 			DBG(1, "Recieving  msg_state_read_content\n");
-			verdict = HttpReq_consumeResponseContent(req, p, len);
+			verdict = HttpReq_consumeResponseContent(req, p, len, &rest);
 
 			//FIXME  if the payload is more than the content length, the may contain another request.
 
@@ -945,6 +978,8 @@ static int __processs_response_payload(struct HttpConn* con, struct HttpReq *req
 				return 0;
 			}
 
+			if (rest)
+				return __processs_next_response(con, pkt, p + len - rest, rest);
 		break;
 		case msg_state_complete:
 			DBG(1, "FIXME TODO\n");
@@ -959,12 +994,22 @@ static int __processs_response_payload(struct HttpConn* con, struct HttpReq *req
 
 	response_hdr_complete:
 
-	verdict = HttpReq_consumeResponseContent(req, p, len);
+	// RFC2616 status codes 204 and 304 and responses to HEAD have no message body,
+	// whatever their Content-Length or Transfer-Encoding say
+	no_body = req->resp_status_code == 204 || req->resp_status_code == 304
+		|| req->method == http_method_head;
 
-	if (verdict && (Action_malware | Action_reject | Action_virus | Action_phishing)){
-		DBG(3, "Generate error msg for bad content verdict = 0x%x\n", verdict);
-		__gen_error_packet(req, pkt, verdict);
-		return 0;
+	if (no_body) {
+		// the rest of the packet is the next response
+		rest = len;
+	} else {
+		verdict = HttpReq_consumeResponseContent(req, p, len, &rest);
+
+		if (verdict && (Action_malware | Action_reject | Action_virus | Action_phishing)){
+			DBG(3, "Generate error msg for bad content verdict = 0x%x\n", verdict);
+			__gen_error_packet(req, pkt, verdict);
+			return 0;
+		}
 	}
 
 	// NOTE not going to check verdict on:
@@ -989,6 +1034,13 @@ static int __processs_response_payload(struct HttpConn* con, struct HttpReq *req
 			default:
 				break;
 		}
+
+		// a modified connection keeps needing its sequence numbers fixed
+		if ((verdict & Action_trust) && !con->server_data_altered
+			&& !(verdict & (Action_reject | Action_virus | Action_malware | Action_phishing))) {
+			DBG(2, "Trust connection id=%u\n", con->id);
+			con->trusted = true;
+		}
 	}
 
 	if (req->rule_matched && Rule_getMark(req->rule_matched)) {
@@ -997,21 +1049,38 @@ static int __processs_response_payload(struct HttpConn* con, struct HttpReq *req
 			Rule_getMask(req->rule_matched));
 	}
 
-	// RFC2616 status codes 204 and 304 have no message body
-	if (req->resp_status_code == 204 || req->resp_status_code == 304 ||
-		req->resp_status_code == 400 ||
-		req->method == http_method_head) {
+	// a 400 is taken as complete at its headers, unless its body already ended
+	if (no_body || (req->resp_status_code == 400 && msg->state != msg_state_complete)) {
 		// response codes that have no message body
 		DBG(5, "Http message code %u with no body\n", req->resp_status_code);
 		req->con->cur_response++;
 		msg->state = msg_state_complete;
 	}
 
-
+	if (rest)
+		return __processs_next_response(con, pkt, p + len - rest, rest);
 
 	return 0;
 }
 
+/**
+* Bytes after the end of a response, in the same packet, are the start
+* of the next response on the connection.
+*/
+static int __processs_next_response(struct HttpConn* con, struct Ipv4TcpPkt *pkt,
+	unsigned char *p, unsigned int len)
+{
+	struct HttpReq *req = __find_request(con, con->cur_response);
+
+	if (!req) {
+		DBG(5, "request/response not found allocate new\n");
+		req = __add_request_new_to_list(con);
+	}
+
+	DBG(3, "next response id=%d in the same packet len=%u\n", req->id, len);
+	return __processs_response_payload(con, req, pkt, p, len);
+}
+
 #if 0
 static int __processs_pkt_payload(struct HttpConn* con, struct Ipv4TcpPkt *pkt)
 {
@@ -1052,21 +1121,60 @@ static int __processs_pkt_payload(struct HttpConn* con, struct Ipv4TcpPkt *pkt)
 }
 #endif
 
-static int __pkt_list_process(struct HttpConn* con, ipv4_tcp_pkt_list_t *pkt_list)
+/**
+* Replay buffered packets that the stream has caught up with.
+* Every contiguous segment is processed in one pass, stopping at the
+* next gap.  Data already seen is trimmed off the front of a segment,
+* or the segment is dropped if nothing new is left.
+* Replayed packets go through HttpConn_processsPkt(), which does not
+* drain again while con->draining is set, so the stack stays flat.
+*/
+static void __pkt_list_process(struct HttpConn* con, bool from_server)
 {
+	struct SegStore *pkt_list = from_server ? &con->server_buffer : &con->client_buffer;
 	struct Ipv4TcpPkt *next_pkt;
-	int ret = 0;
+	uint32_t next_seq;
+	uint32_t overlap;
 
+	if (con->draining)
+		return;
 
-	next_pkt = (struct Ipv4TcpPkt *) ubi_dlRemHead(pkt_list);
-	if (next_pkt) {
-		DBG(2, "Extracted saved packet from list count=%lu pkt=%p\n",
-			ubi_dlCount(pkt_list), next_pkt);
-		ret = HttpConn_processsPkt(con, next_pkt);
-		Ipv4TcpPkt_del(&next_pkt); // delete packet as we are done with it.
-	}
+	con->draining = true;
+	while ((next_pkt = SegStore_first(pkt_list))) {
+
+		next_seq = from_server ? con->server_seq_num : con->client_seq_num;
 
-	return ret;
+		// same window as HttpConn_processsPkt(), a delta of 1 is in order
+		if ((int) (next_pkt->seq_num - next_seq) > 1)
+			break;
+
+		SegStore_popFirst(pkt_list);
+		con->buffered_bytes -= __pkt_buffered_size(next_pkt);
+		DBG(2, "Extracted saved packet from list count=%u pkt=%p\n",
+			SegStore_count(pkt_list), next_pkt);
+
+		if (SEQ_LT(next_pkt->seq_num, next_seq)) {
+			overlap = next_seq - next_pkt->seq_num;
+			if (overlap >= next_pkt->tcp_payload_length) {
+				// already parsed from another packet
+				if (next_pkt->held)
+					__pkt_release(con, next_pkt);
+				else
+					Ipv4TcpPkt_del(&next_pkt);
+				continue;
+			}
+			next_pkt->seq_num += overlap;
+			next_pkt->tcp_payload += overlap;
+			next_pkt->tcp_payload_length -= overlap;
+		}
+
+		HttpConn_processsPkt(con, next_pkt);
+		if (next_pkt->held)
+			__pkt_release(con, next_pkt); // parsed, its verdict can go
+		else
+			Ipv4TcpPkt_del(&next_pkt); // delete packet as we are done with it.
+	}
+	con->draining = false;
 }
 
 int HttpConn_processsPkt(struct HttpConn* con, struct Ipv4TcpPkt *pkt)
@@ -1147,9 +1255,15 @@ int HttpConn_processsPkt(struct HttpConn* con, struct Ipv4TcpPkt *pkt)
 
 				DBG(1, "Save packet from server delta=%d\n", delta);
 
+				if (__pkt_list_hold_full(con, &con->server_buffer)) {
+					WARN("Out of order server buffer full reset connection.\n");
+					Ipv4TcpPkt_resetTcpCon(pkt);
+					return -EBUSY;
+				}
+
 				__pkt_list_insert(con, req, pkt, from_server, delta);
 
-				if (ubi_dlCount(con->server_buffer) > WfConfig_getPktBuffSize(con->config)) {
+				if (SegStore_count(&con->server_buffer) > WfConfig_getPktBuffSize(con->config)) {
 					WARN("Out of order server buffer full reset connection.\n");
 					Ipv4TcpPkt_resetTcpCon(pkt);
 				}
@@ -1160,7 +1274,8 @@ int HttpConn_processsPkt(struct HttpConn* con, struct Ipv4TcpPkt *pkt)
 				con->server_seq_num = pkt->seq_num + pkt->tcp_payload_length;
 				con->server_ack_num = pkt->ack_num;
 // 				__processs_pkt_payload(con, pkt);
-				__processs_response_payload(con, req, pkt);
+				__processs_response_payload(con, req, pkt,
+					(unsigned char *) pkt->tcp_payload, pkt->tcp_payload_length);
 // 				con->throttling = 0;
 
 			}
@@ -1170,7 +1285,7 @@ int HttpConn_processsPkt(struct HttpConn* con, struct Ipv4TcpPkt *pkt)
 		con->server_seq_num, pkt->seq_num, delta);
 
 		// process any out of order packets that come after current pkt
-		__pkt_list_process(con, con->server_buffer);
+		__pkt_list_process(con, true);
 
 		con->server_state = __HttpConn_checkFlags(con, pkt, con->server_state);
 
@@ -1199,9 +1314,14 @@ int HttpConn_processsPkt(struct HttpConn* con, struct Ipv4TcpPkt *pkt)
 				return MIN(con->server_state, con->client_state);
 			} else if (delta > 1) {
 				DBG(1, "Save packet from client\n");
+				if (__pkt_list_hold_full(con, &con->client_buffer)) {
+					ERROR("Out of order client buffer full reset connection.\n");
+					Ipv4TcpPkt_resetTcpCon(pkt);
+					return -EBUSY;
+				}
 				__pkt_list_insert(con, req, pkt, from_server, delta);
 
-				if (ubi_dlCount(con->client_buffer) > WfConfig_getPktBuffSize(con->config)) {
+				if (SegStore_count(&con->client_buffer) > WfConfig_getPktBuffSize(con->config)) {
 					ERROR("Out of order client buffer full reset connection.\n");
 					Ipv4TcpPkt_resetTcpCon(pkt);
 				}
@@ -1216,7 +1336,7 @@ int HttpConn_processsPkt(struct HttpConn* con, struct Ipv4TcpPkt *pkt)
 		, con->client_seq_num, pkt->seq_num, delta);
 		con->client_state = __HttpConn_checkFlags(con, pkt, con->client_state);
 		// process any out of order packets that come after this one
-		__pkt_list_process(con, con->client_buffer);
+		__pkt_list_process(con, false);
 	}
 
 	DBG(5, " Server state=%d ; client state = %d  client_seq_num= %u server_seq_num= %u\n",
@@ -28,7 +28,11 @@ THE SOFTWARE.
 #include <ubiqx/ubi_dLinkList.h>
 #include <linux/netfilter/nf_conntrack_tcp.h>
 
+#include "Arena.h"
 #include "HttpReq.h"
+#include "PrivData.h"
+#include "SegStore.h"
+#include "TimerWheel.h"
 
 /**
 * @defgroup HttpConn  HTTP connection
@@ -36,22 +40,49 @@ THE SOFTWARE.
 */
 
 struct ContentFilter;
+struct Slab;
 
 typedef ubi_dlList ipv4_tcp_pkt_list_t;
 
+/**
+* Per queue allocation context.
+* HttpConn, its HttpReqs and their inline members come from these slabs,
+* so connection setup and teardown do not touch malloc in steady state.
+* Only used from the queue thread.
+*/
+struct HttpConnCtx {
+	struct Slab *con_slab;
+	struct Slab *req_slab;
+	struct Slab *seg_slab; /**< SegStore nodes of out of order packets */
+};
+
+/** first block of HttpConn::arena, embedded in the connection */
+#define HTTP_CONN_ARENA_SIZE 1024
+
+/** HttpConn::hash_slot of a connection not in a HttpConnTable */
+#define HTTP_CONN_NO_SLOT 0xFFFFFFFF
+
 struct HttpConn {
 	ubi_dlNode node;	/** ubiqx "internal" data */
 	uint32_t id;
 	struct Ipv4TcpTuple tuple;
+	uint32_t hash_slot; /**< slot in the queue's HttpConnTable */
 	uint32_t server_seq_num;  // note sure if this needed
 	uint32_t server_ack_num;
 	uint32_t client_seq_num;
 	uint32_t client_ack_num;
 	bool server_data_altered;
 	bool not_http; /// true if we detect connection that does not comply with HTTP
+	/** a trust rule matched, the rest of the connection needs no filtering.
+	The caller of HttpConn_processsPkt() may stop tracking it, when it
+	can keep its later packets out of the queue */
+	bool trusted;
 	uint32_t packet_count;
 	uint32_t request_count;  /// how many requests have been sent
 	time_t last_pkt; ///time last packet received, used to remove stale connections
+	/** expiry timer in the queue's wheel. Not moved on every packet,
+	when it fires last_pkt decides if the connection really expired */
+	struct TimerWheel_timer timer;
 	unsigned cur_request;
 	unsigned cur_response;
 	enum tcp_conntrack client_state;
@@ -59,23 +90,52 @@ struct HttpConn {
 	/// Contains pointer with reference to content filter and its rules
 	struct WfConfig *config;
 
-	struct PrivData *priv_data;
+	/// where this connection and its requests were allocated, NULL for the heap
+	struct HttpConnCtx *ctx;
+
+	struct PrivData priv_data;
 
 	/** linked list of HttpReq.  HTTP 1.1 persistent connections have multiple reqs per con.
 	After request has been received by client we may remove from list.
 	*/
-	HttpReq_list_t *request_list;
-
-	/** Linked list of packets from server, only used with out of order packets */
-	ipv4_tcp_pkt_list_t *server_buffer;
-	ipv4_tcp_pkt_list_t *client_buffer;
-
+	HttpReq_list_t request_list;
+
+	/** Out of order packets from server and client, by sequence number */
+	struct SegStore server_buffer;
+	struct SegStore client_buffer;
+	/** memory held by packets in server_buffer and client_buffer,
+	without the receive buffers of held packets */
+	unsigned int buffered_bytes;
+	bool draining; /**< buffered packets are being replayed */
+
+	/** Keep the original out of order packets, with their verdict deferred,
+	instead of copies. See reorder_mode in WfConfig */
+	bool hold;
+	unsigned int held_pkts; /**< packets in server_buffer and client_buffer with held set */
+	time_t held_since; /**< when held_pkts last went from 0 to 1 */
+	/** a held buffer was full, the caller of HttpConn_processsPkt()
+	must stop tracking the connection and give the held packets a verdict */
+	bool hold_full;
+	/** held packets done with, the caller of HttpConn_processsPkt()
+	must send their verdicts and free them */
+	ipv4_tcp_pkt_list_t released;
+
+	/** strings and header fragments of the connection and its requests.
+	Requests stay on request_list until the connection is freed, so
+	nothing here is freed before that, then all of it at once. */
+	struct Arena arena;
+	unsigned char arena_buf[HTTP_CONN_ARENA_SIZE];
 };
 
 
-struct HttpConn* HttpConn_new(struct WfConfig *config);
+int HttpConnCtx_init(struct HttpConnCtx *ctx);
+void HttpConnCtx_destroy(struct HttpConnCtx *ctx);
+void HttpConnCtx_printStats(struct HttpConnCtx *ctx, FILE *stream);
+
+struct HttpConn* HttpConn_new(struct WfConfig *config, struct HttpConnCtx *ctx);
 void HttpConn_del(struct HttpConn **con);
 int HttpConn_processsPkt(struct HttpConn* con, struct Ipv4TcpPkt *pkt);
+void HttpConn_releaseHeld(struct HttpConn* con);
 
 
 typedef ubi_dlList HttpConn_list_t;
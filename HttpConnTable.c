@@ -0,0 +1,456 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+
+#include "HttpConn.h"
+#include "HttpConnTable.h"
+#include "nfq_wf_private.h"
+
+/**
+* @ingroup HttpConnTable
+* @{
+*/
+
+/** smallest table, in slots */
+#define CONN_TABLE_MIN_SIZE 64
+
+/**
+* 4-tuple with the lower endpoint first, the same for both directions
+*/
+struct ConnKey {
+	in_addr_t ip_lo;
+	in_addr_t ip_hi;
+	in_port_t port_lo;
+	in_port_t port_hi;
+};
+
+struct ConnSlot {
+	struct ConnKey key;
+	uint32_t hash;
+	struct HttpConn *con; /**< NULL if slot empty */
+};
+
+/**
+* Memo entry, direct mapped by hash
+*/
+struct MemoSlot {
+	struct ConnKey key;
+	uint32_t value;
+	uint32_t ttl; /**< seconds a hit extends expires by */
+	time_t expires; /**< 0 if slot empty */
+};
+
+struct HttpConnMemo {
+	struct MemoSlot *slots;
+	uint32_t mask;
+	uint32_t seed;
+	uint64_t inserts;
+	uint64_t hits;
+	uint64_t replaced; /**< live entries overwritten by a colliding flow */
+};
+
+struct HttpConnTable {
+	struct ConnSlot *slots;
+	uint32_t size; /**< power of 2 */
+	uint32_t mask;
+	uint32_t count;
+	uint32_t min_size;
+	uint32_t seed; /**< so flows can not be crafted to collide */
+	uint64_t lookups;
+	uint64_t probes; /**< slots visited by lookups */
+	uint64_t resizes;
+};
+
+static inline void __make_key(const struct Ipv4TcpTuple *t, struct ConnKey *key)
+{
+	if (t->src_ip < t->dst_ip
+		|| (t->src_ip == t->dst_ip && t->src_port <= t->dst_port)) {
+		key->ip_lo = t->src_ip;
+		key->ip_hi = t->dst_ip;
+		key->port_lo = t->src_port;
+		key->port_hi = t->dst_port;
+	} else {
+		key->ip_lo = t->dst_ip;
+		key->ip_hi = t->src_ip;
+		key->port_lo = t->dst_port;
+		key->port_hi = t->src_port;
+	}
+}
+
+static inline bool __key_eq(const struct ConnKey *a, const struct ConnKey *b)
+{
+	return a->ip_lo == b->ip_lo && a->ip_hi == b->ip_hi
+		&& a->port_lo == b->port_lo && a->port_hi == b->port_hi;
+}
+
+static inline uint32_t __hash_key(uint32_t seed, const struct ConnKey *key)
+{
+	uint64_t h;
+
+	h = ((uint64_t) key->ip_lo << 32 | key->ip_hi) ^ seed;
+	h ^= ((uint64_t) key->port_lo << 16 | key->port_hi) * 0x9E3779B97F4A7C15ULL;
+
+	/* 64 bit finalizer from MurmurHash3 */
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+	return (uint32_t) h;
+}
+
+static int __alloc_slots(struct HttpConnTable *tbl, uint32_t size)
+{
+	tbl->slots = calloc(size, sizeof(struct ConnSlot));
+	if (!tbl->slots)
+		return -ENOMEM;
+
+	tbl->size = size;
+	tbl->mask = size - 1;
+	return 0;
+}
+
+/** place an entry known not to be in the table */
+static void __place(struct HttpConnTable *tbl, const struct ConnSlot *entry)
+{
+	uint32_t i = entry->hash & tbl->mask;
+
+	while (tbl->slots[i].con)
+		i = (i + 1) & tbl->mask;
+
+	tbl->slots[i] = *entry;
+	entry->con->hash_slot = i;
+}
+
+static int __resize(struct HttpConnTable *tbl, uint32_t new_size)
+{
+	struct ConnSlot *old_slots = tbl->slots;
+	uint32_t old_size = tbl->size;
+	uint32_t i;
+
+	if (__alloc_slots(tbl, new_size)) {
+		tbl->slots = old_slots;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < old_size; i++) {
+		if (old_slots[i].con)
+			__place(tbl, &old_slots[i]);
+	}
+
+	DBG(2, "connection table %p resized %u -> %u count=%u\n",
+		tbl, old_size, new_size, tbl->count);
+
+	tbl->resizes++;
+	free(old_slots);
+	return 0;
+}
+
+/**
+* Create a connection table
+* @arg size_hint  expected number of connections, may be 0
+*/
+struct HttpConnTable *HttpConnTable_new(unsigned int size_hint)
+{
+	struct HttpConnTable *tbl;
+	uint32_t size = CONN_TABLE_MIN_SIZE;
+
+	tbl = calloc(1, sizeof(struct HttpConnTable));
+	if (!tbl)
+		return NULL;
+
+	// keep load under 3/4
+	while (size < 0x80000000U && size * 3 / 4 < size_hint)
+		size <<= 1;
+
+	if (__alloc_slots(tbl, size)) {
+		free(tbl);
+		return NULL;
+	}
+
+	tbl->min_size = size;
+	tbl->seed = (uint32_t) time(NULL) ^ (uint32_t) (uintptr_t) tbl;
+	return tbl;
+}
+
+/**
+* Free the table, not the connections in it
+*/
+void HttpConnTable_del(struct HttpConnTable **tbl)
+{
+	if (!*tbl)
+		return;
+
+	free((*tbl)->slots);
+	free(*tbl);
+	*tbl = NULL;
+}
+
+/**
+* Find the connection of a packet, in either direction
+* @return connection or NULL
+*/
+struct HttpConn *HttpConnTable_find(struct HttpConnTable *tbl, const struct Ipv4TcpTuple *tuple)
+{
+	struct ConnKey key;
+	struct ConnSlot *slot;
+	uint32_t hash, i;
+
+	__make_key(tuple, &key);
+	hash = __hash_key(tbl->seed, &key);
+	tbl->lookups++;
+
+	for (i = hash & tbl->mask; ; i = (i + 1) & tbl->mask) {
+		slot = &tbl->slots[i];
+		tbl->probes++;
+
+		if (!slot->con)
+			return NULL;
+
+		if (slot->hash == hash && __key_eq(&slot->key, &key))
+			return slot->con;
+	}
+}
+
+/**
+* Index a connection.
+* The tuple may be in either direction.
+* @return 0, -EEXIST if the tuple is already indexed or -ENOMEM
+*/
+int HttpConnTable_insert(struct HttpConnTable *tbl, const struct Ipv4TcpTuple *tuple,
+	struct HttpConn *con)
+{
+	struct ConnSlot entry;
+
+	if (HttpConnTable_find(tbl, tuple))
+		return -EEXIST;
+
+	if ((tbl->count + 1) > tbl->size / 4 * 3) {
+		if (__resize(tbl, tbl->size << 1))
+			return -ENOMEM;
+	}
+
+	__make_key(tuple, &entry.key);
+	entry.hash = __hash_key(tbl->seed, &entry.key);
+	entry.con = con;
+	__place(tbl, &entry);
+	tbl->count++;
+	return 0;
+}
+
+/**
+* Remove a connection using its hash_slot.
+* Later entries of the probe run are shifted back, so no tombstones are left.
+*/
+void HttpConnTable_remove(struct HttpConnTable *tbl, struct HttpConn *con)
+{
+	uint32_t i = con->hash_slot;
+	uint32_t j, home;
+
+	if (i == HTTP_CONN_NO_SLOT)
+		return;
+
+	if (i >= tbl->size || tbl->slots[i].con != con) {
+		ERROR("connection %u has bad hash_slot %u\n", con->id, i);
+		return;
+	}
+
+	for (j = (i + 1) & tbl->mask; tbl->slots[j].con; j = (j + 1) & tbl->mask) {
+		home = tbl->slots[j].hash & tbl->mask;
+
+		// move j to i only if i lies on the probe path from home to j
+		if (((j - home) & tbl->mask) >= ((j - i) & tbl->mask)) {
+			tbl->slots[i] = tbl->slots[j];
+			tbl->slots[i].con->hash_slot = i;
+			i = j;
+		}
+	}
+
+	tbl->slots[i].con = NULL;
+	con->hash_slot = HTTP_CONN_NO_SLOT;
+	tbl->count--;
+
+	// give back memory after a burst of connections
+	if (tbl->size > tbl->min_size && tbl->count < tbl->size / 8)
+		__resize(tbl, tbl->size >> 1);
+}
+
+unsigned int HttpConnTable_count(struct HttpConnTable *tbl)
+{
+	return tbl->count;
+}
+
+void HttpConnTable_printStats(struct HttpConnTable *tbl, FILE *stream)
+{
+	fprintf(stream, "conn_table size=%u count=%u lookups=%llu avg_probes=%.2f resizes=%llu\n",
+		tbl->size, tbl->count,
+		(unsigned long long) tbl->lookups,
+		tbl->lookups ? (double) tbl->probes / tbl->lookups : 0.0,
+		(unsigned long long) tbl->resizes);
+}
+
+/**
+* Create a flow memo
+* @arg size  number of entries, rounded up to a power of 2
+*/
+struct HttpConnMemo *HttpConnMemo_new(unsigned int size)
+{
+	struct HttpConnMemo *memo;
+	uint32_t n = CONN_TABLE_MIN_SIZE;
+
+	memo = calloc(1, sizeof(struct HttpConnMemo));
+	if (!memo)
+		return NULL;
+
+	while (n < 0x80000000U && n < size)
+		n <<= 1;
+
+	memo->slots = calloc(n, sizeof(struct MemoSlot));
+	if (!memo->slots) {
+		free(memo);
+		return NULL;
+	}
+
+	memo->mask = n - 1;
+	memo->seed = (uint32_t) time(NULL) ^ (uint32_t) (uintptr_t) memo;
+	return memo;
+}
+
+/**
+* Grow a flow memo, keeping its entries
+* @arg size  number of entries, rounded up to a power of 2.
+* A memo already that large is left as it is.
+* @return 0 or -ENOMEM, the memo is unchanged on error
+*/
+int HttpConnMemo_grow(struct HttpConnMemo *memo, unsigned int size)
+{
+	struct MemoSlot *old_slots = memo->slots;
+	uint32_t old_size = memo->mask + 1;
+	uint32_t n = old_size;
+	uint32_t i;
+
+	while (n < 0x80000000U && n < size)
+		n <<= 1;
+
+	if (n == old_size)
+		return 0;
+
+	memo->slots = calloc(n, sizeof(struct MemoSlot));
+	if (!memo->slots) {
+		memo->slots = old_slots;
+		return -ENOMEM;
+	}
+	memo->mask = n - 1;
+
+	for (i = 0; i < old_size; i++) {
+		if (old_slots[i].expires)
+			memo->slots[__hash_key(memo->seed, &old_slots[i].key) & memo->mask] = old_slots[i];
+	}
+
+	DBG(2, "flow memo %p resized %u -> %u\n", memo, old_size, n);
+	free(old_slots);
+	return 0;
+}
+
+void HttpConnMemo_del(struct HttpConnMemo **memo)
+{
+	if (!*memo)
+		return;
+
+	free((*memo)->slots);
+	free(*memo);
+	*memo = NULL;
+}
+
+static inline struct MemoSlot *__memo_slot(struct HttpConnMemo *memo,
+	const struct Ipv4TcpTuple *tuple, struct ConnKey *key)
+{
+	__make_key(tuple, key);
+	return &memo->slots[__hash_key(memo->seed, key) & memo->mask];
+}
+
+/**
+* Remember a value for a flow, in either direction.
+* A colliding flow already in the slot is forgotten.
+* @arg ttl  seconds the entry lives after now, or after its last hit
+*/
+void HttpConnMemo_insert(struct HttpConnMemo *memo, const struct Ipv4TcpTuple *tuple,
+	uint32_t value, unsigned int ttl, time_t now)
+{
+	struct ConnKey key;
+	struct MemoSlot *slot = __memo_slot(memo, tuple, &key);
+
+	if (slot->expires > now && !__key_eq(&slot->key, &key))
+		memo->replaced++;
+
+	slot->key = key;
+	slot->value = value;
+	slot->ttl = ttl;
+	slot->expires = now + ttl;
+	memo->inserts++;
+}
+
+/**
+* Find the value of a flow and extend its life by its ttl
+* @return true if found, with the value in *value
+*/
+bool HttpConnMemo_lookup(struct HttpConnMemo *memo, const struct Ipv4TcpTuple *tuple,
+	time_t now, uint32_t *value)
+{
+	struct ConnKey key;
+	struct MemoSlot *slot = __memo_slot(memo, tuple, &key);
+
+	if (slot->expires <= now || !__key_eq(&slot->key, &key))
+		return false;
+
+	slot->expires = now + slot->ttl;
+	*value = slot->value;
+	memo->hits++;
+	return true;
+}
+
+/** Forget a flow, if present */
+void HttpConnMemo_remove(struct HttpConnMemo *memo, const struct Ipv4TcpTuple *tuple)
+{
+	struct ConnKey key;
+	struct MemoSlot *slot = __memo_slot(memo, tuple, &key);
+
+	if (__key_eq(&slot->key, &key))
+		slot->expires = 0;
+}
+
+void HttpConnMemo_printStats(struct HttpConnMemo *memo, const char *name, FILE *stream)
+{
+	fprintf(stream, "%s memo size=%u inserts=%llu hits=%llu replaced=%llu\n",
+		name, memo->mask + 1,
+		(unsigned long long) memo->inserts,
+		(unsigned long long) memo->hits,
+		(unsigned long long) memo->replaced);
+}
+
+/** @}  */
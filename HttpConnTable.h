@@ -0,0 +1,80 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef HTTP_CONN_TABLE_H
+#define HTTP_CONN_TABLE_H 1
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "Ipv4Tcp.h"
+
+/**
+* @defgroup HttpConnTable  HTTP connection index
+* @brief Hash table from TCP 4-tuple to HttpConn.
+*
+* Keys are direction normalised, so packets from client and server find
+* the same connection with one lookup.
+* Open addressing with linear probing and backward shift deletion,
+* grows and shrinks by powers of two.
+* Each indexed HttpConn stores its slot in hash_slot, so removal
+* does not need a lookup.
+* @{
+*/
+
+struct HttpConn;
+struct HttpConnTable;
+
+struct HttpConnTable *HttpConnTable_new(unsigned int size_hint);
+void HttpConnTable_del(struct HttpConnTable **tbl);
+
+struct HttpConn *HttpConnTable_find(struct HttpConnTable *tbl, const struct Ipv4TcpTuple *tuple);
+int HttpConnTable_insert(struct HttpConnTable *tbl, const struct Ipv4TcpTuple *tuple,
+	struct HttpConn *con);
+void HttpConnTable_remove(struct HttpConnTable *tbl, struct HttpConn *con);
+
+unsigned int HttpConnTable_count(struct HttpConnTable *tbl);
+void HttpConnTable_printStats(struct HttpConnTable *tbl, FILE *stream);
+
+/**
+* Flow memo.
+* Cache from 4-tuple to a 32 bit value, for flows that
+* are no longer tracked by a HttpConn but still need a known verdict.
+* Direct mapped, a colliding flow replaces the older entry, so callers
+* must treat a miss as "unknown" not as "never seen".
+*/
+struct HttpConnMemo;
+
+struct HttpConnMemo *HttpConnMemo_new(unsigned int size);
+int HttpConnMemo_grow(struct HttpConnMemo *memo, unsigned int size);
+void HttpConnMemo_del(struct HttpConnMemo **memo);
+void HttpConnMemo_insert(struct HttpConnMemo *memo, const struct Ipv4TcpTuple *tuple,
+	uint32_t value, unsigned int ttl, time_t now);
+bool HttpConnMemo_lookup(struct HttpConnMemo *memo, const struct Ipv4TcpTuple *tuple,
+	time_t now, uint32_t *value);
+void HttpConnMemo_remove(struct HttpConnMemo *memo, const struct Ipv4TcpTuple *tuple);
+void HttpConnMemo_printStats(struct HttpConnMemo *memo, const char *name, FILE *stream);
+
+/** @}  */
+
+#endif
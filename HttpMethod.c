@@ -0,0 +1,164 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+#include <pthread.h>
+
+#ifdef HAVE_CONFIG_H
+#include "nfq-web-filter-config.h"
+#endif
+
+#include "HttpMethod.h"
+#include "nfq_wf_private.h"
+
+/**
+* @ingroup HttpMethod
+* @{
+*/
+
+/** multiplier that hashes the key of every method to its own slot */
+#define HTTP_METHOD_HASH_MUL 0x23d71e535e86d1ddULL
+#define HTTP_METHOD_HASH_BITS 5
+
+#define HTTP_METHOD_HASH(key) \
+	((unsigned int) (((key) * HTTP_METHOD_HASH_MUL) >> (64 - HTTP_METHOD_HASH_BITS)))
+
+static const struct {
+	const char *token;
+	unsigned int len;
+} __methods[http_method_max] = {
+	[http_method_options] = { "OPTIONS", 7 },
+	[http_method_get] = { "GET", 3 },
+	[http_method_head] = { "HEAD", 4 },
+	[http_method_post] = { "POST", 4 },
+	[http_method_put] = { "PUT", 3 },
+	[http_method_delete] = { "DELETE", 6 },
+	[http_method_trace] = { "TRACE", 5 },
+	[http_method_connect] = { "CONNECT", 7 },
+	[http_method_propfind] = { "PROPFIND", 8 },
+	[http_method_proppatch] = { "PROPPATCH", 9 },
+	[http_method_mkcol] = { "MKCOL", 5 },
+	[http_method_copy] = { "COPY", 4 },
+	[http_method_move] = { "MOVE", 4 },
+	[http_method_lock] = { "LOCK", 4 },
+	[http_method_unlock] = { "UNLOCK", 6 },
+	[http_method_report] = { "REPORT", 6 },
+	[http_method_version_control] = { "VERSION-CONTROL", 15 },
+	[http_method_checkout] = { "CHECKOUT", 8 },
+	[http_method_checkin] = { "CHECKIN", 7 },
+	[http_method_uncheckout] = { "UNCHECKOUT", 10 },
+	[http_method_mkworkspace] = { "MKWORKSPACE", 11 },
+};
+
+/** hash slot, key is the first 8 bytes of the token */
+static struct {
+	uint64_t key;
+	int method; /* -1 if empty */
+} __slots[1 << HTTP_METHOD_HASH_BITS];
+
+static pthread_once_t __slots_once = PTHREAD_ONCE_INIT;
+
+/** first 8 bytes of a token as a little endian word, 0 padded */
+static inline uint64_t __load_word(const unsigned char *data, unsigned int len)
+{
+	uint64_t w = 0;
+
+	memcpy(&w, data, len < 8 ? len : 8);
+	return le64toh(w);
+}
+
+static void __build_slots(void)
+{
+	unsigned int i, slot;
+	uint64_t key;
+
+	for (i = 0; i < sizeof(__slots) / sizeof(__slots[0]); i++)
+		__slots[i].method = -1;
+
+	for (i = 0; i < http_method_max; i++) {
+		key = __load_word((const unsigned char *) __methods[i].token, __methods[i].len);
+		slot = HTTP_METHOD_HASH(key);
+		if (__slots[slot].method != -1) {
+			ERROR_FATAL("HTTP method hash collision %s %s\n",
+				__methods[i].token, __methods[__slots[slot].method].token);
+		}
+		__slots[slot].key = key;
+		__slots[slot].method = i;
+	}
+}
+
+/**
+* Find the method of a request line
+* @arg data  start of the request, empty lines before it are skipped (RFC 7230 3.5)
+* @arg len   bytes of data
+* @arg method  set to the method found
+* @return offset of the request target after the method and its space,
+*     0 if there is no known method token
+*/
+unsigned int HttpMethod_parse(const unsigned char *data, unsigned int len,
+		enum http_method *method)
+{
+	const unsigned char *start = data;
+	uint64_t w, x, spaces, key;
+	unsigned int slot, tok_len;
+	int m;
+
+	pthread_once(&__slots_once, __build_slots);
+
+	while (len && (*data == '\r' || *data == '\n')) {
+		data++;
+		len--;
+	}
+
+	w = __load_word(data, len);
+
+	// cut the word at its first space, bytes past it are the path
+	x = w ^ 0x2020202020202020ULL;
+	spaces = (x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL;
+	key = spaces ? w & ((1ULL << (__builtin_ctzll(spaces) & ~7)) - 1) : w;
+
+	slot = HTTP_METHOD_HASH(key);
+	m = __slots[slot].method;
+	if (m < 0 || __slots[slot].key != key)
+		return 0;
+
+	tok_len = __methods[m].len;
+	if (len <= tok_len || data[tok_len] != ' ')
+		return 0;
+	if (tok_len > 8 && memcmp(data + 8, __methods[m].token + 8, tok_len - 8))
+		return 0;
+
+	*method = m;
+	return data - start + tok_len + 1;
+}
+
+/** method token, for messages */
+const char *HttpMethod_name(enum http_method method)
+{
+	if ((unsigned int) method >= http_method_max)
+		return "unknown";
+	return __methods[method].token;
+}
+
+/** @}  */
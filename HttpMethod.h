@@ -0,0 +1,68 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef HTTP_METHOD_H
+#define HTTP_METHOD_H 1
+
+/**
+* @ingroup HttpReq
+* @defgroup HttpMethod  HTTP request method
+* @brief Classify the method token at the start of a request.
+*
+* The first 8 bytes are loaded once, cut at the first space and hashed
+* with one multiply into a table of 32 slots with no collisions.  The
+* token of the slot is then compared in full.
+* @{
+*/
+
+enum http_method { http_method_options, /* RFC 2616   sect 9.2 */
+		http_method_get,         /* RFC 2616   sect 9.3 */
+		http_method_head,
+		http_method_post,
+		http_method_put,
+		http_method_delete,
+		http_method_trace,
+		http_method_connect,
+		http_method_propfind,   /* RFC 4918 WebDav */
+		http_method_proppatch,
+		http_method_mkcol,
+		http_method_copy,
+		http_method_move,
+		http_method_lock,
+		http_method_unlock,
+		http_method_report,   /* RFC 3253 version control. SVN over http uses this */
+		http_method_version_control,
+		http_method_checkout,
+		http_method_checkin,
+		http_method_uncheckout,
+		http_method_mkworkspace,
+		http_method_max, /* number of methods, not a method */
+};
+
+unsigned int HttpMethod_parse(const unsigned char *data, unsigned int len,
+		enum http_method *method);
+
+const char *HttpMethod_name(enum http_method method);
+
+/** @}  */
+
+#endif
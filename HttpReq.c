@@ -47,6 +47,7 @@ THE SOFTWARE.
 #include "HttpConn.h"
 #include "Rules.h"
 #include "PrivData.h"
+#include "Slab.h"
 #include "nfq_wf_private.h"
 
 #define MAX(a, b) (a > b ? a : b)
@@ -61,7 +62,6 @@ static void __cleanup_tmpfile(struct HttpReq *req)
 
 	if (req->file_scan_tmpfile) {
 		unlink(req->file_scan_tmpfile);
-		free(req->file_scan_tmpfile);
 		req->file_scan_tmpfile = NULL;
 	}
 }
@@ -69,10 +69,16 @@ struct HttpReq * HttpReq_new(struct HttpConn *con)
 {
 	struct HttpReq *req;
 
-	req = calloc(1, sizeof(struct HttpReq));
+	if (con->ctx)
+		req = Slab_zalloc(con->ctx->req_slab);
+	else
+		req = calloc(1, sizeof(struct HttpReq));
+	if (!req)
+		return NULL;
+
 	req->con = con;
 	req->cf = WfConfig_getContentFilter(con->config);
-	req->priv_data = PrivData_new();
+	PrivData_init(&req->priv_data);
 	gettimeofday(&req->start_time, NULL);
 	return req;
 }
@@ -82,7 +88,7 @@ void HttpReq_del(struct HttpReq **req_in)
 {
 	struct HttpReq *req = *req_in;
 
-	DBG(5, "Free req %p url='%s'\n", req, req->url);
+	DBG(5, "Free req %p url='%s'\n", req, req->url.str);
 	if (req->rule_matched) {
 		ContentFilter_logReq(req->cf, req);
 		Rule_put(&req->rule_matched);
@@ -90,38 +96,72 @@ void HttpReq_del(struct HttpReq **req_in)
 		DBG(1, "Free request that did not match any rule \n");
 	}
 
-	if (req->host)
-		free(req->host);
+	PrivData_destroy(&req->priv_data);
 
-	if (req->path)
-		free(req->path);
+	__cleanup_tmpfile(req);
 
-	if (req->url)
-		free(req->url);
+	if (req->con->ctx)
+		Slab_free(req->con->ctx->req_slab, req);
+	else
+		free(req);
+	*req_in = NULL;
+}
 
-	if (req->client_req_msg.buf_line)
-		free(req->client_req_msg.buf_line);
+/**
+* Copy a field of the request into the connection's arena
+* @arg field  &req->host, &req->path or &req->url
+* @return 0 or -ENOMEM
+*/
+int HttpReq_setStr(struct HttpReq *req, struct http_str *field,
+	const unsigned char *data, unsigned int len)
+{
+	char *s = Arena_strndup(&req->con->arena, data, len);
 
-	if (req->server_resp_msg.buf_line)
-		free(req->server_resp_msg.buf_line);
+	if (!s)
+		return -ENOMEM;
 
-	PrivData_del(&req->priv_data);
+	field->str = s;
+	field->len = len;
+	return 0;
+}
 
-	if (req->reject_reason) {
-		free(req->reject_reason);
+/**
+* Set req->url from the path and host, once the request header is complete.
+* An absolute path is the url already and is not copied.
+*/
+void HttpReq_buildUrl(struct HttpReq *req)
+{
+	unsigned int len;
+	char *s;
+
+	if (req->path.len >= 7 && !strncmp(req->path.str, "http://", 7)) {
+		req->url = req->path;
+		return;
 	}
 
-	if (req->category_name) {
-		free(req->category_name);
+	// "http://" host ["/"] path
+	len = 7 + req->host.len + (req->path.str[0] != '/') + req->path.len;
+	s = Arena_alloc(&req->con->arena, len + 1);
+	if (!s) {
+		ERROR_FATAL("Out of memory\n");
 	}
 
-	__cleanup_tmpfile(req);
+	req->url.str = s;
+	req->url.len = len;
 
-	free(req);
-	*req_in = NULL;
+	memcpy(s, "http://", 7);
+	s += 7;
+	if (req->host.str) {
+		memcpy(s, req->host.str, req->host.len);
+		s += req->host.len;
+	}
+	if (req->path.str[0] != '/')
+		*s++ = '/';
+	memcpy(s, req->path.str, req->path.len);
+	s[req->path.len] = 0;
 }
 
-static void save_msg_line(struct http_msg *msg, unsigned char *start, unsigned int len)
+static void save_msg_line(struct HttpReq *req, struct http_msg *msg, unsigned char *start, unsigned int len)
 {
 	if (!len) {
 		/* malloc(0) makes no sense */
@@ -132,152 +172,179 @@ static void save_msg_line(struct http_msg *msg, unsigned char *start, unsigned i
 		BUG();
 	}
 	msg->state = msg_state_partial;
-	msg->buf_line = malloc(len);
+	msg->buf_line = Arena_alloc(&req->con->arena, len);
+	if (!msg->buf_line) {
+		ERROR_FATAL("Out of memory\n");
+	}
 	msg->buf_line_len= len;
 	memcpy(msg->buf_line, start, len);
 	DBG(7,"Save partial header line for processing later len=%d\n", len);
 }
 
 
+/** header lines HttpReq_processHeaderLine() looks at */
+enum http_hdr {
+	http_hdr_other = 0,
+	http_hdr_host,
+	http_hdr_content_length,
+	http_hdr_transfer_encoding,
+};
+
+/** longest name of enum http_hdr, "Transfer-Encoding" */
+#define HTTP_HDR_MAX_NAME 17
+
+/**
+* Classify a header line by its name, any case.
+* @arg value  set to the first byte after the ':'
+*/
+static enum http_hdr __header_name(const unsigned char *line, unsigned int line_len,
+		const unsigned char **value)
+{
+	const unsigned char *colon;
+
+	colon = memchr(line, ':', MIN(line_len, HTTP_HDR_MAX_NAME + 1));
+	if (!colon)
+		return http_hdr_other;
+
+	*value = colon + 1;
+
+	switch (colon - line) {
+		case 4:
+			if (HttpScan_nameEq(line, "host", 4))
+				return http_hdr_host;
+			break;
+		case 14:
+			if (HttpScan_nameEq(line, "content-length", 14))
+				return http_hdr_content_length;
+			break;
+		case 17:
+			if (HttpScan_nameEq(line, "transfer-encoding", 17))
+				return http_hdr_transfer_encoding;
+			break;
+	}
+	return http_hdr_other;
+}
+
 /**
 * @brief process a line of the general header or request header,
+* @arg scan  scanner over the buffer start_line points into
 * @arg start_line  Pointer to start of line to process
 *      NOTE NOT null terminated, may contain multiple or partial lines.
 * @arg len   Length of buffer start_line
 */
-int HttpReq_processHeaderLine(struct HttpReq *req, bool client_req, unsigned char **start_line, unsigned int *buf_len)
+int HttpReq_processHeaderLine(struct HttpReq *req, bool client_req, struct HttpScan *scan,
+		unsigned char **start_line, unsigned int *buf_len)
 {
 	unsigned char *line = *start_line;
 	unsigned int len = *buf_len;
+	const unsigned char *value = NULL;
 	unsigned char *p;
-	unsigned char *end;
+	unsigned char *eol = NULL;
+	unsigned int line_len;
 	int str_len;
 	char value_str[16];  // for parsing numbers
 	int count;
 	struct http_msg *msg;
+	enum http_hdr hdr;
 
 	if (client_req)
 		msg = &req->client_req_msg;
 	else
 		msg = &req->server_resp_msg;
 
+	if (len)
+		eol = (unsigned char *) HttpScan_findEol(scan, line);
+	if (eol && eol >= line + len)
+		eol = NULL;
+
+	line_len = eol ? eol - line : len;
+	hdr = __header_name(line, line_len, &value);
 
-	if (!req->host && (p = memmem(line, MIN(len, 15), "Host: ", 6))) {
-		p = line+6; // skip past "Host: "
-		len -= 6;
+	if (hdr == http_hdr_host && !req->host.str) {
+		if (!eol) {
+			DBG(1, "Partial request. Possible Host\n");
+			goto save_partial;
+		}
 
 		// skip white space
-		while ((*p == ' ' || *p == '\t') && len > 0) {
+		p = (unsigned char *) value;
+		while (p < eol && (*p == ' ' || *p == '\t'))
 			p++;
-			len--;
-		}
 
-		end = p;
+		value = p;
 		// while over host name
-		while ((*end > ' ' && *end < 127) && len > 0) {
-			end++;
-			len--;
-		}
+		while (p < eol && *p > ' ' && *p < 127)
+			p++;
 
-		if (!len) {
-			DBG(1, "Partial request. Possible Host\n");
-			save_msg_line(msg, *start_line, *buf_len);
-			*start_line = p;
-			*buf_len = 0;
-			return -1;
+		if (HttpReq_setStr(req, &req->host, value, p - value)) {
+			ERROR_FATAL("Out of memory\n");
 		}
-
-		// now should be at the end of the Host:
-		str_len = end - p;
-		req->host = malloc(str_len+1);
-		memcpy(req->host, p, str_len);
-		req->host[str_len] = 0; /* NULL term */
-		DBG(3, "host = '%s' len=%d\n", req->host, len);
-		p = end;  // continue at end of Hostname,  len is already updated.
-	} else if (!msg->content_length  // check if not set yet
-			&& line && (p = memmem(line, MIN(len, 16), "Content-Length: ", 16))) {
-
-		str_len = len;  // save as max possible length.
+		DBG(3, "host = '%s' len=%d\n", req->host.str, len);
+	} else if (hdr == http_hdr_content_length && !msg->content_length && !msg->chunked) {
 		// with POST/PUT requests there will be content length data part of the POST/PUT
-		p += 16;
-		len -= 16;
-		while (!isdigit(*p) && len > 0) {
-			p++;
-			len--;
-		}
-		end = p;
-		// should now be positioned on 1st digit
-		while (isdigit(*end) && len > 0) {
-			end++;
-			len--;
-		}
-		if (!len) {
+		if (!eol) {
 			DBG(1, "Partial request. Possible Content-Length\n");
-			save_msg_line(msg, *start_line, *buf_len);
-			*start_line = p;
-			*buf_len = 0;
-			return -1;
+			goto save_partial;
 		}
 
+		p = (unsigned char *) value;
+		while (p < eol && !isdigit(*p))
+			p++;
+
+		value = p;
+		// should now be positioned on 1st digit
+		while (p < eol && isdigit(*p))
+			p++;
+
 		// set len to be string length of content-length number
-		str_len = end - p;
+		str_len = p - value;
 		if (str_len > 15) {
-			ERROR_FATAL("Bug parsing content-length\n");
+			WARN("Content-Length of %d digits ignored\n", str_len);
+		} else {
+			memcpy(value_str, value, str_len);
+			value_str[str_len] = 0; // NULL term
+			msg->content_length = strtoull(value_str, NULL, 10);
+			DBG(3, "Content-Length = %llu len=%d\n", (long long) msg->content_length, len);
 		}
-		memcpy(value_str, p, str_len);
-		value_str[str_len] = 0; // NULL term
-		msg->content_length = strtoull(value_str, NULL, 0);
-		DBG(3, "Content-Length = %llu len=%d\n", (long long) msg->content_length, len);
-		p = end;  // continue at end of number,  len is already updated.
-	} else if (!msg->content_length  // check if not set yet
-		&& (p = memmem(line, MIN(len, 19), "Transfer-Encoding: ", 19))) {
-
+	} else if (hdr == http_hdr_transfer_encoding && !msg->chunked) {
 		DBG(5, "found 'Transfer-Encoding:'\n");
-		str_len = len;  // save as max possible length.
-		// with POST/PUT requests there will be content length data part of the POST/PUT
-		p += 19;
-		len -= 19;
-	// FIXME
-
-
-		msg->chunked = true;
-
-	} else {
-		p = line;  // continue to next line
+		if (!eol) {
+			DBG(1, "Partial request. Possible Transfer-Encoding\n");
+			goto save_partial;
+		}
 
+		// chunked must be the last coding, RFC 7230 3.3.1
+		p = eol;
+		while (p > value && (p[-1] == ' ' || p[-1] == '\t'))
+			p--;
+
+		if (p - value >= 7 && HttpScan_nameEq(p - 7, "chunked", 7)) {
+			// and overrides any Content-Length, RFC 7230 3.3.3
+			msg->chunked = true;
+			msg->content_length = 0;
+			HttpChunk_init(&msg->chunk);
+			DBG(3, "chunked len=%d\n", len);
+		}
+	} else if (!eol && len < 19 && len) {
 		/* if this might be worth saving
 		 len < 19 because it's the only way it has a partial
 		 "Content-Length:", "Host:", "Transfer-Encoding:" that interest us
 		 This way we avoid saving large junk, like cookies and Refer tags.
 		*/
-		if (len < 19 && len)  {
-
-			// check if line contains a EOL
-			while (len && *p != '\n' && *p != '\r') {
-				p++;
-				len--;
-			}
-
-			// if len remaining and not at end of line
-			if (!len && *p != '\n' && *p != '\r') {
-				// No end of line  save
-				DBG(1, "Partial request. save data\n");
-				save_msg_line(msg, *start_line, *buf_len);
-				*start_line = p;
-				*buf_len = 0;
-				return -1;
-			}
-			/* p should now be at correct stop to count data */
-		}
-
+		DBG(1, "Partial request. save data\n");
+		goto save_partial;
 	}
 
-	/* advance to first EOL char */
-	while(len && *p != '\n' && *p != '\r') {
-		len--;
-		p++;
+	if (!eol) {
+		*start_line = line + len;
+		*buf_len = 0;
+		DBG(6, "count=0 len=0\n");
+		return ZERO_EOL;
 	}
 
+	p = eol;
+	len -= eol - line;
+
 	count = 0;  // count number of \r and \n
 	while(len && (*p == '\n' || *p == '\r') && count < 4) {
 		len--;
@@ -301,6 +368,12 @@ int HttpReq_processHeaderLine(struct HttpReq *req, bool client_req, unsigned cha
 	}
 
 	return ZERO_EOL;
+
+save_partial:
+	save_msg_line(req, msg, *start_line, *buf_len);
+	*start_line = line + len;
+	*buf_len = 0;
+	return -1;
 }
 
 static void __check_recvd_content(struct HttpReq *req)
@@ -335,16 +408,21 @@ static inline int fallocate(int fd, int mode, off_t offset, off_t len)
 
 static int open_tmpfile(struct HttpReq *req)
 {
-	int ret;
+	const char *tmp_dir = WfConfig_getTmpDir(req->con->config);
+	int len;
 
 	/* Create temporal file name.. */
-	ret = asprintf(&req->file_scan_tmpfile, "%s/req_tmp_%p_%08X",
-		WfConfig_getTmpDir(req->con->config), req,
-		req->con->tuple.dst_ip);
+	len = snprintf(NULL, 0, "%s/req_tmp_%p_%08X", tmp_dir, req, req->con->tuple.dst_ip);
+	if (len < 0)
+		return -1;
 
-	if (ret == -1)
+	req->file_scan_tmpfile = Arena_alloc(&req->con->arena, len + 1);
+	if (!req->file_scan_tmpfile)
 		return -1;
 
+	snprintf(req->file_scan_tmpfile, len + 1, "%s/req_tmp_%p_%08X", tmp_dir, req,
+		req->con->tuple.dst_ip);
+
 	/* incase it already exists remove*/
 	unlink(req->file_scan_tmpfile);
 	req->file_scan_fd = open(req->file_scan_tmpfile, O_RDWR|O_CREAT|O_EXCL, S_IRUSR|S_IWUSR|S_IRGRP);
@@ -372,7 +450,7 @@ static int open_tmpfile(struct HttpReq *req)
 	return 0;
 }
 
-int HttpReq_consumeResponseContent(struct HttpReq *req, const unsigned char *data,
+static int __consume_body(struct HttpReq *req, const unsigned char *data,
 	unsigned int len)
 {
 	bool first_packet =  req->server_resp_msg.content_received ? false : true;
@@ -430,6 +508,72 @@ int HttpReq_consumeResponseContent(struct HttpReq *req, const unsigned char *dat
 	return ContentFilter_filterStream(req->cf, req, data, len);
 }
 
+/** the last chunk of a chunked response went by */
+static int __chunked_body_done(struct HttpReq *req)
+{
+	int rc;
+
+	DBG(3, "chunked response complete body=%llu\n",
+		(long long) req->server_resp_msg.chunk.body_len);
+	req->con->cur_response++;
+	req->server_resp_msg.state = msg_state_complete;
+
+	if (req->file_scan_fd) {
+		DBG(1, "last chunk scanning file\n");
+		rc = ContentFilter_fileScan(req->cf, req);
+		if (rc) {
+			DBG(1, "file scan returned %d\n", rc);
+			return rc;
+		}
+	}
+	return 0;
+}
+
+/**
+* Response body bytes, as they come in a packet.
+* A chunked body is decoded in place, the filters only see the chunk data.
+* @param rest set to the number of bytes at the end of data after the last
+* chunk, they start the next response
+* @return verdict of the filters, or -1 on error
+*/
+int HttpReq_consumeResponseContent(struct HttpReq *req, const unsigned char *data,
+	unsigned int len, unsigned int *rest)
+{
+	struct http_msg *msg = &req->server_resp_msg;
+	const unsigned char *body;
+	unsigned int n;
+	int rc;
+
+	*rest = 0;
+	if (!msg->chunked)
+		return __consume_body(req, data, len);
+
+	if (msg->state == msg_state_complete)
+		return 0;
+
+	msg->state = msg_state_read_content;
+	while ((n = HttpChunk_parse(&msg->chunk, &data, &len, &body))) {
+		rc = __consume_body(req, body, n);
+		if (rc)
+			return rc;
+	}
+
+	if (HttpChunk_done(&msg->chunk)) {
+		DBG(3, "%u bytes after the chunked response\n", len);
+		*rest = len;
+		return __chunked_body_done(req);
+	}
+
+	if (HttpChunk_error(&msg->chunk)) {
+		// can not find the end anymore, filter the rest as it comes
+		WARN("bad chunked response, no longer decoding\n");
+		msg->chunked = false;
+		return __consume_body(req, data, len);
+	}
+
+	return 0;
+}
+
 void HttpReq_setRuleMatched(struct HttpReq *req, struct Rule *r)
 {
 	if (req->rule_matched) {
@@ -459,18 +603,11 @@ void HttpReq_setRuleMatched(struct HttpReq *req, struct Rule *r)
 
 void HttpReq_setRejectReason(struct HttpReq *req, const char *reason)
 {
-	if (req->reject_reason) {
-		/* someone is overwriting the reason, free the old*/
-		free(req->reject_reason);
-	}
-	req->reject_reason = strdup(reason);
+	/* someone may be overwriting the reason, the old stays in the arena */
+	req->reject_reason = Arena_strndup(&req->con->arena, reason, strlen(reason));
 }
 
 void HttpReq_setCatName(struct HttpReq *req, const char *name)
 {
-	if (req->category_name) {
-		/* someone is overwriting the reason, free the old*/
-		free(req->category_name);
-	}
-	req->category_name = strdup(name);
+	req->category_name = Arena_strndup(&req->con->arena, name, strlen(name));
 }
@@ -28,6 +28,10 @@ THE SOFTWARE.
 #include <ubiqx/ubi_dLinkList.h>
 #include "Ipv4Tcp.h"
 #include "Rules.h"
+#include "PrivData.h"
+#include "HttpScan.h"
+#include "HttpMethod.h"
+#include "HttpChunk.h"
 
 
 #define ZERO_EOL 0
@@ -40,29 +44,6 @@ THE SOFTWARE.
 * @{
 */
 
-enum http_method { http_method_options, /* RFC 2616   sect 9.2 */
-		http_method_get,         /* RFC 2616   sect 9.3 */
-		http_method_head,
-		http_method_post,
-		http_method_put,
-		http_method_delete,
-		http_method_trace,
-		http_method_connect,
-		http_method_propfind,   /* RFC 4918 WebDav */
-		http_method_proppatch,
-		http_method_mkcol,
-		http_method_copy,
-		http_method_move,
-		http_method_lock,
-		http_method_unlock,
-		http_method_report,   /* RFC 3253 version control. SVN over http uses this */
-		http_method_version_control,
-		http_method_checkout,
-		http_method_checkin,
-		http_method_uncheckout,
-		http_method_mkworkspace,
-};
-
 enum msg_state { msg_state_new, ///newly allocated
 		msg_state_partial,  /// more HTTP headers
 		msg_state_read_content, /// read POST/PUT data or response data
@@ -74,16 +55,25 @@ struct HttpConn;
 
 #define HTTP_REQ_MAX_CATEGORY_IDS 5
 
+/**
+* Length delimited string in the connection's arena.
+* str is NULL if the field was not seen,
+* otherwise also NULL terminated so it can go to fnmatch() and printf().
+*/
+struct http_str {
+	const char *str;
+	unsigned int len;
+};
+
 /* Struct to model rfc 2616 messages to/from server and client*/
 struct http_msg {
 	enum msg_state state;
 	uint64_t content_length;  /// from 'Content-Length:'
 	uint64_t content_received;  /// content data received of the content length.
-	char *buf_line; /// temporary buffer when one line of a header is in multiple packets
+	char *buf_line; /// temporary buffer when one line of a header is in multiple packets, in the connection's arena
 	unsigned int buf_line_len; /// length of buffer
 	bool chunked; ///   Transfer-Encoding: chunked
-	unsigned int chunk_len; /// length of current chunk
-	unsigned int chunk_recieved; /// length of current chunk received
+	struct HttpChunk chunk; /// decoder of a chunked response body
 };
 
 struct HttpReq {
@@ -92,9 +82,9 @@ struct HttpReq {
 	unsigned id;  // an auto increment ID for us to track.
 	int resp_status_code; /// 200, 304, 404  etc. RFC2616  Section 6.1.1
 	enum http_method method; /// GET, POST, etc
-	char *host;
-	char *path;
-	char *url; /** combine host and path, without http://  so will be host/path */
+	struct http_str host;
+	struct http_str path;
+	struct http_str url; /** http://host/path, or the path if it has the http:// */
 	struct timeval start_time; /** time the request started */
 	struct http_msg client_req_msg;  /// data coming from client HTTP Request
 	struct http_msg server_resp_msg;  /// data coming from server HTTP response
@@ -105,14 +95,14 @@ struct HttpReq {
 //	enum Action verdict; /// reject, virus, Phishing, malware, etc
 	struct Rule *rule_matched; /// rule that was matched
 	int category_id[HTTP_REQ_MAX_CATEGORY_IDS];
-	char *reject_reason; /* virus name, or other reason to reject */
-	char *category_name;
+	char *reject_reason; /* virus name, or other reason to reject. In the connection's arena */
+	char *category_name; /* in the connection's arena */
 	int file_scan_fd;
-	char *file_scan_tmpfile;
+	char *file_scan_tmpfile; /* in the connection's arena */
 	struct ContentFilter *cf; /* content filter object */
 	/// Private data that a filter object may request, will allow different filter objects to share data.
 	/// Or it allows a filter object to save its state between request states
-	struct PrivData *priv_data;
+	struct PrivData priv_data;
 };
 
 typedef ubi_dlList HttpReq_list_t;
@@ -125,11 +115,15 @@ void HttpReq_del(struct HttpReq **req);
 // void * HttpReq_getPrivateDataPtr(struct HttpReq *req, int key);
 // int HttpReq_freePrivateDataPtr(struct HttpReq *req, int key);
 
-int HttpReq_processHeaderLine(struct HttpReq *req, bool client_req,
+int HttpReq_processHeaderLine(struct HttpReq *req, bool client_req, struct HttpScan *scan,
 		unsigned char **start_line, unsigned int *buf_len);
 
 int HttpReq_consumeResponseContent(struct HttpReq *req, const unsigned char *data,
-	unsigned int len);
+	unsigned int len, unsigned int *rest);
+
+int HttpReq_setStr(struct HttpReq *req, struct http_str *field,
+	const unsigned char *data, unsigned int len);
+void HttpReq_buildUrl(struct HttpReq *req);
 
 void HttpReq_setRuleMatched(struct HttpReq *req, struct Rule *r);
 void HttpReq_setRejectReason(struct HttpReq *req, const char *reason);
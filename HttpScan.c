@@ -0,0 +1,226 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#ifdef HAVE_CONFIG_H
+#include "nfq-web-filter-config.h"
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCAN_X86 1
+#endif
+
+#include "HttpScan.h"
+#include "nfq_wf_private.h"
+
+/**
+* @ingroup HttpScan
+* @{
+*/
+
+/** line break mask of a full block */
+typedef uint64_t (*HttpScan_classify_fn)(const unsigned char *block);
+
+static uint64_t __classify_scalar(const unsigned char *block)
+{
+	uint64_t mask = 0;
+	unsigned int i;
+
+	for (i = 0; i < HTTP_SCAN_BLOCK; i++) {
+		if (block[i] == '\r' || block[i] == '\n')
+			mask |= 1ULL << i;
+	}
+	return mask;
+}
+
+#ifdef HTTP_SCAN_X86
+__attribute__((target("sse2")))
+static uint64_t __classify_sse2(const unsigned char *block)
+{
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	__m128i v, eq;
+	uint64_t mask = 0;
+	unsigned int i;
+
+	for (i = 0; i < HTTP_SCAN_BLOCK / 16; i++) {
+		v = _mm_loadu_si128((const __m128i *) (block + 16 * i));
+		eq = _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf));
+		mask |= (uint64_t) (uint16_t) _mm_movemask_epi8(eq) << (16 * i);
+	}
+	return mask;
+}
+
+__attribute__((target("avx2")))
+static uint64_t __classify_avx2(const unsigned char *block)
+{
+	const __m256i cr = _mm256_set1_epi8('\r');
+	const __m256i lf = _mm256_set1_epi8('\n');
+	__m256i lo, hi;
+
+	lo = _mm256_loadu_si256((const __m256i *) block);
+	hi = _mm256_loadu_si256((const __m256i *) (block + 32));
+	lo = _mm256_or_si256(_mm256_cmpeq_epi8(lo, cr), _mm256_cmpeq_epi8(lo, lf));
+	hi = _mm256_or_si256(_mm256_cmpeq_epi8(hi, cr), _mm256_cmpeq_epi8(hi, lf));
+
+	return (uint64_t) (uint32_t) _mm256_movemask_epi8(lo)
+		| (uint64_t) (uint32_t) _mm256_movemask_epi8(hi) << 32;
+}
+#endif
+
+static const struct {
+	const char *name;
+	HttpScan_classify_fn fn;
+} __impls[] = {
+#ifdef HTTP_SCAN_X86
+	{ "avx2", __classify_avx2 },
+	{ "sse2", __classify_sse2 },
+#endif
+	{ "scalar", __classify_scalar },
+};
+
+static HttpScan_classify_fn __classify = __classify_scalar;
+static const char *__impl_name = "scalar";
+static pthread_once_t __impl_once = PTHREAD_ONCE_INIT;
+
+static bool __impl_supported(const char *name)
+{
+#ifdef HTTP_SCAN_X86
+	__builtin_cpu_init();
+	if (!strcmp(name, "avx2"))
+		return __builtin_cpu_supports("avx2");
+	if (!strcmp(name, "sse2"))
+		return __builtin_cpu_supports("sse2");
+#endif
+	return !strcmp(name, "scalar");
+}
+
+/** the first of __impls the CPU has */
+static void __pick_impl(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(__impls) / sizeof(__impls[0]); i++) {
+		if (__impl_supported(__impls[i].name)) {
+			__classify = __impls[i].fn;
+			__impl_name = __impls[i].name;
+			break;
+		}
+	}
+	DBG(2, "HTTP line scanner using %s\n", __impl_name);
+}
+
+/** name of the classifier in use, "avx2", "sse2" or "scalar" */
+const char *HttpScan_impl(void)
+{
+	pthread_once(&__impl_once, __pick_impl);
+	return __impl_name;
+}
+
+/**
+* Use another classifier, for tests and benchmarks.
+* Not thread safe, call before any scanning.
+* @return 0, or -EINVAL if unknown or the CPU does not have it
+*/
+int HttpScan_setImpl(const char *name)
+{
+	unsigned int i;
+
+	pthread_once(&__impl_once, __pick_impl);
+
+	for (i = 0; i < sizeof(__impls) / sizeof(__impls[0]); i++) {
+		if (!strcmp(name, __impls[i].name) && __impl_supported(name)) {
+			__classify = __impls[i].fn;
+			__impl_name = __impls[i].name;
+			return 0;
+		}
+	}
+	return -EINVAL;
+}
+
+/**
+* Start scanning a buffer
+* @arg data  buffer, not copied
+* @arg len   bytes of data
+*/
+void HttpScan_init(struct HttpScan *scan, const unsigned char *data, unsigned int len)
+{
+	pthread_once(&__impl_once, __pick_impl);
+
+	scan->data = data;
+	scan->end = data + len;
+	scan->block = NULL;
+	scan->mask = 0;
+}
+
+static inline void __load_block(struct HttpScan *scan, const unsigned char *block)
+{
+	unsigned int n = scan->end - block;
+	unsigned int i;
+
+	scan->block = block;
+
+	if (n >= HTTP_SCAN_BLOCK) {
+		scan->mask = __classify(block);
+		return;
+	}
+
+	// last block, do not read past the end
+	scan->mask = 0;
+	for (i = 0; i < n; i++) {
+		if (block[i] == '\r' || block[i] == '\n')
+			scan->mask |= 1ULL << i;
+	}
+}
+
+/**
+* Find the end of a line
+* @arg from  where to start, between the start and the end of the buffer
+* @return first CR or LF at or after from, NULL if there is none before the end
+*/
+const unsigned char *HttpScan_findEol(struct HttpScan *scan, const unsigned char *from)
+{
+	const unsigned char *block;
+	uint64_t mask;
+
+	block = scan->data + ((from - scan->data) & ~(HTTP_SCAN_BLOCK - 1));
+	if (block != scan->block)
+		__load_block(scan, block);
+
+	mask = scan->mask & (~0ULL << (from - block));
+	while (!mask) {
+		block += HTTP_SCAN_BLOCK;
+		if (block >= scan->end)
+			return NULL;
+		__load_block(scan, block);
+		mask = scan->mask;
+	}
+
+	return block + __builtin_ctzll(mask);
+}
+
+/** @}  */
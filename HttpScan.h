@@ -0,0 +1,103 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H 1
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/**
+* @ingroup HttpReq
+* @defgroup HttpScan  HTTP line break scanner
+* @brief Find CR and LF in a payload, 64 bytes at a time.
+*
+* A block of 64 bytes is classified in one go into a bit mask of its line
+* breaks, with AVX2 or SSE2 when the CPU has it, chosen at run time, or
+* a scalar loop.  The mask of the current block is kept, so walking a
+* header line by line reads each byte once and finding the end of a line
+* is a bit scan.
+* @{
+*/
+
+#define HTTP_SCAN_BLOCK 64
+
+/**
+* Cursor over one buffer.  On the stack, nothing to free.
+*/
+struct HttpScan {
+	const unsigned char *data; /**< start of the buffer, blocks are counted from here */
+	const unsigned char *end;
+	const unsigned char *block; /**< block mask is for, NULL before the first lookup */
+	uint64_t mask; /**< bit i set if block[i] is CR or LF */
+};
+
+void HttpScan_init(struct HttpScan *scan, const unsigned char *data, unsigned int len);
+const unsigned char *HttpScan_findEol(struct HttpScan *scan, const unsigned char *from);
+
+const char *HttpScan_impl(void);
+int HttpScan_setImpl(const char *name);
+
+/**
+* Case insensitive compare of a header name with lname, for names of
+* letters and '-' only, given in lower case.
+* Setting bit 5 of every byte lower cases letters and leaves '-' alone,
+* so 8 bytes compare at once, the first 8 and the last 8 overlapping.
+* @arg len  length of both, the caller has compared the lengths
+*/
+static inline bool HttpScan_nameEq(const unsigned char *p, const char *lname, unsigned int len)
+{
+	uint64_t a, b;
+	uint32_t c, d;
+	unsigned int i;
+
+	if (len >= 8) {
+		memcpy(&a, p, 8);
+		memcpy(&b, lname, 8);
+		if ((a | 0x2020202020202020ULL) != b)
+			return false;
+		memcpy(&a, p + len - 8, 8);
+		memcpy(&b, lname + len - 8, 8);
+		return (a | 0x2020202020202020ULL) == b;
+	}
+
+	if (len >= 4) {
+		memcpy(&c, p, 4);
+		memcpy(&d, lname, 4);
+		if ((c | 0x20202020) != d)
+			return false;
+		memcpy(&c, p + len - 4, 4);
+		memcpy(&d, lname + len - 4, 4);
+		return (c | 0x20202020) == d;
+	}
+
+	for (i = 0; i < len; i++) {
+		if ((p[i] | 0x20) != (unsigned char) lname[i])
+			return false;
+	}
+	return true;
+}
+
+/** @}  */
+
+#endif
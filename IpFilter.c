@@ -120,24 +120,41 @@ static int IpFilter_load_from_xml(struct Filter *fobj, xmlNode *node)
 
 }
 
-static int IpFilter_matches_req(struct Filter *fobj, struct HttpReq *req)
+static int IpFilter_matches_tuple(struct Filter *fobj,
+	const struct Ipv4TcpTuple *tuple, time_t now)
 {
-	struct HttpConn *con = req->con;
 	struct IpFilter *ipfo = (struct IpFilter *) fobj; /* IP filter object */
 
 	if (ipfo->match_src) {
 		// match source IP address
-		if ( (con->tuple.src_ip & ipfo->mask) == ipfo->ip)
+		if ( (tuple->src_ip & ipfo->mask) == ipfo->ip)
 			return 1;
 	} else {
 		// match destination IP address
-		if ( (con->tuple.dst_ip & ipfo->mask) == ipfo->ip)
+		if ( (tuple->dst_ip & ipfo->mask) == ipfo->ip)
 			return 1;
 	}
 
 	return 0;
 }
 
+static int IpFilter_dst_net(struct Filter *fobj, struct Ipv4Net *net)
+{
+	struct IpFilter *ipfo = (struct IpFilter *) fobj; /* IP filter object */
+
+	if (ipfo->match_src)
+		return -1;
+
+	net->addr = ipfo->ip;
+	net->mask = ipfo->mask;
+	return 0;
+}
+
+static int IpFilter_matches_req(struct Filter *fobj, struct HttpReq *req)
+{
+	return IpFilter_matches_tuple(fobj, &req->con->tuple, req->con->last_pkt);
+}
+
 /** Object definitions */
 static struct Object_ops obj_ops = {
 	.obj_type           = "filter/ip",
@@ -149,6 +166,8 @@ static struct Filter_ops IpFilter_obj_ops = {
 	.ops                = &obj_ops,
 	.foo_load_from_xml  = IpFilter_load_from_xml,
 	.foo_matches_req    = IpFilter_matches_req,
+	.foo_matches_tuple  = IpFilter_matches_tuple,
+	.foo_dst_net        = IpFilter_dst_net,
 };
 
 
@@ -25,6 +25,7 @@ THE SOFTWARE.
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
+#include <string.h>
 
 #include <linux/netfilter.h>
 #include <arpa/inet.h>
@@ -37,11 +38,11 @@ THE SOFTWARE.
 
 
 #include <linux/netfilter/nfnetlink_queue.h>
-#include <netlink/netfilter/nfnl.h>
-#include <netlink/netfilter/queue.h>
-#include <netlink/netfilter/queue_msg.h>
-#include <netlink/msg.h>
-#include <netlink/object.h>
+
+/* older kernel headers, and kernels that never set it */
+#ifndef NFQA_SKB_CSUM_NOTVERIFIED
+#define NFQA_SKB_CSUM_NOTVERIFIED (1 << 2)
+#endif
 
 /**
 * @defgroup Ipv4Tcp  TCP/IP version 4 defintions
@@ -49,22 +50,164 @@ THE SOFTWARE.
 */
 
 #include "Ipv4Tcp.h"
+#include "NfQueueMsg.h"
 #include "nfq_wf_private.h"
 
 
-struct Ipv4TcpPkt *Ipv4TcpPkt_new(unsigned nl_buff_size)
+#define PKT_CACHE_LINE 64
+
+/** slot header, rounded up so the inline data starts on a cache line */
+#define PKT_SLOT_HDR_SIZE ((sizeof(struct Ipv4TcpPkt) + PKT_CACHE_LINE - 1) & ~(PKT_CACHE_LINE - 1))
+#define PKT_SLOT_SIZE (PKT_SLOT_HDR_SIZE + IPV4_TCP_PKT_SLOT_DATA)
+#define PKT_SLOT_DATA(pkt) ((uint8_t *)(pkt) + PKT_SLOT_HDR_SIZE)
+
+/**
+* Fixed size pool of packets, owned by a single NfQueue thread so no locking.
+* Each slot is a packet with an inline data buffer, so in steady state getting a packet,
+* parsing it and cloning it for out of order buffering does not allocate.
+* When the pool is empty, or the data does not fit inline, we fall back to the heap.
+*/
+struct Ipv4TcpPktPool {
+	uint8_t *slots; /**< n_slots * PKT_SLOT_SIZE, cache line aligned */
+	unsigned int n_slots;
+	struct Ipv4TcpPkt **free_list; /**< stack of free slots, LIFO to keep them cache hot */
+	unsigned int n_free;
+	unsigned int high_water; /**< most slots in use at one time */
+	uint64_t slot_allocs; /**< packets served from a slot */
+	uint64_t heap_allocs; /**< packets allocated on the heap because the pool was empty */
+	uint64_t heap_data; /**< data buffers too large for a slot */
+};
+
+/**
+* Create a packet pool
+* @arg n_slots number of preallocated packets
+*/
+struct Ipv4TcpPktPool *Ipv4TcpPktPool_new(unsigned int n_slots)
 {
-	struct Ipv4TcpPkt *new_pkt = calloc(1, sizeof(struct Ipv4TcpPkt));
-	if (!new_pkt)
+	struct Ipv4TcpPktPool *pool;
+	unsigned int i;
+
+	pool = calloc(1, sizeof(struct Ipv4TcpPktPool));
+	if (!pool)
 		return NULL;
 
-	if (nl_buff_size) {
+	if (posix_memalign((void **) &pool->slots, PKT_CACHE_LINE, (size_t) n_slots * PKT_SLOT_SIZE))
+		goto free_pool;
+
+	pool->free_list = malloc(n_slots * sizeof(struct Ipv4TcpPkt *));
+	if (!pool->free_list)
+		goto free_slots;
+
+	memset(pool->slots, 0, (size_t) n_slots * PKT_SLOT_SIZE);
+	pool->n_slots = n_slots;
+
+	// push in reverse so the first slot is handed out first
+	for (i = n_slots; i > 0; i--)
+		pool->free_list[pool->n_free++] = (struct Ipv4TcpPkt *) &pool->slots[(size_t) (i - 1) * PKT_SLOT_SIZE];
+
+	DBG(2, "packet pool %p slots=%u slot_size=%zu\n", pool, n_slots, (size_t) PKT_SLOT_SIZE);
+	return pool;
+
+free_slots:
+	free(pool->slots);
+free_pool:
+	free(pool);
+	return NULL;
+}
+
+/**
+* Free a packet pool. All packets must have been returned.
+*/
+void Ipv4TcpPktPool_del(struct Ipv4TcpPktPool **in_pool)
+{
+	struct Ipv4TcpPktPool *pool = *in_pool;
+
+	if (!pool)
+		return;
+
+	if (pool->n_free != pool->n_slots) {
+		DBG(1, "Warning %u packets still in use freeing pool %p\n",
+			pool->n_slots - pool->n_free, pool);
+	}
+
+	free(pool->free_list);
+	free(pool->slots);
+	free(pool);
+	*in_pool = NULL;
+}
+
+/**
+* Print pool usage counters
+*/
+void Ipv4TcpPktPool_printStats(struct Ipv4TcpPktPool *pool, FILE *stream)
+{
+	fprintf(stream, "pkt_pool slots=%u in_use=%u high_water=%u slot_allocs=%llu "
+		"heap_allocs=%llu heap_data=%llu\n",
+		pool->n_slots, pool->n_slots - pool->n_free, pool->high_water,
+		(unsigned long long) pool->slot_allocs,
+		(unsigned long long) pool->heap_allocs,
+		(unsigned long long) pool->heap_data);
+}
+
+static inline bool __pool_owns(struct Ipv4TcpPktPool *pool, struct Ipv4TcpPkt *pkt)
+{
+	return pool && (uint8_t *) pkt >= pool->slots
+		&& (uint8_t *) pkt < pool->slots + (size_t) pool->n_slots * PKT_SLOT_SIZE;
+}
+
+static struct Ipv4TcpPkt *__pool_get(struct Ipv4TcpPktPool *pool)
+{
+	struct Ipv4TcpPkt *pkt;
+	unsigned int in_use;
+
+	if (!pool->n_free)
+		return NULL;
+
+	pkt = pool->free_list[--pool->n_free];
+	memset(pkt, 0, sizeof(struct Ipv4TcpPkt));
+
+	pool->slot_allocs++;
+	in_use = pool->n_slots - pool->n_free;
+	if (in_use > pool->high_water)
+		pool->high_water = in_use;
+
+	return pkt;
+}
+
+/**
+* Get a new packet
+* @arg pool  pool to draw from, or NULL to allocate on the heap
+* @arg nl_buff_size size of data buffer to allocate, 0 for none
+*/
+struct Ipv4TcpPkt *Ipv4TcpPkt_new(struct Ipv4TcpPktPool *pool, unsigned nl_buff_size)
+{
+	struct Ipv4TcpPkt *new_pkt = NULL;
+
+	if (pool)
+		new_pkt = __pool_get(pool);
+
+	if (new_pkt) {
+		if (nl_buff_size && nl_buff_size <= IPV4_TCP_PKT_SLOT_DATA)
+			new_pkt->nl_buffer = PKT_SLOT_DATA(new_pkt);
+	} else {
+		new_pkt = calloc(1, sizeof(struct Ipv4TcpPkt));
+		if (!new_pkt)
+			return NULL;
+		if (pool)
+			pool->heap_allocs++;
+	}
+	new_pkt->pool = pool;
+	new_pkt->nl_buffer_size = nl_buff_size;
+
+	if (nl_buff_size && !new_pkt->nl_buffer) {
 		new_pkt->nl_buffer = malloc(nl_buff_size);
 
 		if (!new_pkt->nl_buffer) {
-			free(new_pkt);
+			Ipv4TcpPkt_del(&new_pkt);
 			return NULL;
 		}
+		if (pool)
+			pool->heap_data++;
 	}
 	DBG(6, "new pkt %p size=%d\n", new_pkt, nl_buff_size);
 	return new_pkt;
@@ -73,15 +216,21 @@ struct Ipv4TcpPkt *Ipv4TcpPkt_new(unsigned nl_buff_size)
 void Ipv4TcpPkt_del(struct Ipv4TcpPkt **in_pkt)
 {
 	struct Ipv4TcpPkt *pkt = *in_pkt;
+	struct Ipv4TcpPktPool *pool = pkt->pool;
 
-	if(pkt->nl_qmsg)
-		nfnl_queue_msg_put(pkt->nl_qmsg);
+	DBG(6, "free pkt %p nl_buffer=%p\n", pkt, pkt->nl_buffer);
 
-	if (pkt->nl_buffer)
-		free(pkt->nl_buffer);
+	if (__pool_owns(pool, pkt)) {
+		if (pkt->nl_buffer && pkt->nl_buffer != PKT_SLOT_DATA(pkt))
+			free(pkt->nl_buffer);
+		pkt->nl_buffer = NULL;
+		pool->free_list[pool->n_free++] = pkt;
+	} else {
+		if (pkt->nl_buffer)
+			free(pkt->nl_buffer);
 
-	DBG(6, "free pkt %p  qmsg=%p nl_buffer=%p\n", pkt, pkt->nl_qmsg, pkt->nl_buffer);
-	free(pkt);
+		free(pkt);
+	}
 	*in_pkt = NULL;
 }
 
@@ -90,7 +239,7 @@ struct Ipv4TcpPkt * Ipv4TcpPkt_clone(struct Ipv4TcpPkt *in_pkt, bool copy_packet
 {
 	struct Ipv4TcpPkt *new_pkt;
 
-	new_pkt = Ipv4TcpPkt_new(copy_packet_data ? in_pkt->ip_packet_length : 0);
+	new_pkt = Ipv4TcpPkt_new(in_pkt->pool, copy_packet_data ? in_pkt->ip_packet_length : 0);
 
 	DBG(6, "Clone of %d length\n", copy_packet_data ? in_pkt->ip_packet_length : 0);
 	if (!new_pkt)
@@ -105,6 +254,7 @@ struct Ipv4TcpPkt * Ipv4TcpPkt_clone(struct Ipv4TcpPkt *in_pkt, bool copy_packet
 	new_pkt->tcp_checksum = in_pkt->tcp_checksum;
 	new_pkt->ip_packet_length = in_pkt->ip_packet_length;
 	new_pkt->tcp_payload_length = in_pkt->tcp_payload_length;
+	new_pkt->skb_info = in_pkt->skb_info;
 
 	// set IP packet pointer to buffer
 	new_pkt->ip_data = new_pkt->nl_buffer;
@@ -119,26 +269,6 @@ struct Ipv4TcpPkt * Ipv4TcpPkt_clone(struct Ipv4TcpPkt *in_pkt, bool copy_packet
 	return new_pkt;
 }
 
-static struct nla_policy queue_policy[NFQA_MAX+1] = {
-	[NFQA_PACKET_HDR]		= {
-		.minlen	= sizeof(struct nfqnl_msg_packet_hdr),
-	},
-	[NFQA_VERDICT_HDR]		= {
-		.minlen	= sizeof(struct nfqnl_msg_verdict_hdr),
-	},
-	[NFQA_MARK]			= { .type = NLA_U32 },
-	[NFQA_TIMESTAMP]		= {
-		.minlen = sizeof(struct nfqnl_msg_packet_timestamp),
-	},
-	[NFQA_IFINDEX_INDEV]		= { .type = NLA_U32 },
-	[NFQA_IFINDEX_OUTDEV]		= { .type = NLA_U32 },
-	[NFQA_IFINDEX_PHYSINDEV]	= { .type = NLA_U32 },
-	[NFQA_IFINDEX_PHYSOUTDEV]	= { .type = NLA_U32 },
-	[NFQA_HWADDR]			= {
-		.minlen	= sizeof(struct nfqnl_msg_packet_hw),
-	},
-};
-
 #if 0
 #if __BYTE_ORDER == __BIG_ENDIAN
 static uint64_t ntohll(uint64_t x)
@@ -156,7 +286,8 @@ static uint64_t ntohll(uint64_t x)
 unsigned short get_cksum16(const unsigned short *data, int len, int csum)
 {
 	int nleft             = len;
-	int sum               = csum;
+	// unsigned, 32767 words of a 64KB packet overflow an int
+	uint32_t sum          = csum;
 	const unsigned short *w     = data;
 	unsigned short answer = 0;
 
@@ -257,25 +388,79 @@ void Ipv4TcpPkt_resetTcpCksum(unsigned char *ip_pkt, unsigned int ip_pkt_size, u
 	*sptr = cksum;
 }
 
+/**
+* Update a checksum for one 16 bit word that changed, RFC 1624 eqn. 3
+* HC' = ~(~HC + ~m + m').  Nothing else of the packet is read.
+* @arg cksum  checksum as found in the header
+* @arg old_val, new_val  the word before and after, both as found in the packet
+* @return the new checksum, in the byte order of the arguments
+*/
+uint16_t adjust_cksum16(uint16_t cksum, uint16_t old_val, uint16_t new_val)
+{
+	uint32_t sum;
+
+	sum = (uint16_t) ~cksum + (uint16_t) ~old_val + new_val;
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum += (sum >> 16);
+	return ~sum;
+}
+
+/** adjust_cksum16() for an aligned 32 bit field, two words */
+uint16_t adjust_cksum32(uint16_t cksum, uint32_t old_val, uint32_t new_val)
+{
+	uint32_t sum;
+
+	sum = (uint16_t) ~cksum
+		+ (uint16_t) ~(old_val >> 16) + (uint16_t) ~(old_val & 0xffff)
+		+ (new_val >> 16) + (new_val & 0xffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum += (sum >> 16);
+	return ~sum;
+}
+
+/** keep the TCP checksum right for a changed header word */
+static void __adjust_tcp_cksum32(struct Ipv4TcpPkt *pkt, uint32_t old_val, uint32_t new_val)
+{
+	uint16_t *cksum = (uint16_t *) &pkt->ip_data[pkt->ip_hdr_len + 16];
+
+	if (old_val == new_val)
+		return;
+
+	*cksum = adjust_cksum32(*cksum, old_val, new_val);
+	pkt->tcp_checksum = *cksum;
+}
+
+/**
+* Set TCP flags, the checksum is adjusted for the change.
+* With CSUMNOTREADY the checksum field is not a full checksum, see
+* Ipv4TcpPkt_resetTcpCon()
+*/
 void Ipv4TcpPkt_setTcpFlag(struct Ipv4TcpPkt *pkt, int flag_val)
 {
-	int *flag_data;
+	uint32_t *flag_data;
+	uint32_t old_val;
+
 	if (!pkt->ip_data)
 		return;
-	flag_data = ((int*) &pkt->ip_data[pkt->ip_hdr_len+TCP_FLAG_OFFSET]);
+	flag_data = ((uint32_t*) &pkt->ip_data[pkt->ip_hdr_len+TCP_FLAG_OFFSET]);
+	old_val = *flag_data;
 	*flag_data |= flag_val;
+	__adjust_tcp_cksum32(pkt, old_val, *flag_data);
 }
 
 void Ipv4TcpPkt_clearTcpFlag(struct Ipv4TcpPkt *pkt, int flag_val)
 
 {
-	int *flag_data;
+	uint32_t *flag_data;
+	uint32_t old_val;
 
 	if (!pkt->ip_data)
 		return;
 
-	flag_data = ((int*) &pkt->ip_data[pkt->ip_hdr_len+TCP_FLAG_OFFSET]);
+	flag_data = ((uint32_t*) &pkt->ip_data[pkt->ip_hdr_len+TCP_FLAG_OFFSET]);
+	old_val = *flag_data;
 	*flag_data &= ~flag_val;
+	__adjust_tcp_cksum32(pkt, old_val, *flag_data);
 }
 
 
@@ -325,6 +510,20 @@ int Ipv4TcpPkt_printPkt(struct Ipv4TcpPkt *pkt, FILE *stream)
 }
 
 
+/**
+* Should the checksums be computed again.
+* The kernel validated the checksum of a received packet unless it says
+* CSUM_NOTVERIFIED, and computes the checksum of a CSUMNOTREADY one
+* after the verdict.
+*/
+static inline bool __verify_cksum(struct Ipv4TcpPkt *pkt)
+{
+	if (pkt->skb_info & NFQA_SKB_CSUMNOTREADY)
+		return false;
+
+	return pkt->verify_cksum || (pkt->skb_info & NFQA_SKB_CSUM_NOTVERIFIED);
+}
+
 int Ipv4TcpPkt_parseIpPayload(struct Ipv4TcpPkt *pkt)
 {
 	unsigned char *payload = pkt->ip_data;
@@ -349,16 +548,19 @@ int Ipv4TcpPkt_parseIpPayload(struct Ipv4TcpPkt *pkt)
 		return -EINVAL;
 	}
 
-	verify_cksum = get_cksum16((unsigned short *)payload,
-					pkt->ip_hdr_len, 0);
-
 	pkt->ip_checksum =  ((unsigned short) *((unsigned short*) &payload[10]));
 
-	if (verify_cksum) {
-		DBG(1, "IP Header checksum ERROR ip_checksum= %hu = 0x%04hx  verify= %u =0x%04hx\n",
-			pkt->ip_checksum, pkt->ip_checksum, verify_cksum, verify_cksum);
-	} else {
-		DBG(4, "IP header checksum OK\n");
+	// the kernel checks the IP header on input, and fills it before the output hooks
+	if (pkt->verify_cksum) {
+		verify_cksum = get_cksum16((unsigned short *)payload,
+						pkt->ip_hdr_len, 0);
+
+		if (verify_cksum) {
+			DBG(1, "IP Header checksum ERROR ip_checksum= %hu = 0x%04hx  verify= %u =0x%04hx\n",
+				pkt->ip_checksum, pkt->ip_checksum, verify_cksum, verify_cksum);
+		} else {
+			DBG(4, "IP header checksum OK\n");
+		}
 	}
 
 	// No need to convert to host byte order. inet_ntop() will do it for us,
@@ -394,6 +596,17 @@ int Ipv4TcpPkt_parseIpPayload(struct Ipv4TcpPkt *pkt)
 
 	pkt->tcp_flags = ((int) *((int*) &payload[pkt->ip_hdr_len + TCP_FLAG_OFFSET])) & __cpu_to_be32(0x00FF0000);
 
+	if (DEBUG_LEVEL > 5) {
+		Ipv4TcpPkt_printPkt(pkt, stdout);
+		print_hex(payload, pkt->ip_packet_length);
+	}
+
+	/* locally generated, the TCP checksum only covers the pseudo header
+	until the kernel or the NIC fills it in. Received, the kernel or NIC
+	has checked it already */
+	if (!__verify_cksum(pkt))
+		return 0;
+
 	sum = ((unsigned short) *((unsigned short*) &payload[12])) + // SRC
 			((unsigned short) *((unsigned short*) &payload[14])) +
 			((unsigned short) *((unsigned short*) &payload[16])) + // DST
@@ -403,11 +616,6 @@ int Ipv4TcpPkt_parseIpPayload(struct Ipv4TcpPkt *pkt)
 	verify_cksum = get_cksum16((unsigned short *)&payload[hdr_len],
 			pkt->ip_packet_length - hdr_len, sum);
 
-	if (DEBUG_LEVEL > 5) {
-		Ipv4TcpPkt_printPkt(pkt, stdout);
-		print_hex(payload, pkt->ip_packet_length);
-	}
-
 	/* because we include the received checksum in the calculation,
 	the verification sum should be 0 */
 	if (verify_cksum) {
@@ -420,132 +628,75 @@ int Ipv4TcpPkt_parseIpPayload(struct Ipv4TcpPkt *pkt)
 
 int Ipv4TcpPkt_parseNlHdrMsg(struct Ipv4TcpPkt *pkt, struct nlmsghdr *nlh)
 {
-	struct nlattr *tb[NFQA_MAX+1];
-	struct nlattr *attr;
+	struct NfQueuePktMsg msg;
 	int err;
 
-	pkt->nl_qmsg = nfnl_queue_msg_alloc();
-
-	if (!pkt->nl_qmsg)
-		return -ENOMEM;
-
-	err = nlmsg_parse(nlh, sizeof(struct nfgenmsg), tb, NFQA_MAX,
-			queue_policy);
-
+	err = NfQueueMsg_parsePkt(nlh, &msg);
 	if (err < 0)
-		goto errout;
-
-	nfnl_queue_msg_set_group(pkt->nl_qmsg, nfnlmsg_res_id(nlh));
-	nfnl_queue_msg_set_family(pkt->nl_qmsg, nfnlmsg_family(nlh));
-
-	attr = tb[NFQA_PACKET_HDR];
-	if (attr) {
-		struct nfqnl_msg_packet_hdr *hdr = nla_data(attr);
-
-		pkt->packet_id = ntohl(hdr->packet_id);
-		DBG(3, "packet_id=%d\n", pkt->packet_id);
-
-		nfnl_queue_msg_set_packetid(pkt->nl_qmsg, ntohl(hdr->packet_id));
-		if (hdr->hw_protocol)
-			nfnl_queue_msg_set_hwproto(pkt->nl_qmsg, hdr->hw_protocol);
-		nfnl_queue_msg_set_hook(pkt->nl_qmsg, hdr->hook);
-	}
-
-	attr = tb[NFQA_MARK];
-	if (attr)
-		nfnl_queue_msg_set_mark(pkt->nl_qmsg, ntohl(nla_get_u32(attr)));
-
-	#if 0
-	/* for now we are not using time, and here is a timeval header issue */
-	attr = tb[NFQA_TIMESTAMP];
-	if (attr) {
-		struct nfqnl_msg_packet_timestamp *timestamp = nla_data(attr);
-		struct timeval tv;
-
-		tv.tv_sec = ntohll(timestamp->sec);
-		tv.tv_usec = ntohll(timestamp->usec);
-		DBG(5, "Pkt time = %u.%06u", (unsigned)tv.tv_sec,(unsigned) tv.tv_usec);
-		nfnl_queue_msg_set_timestamp(pkt->nl_qmsg, &tv);
-	}
-	#endif
-
-	attr = tb[NFQA_IFINDEX_INDEV];
-	if (attr)
-		nfnl_queue_msg_set_indev(pkt->nl_qmsg, ntohl(nla_get_u32(attr)));
-
-	attr = tb[NFQA_IFINDEX_OUTDEV];
-	if (attr)
-		nfnl_queue_msg_set_outdev(pkt->nl_qmsg, ntohl(nla_get_u32(attr)));
-
-	attr = tb[NFQA_IFINDEX_PHYSINDEV];
-	if (attr)
-		nfnl_queue_msg_set_physindev(pkt->nl_qmsg, ntohl(nla_get_u32(attr)));
+		return err;
 
-	attr = tb[NFQA_IFINDEX_PHYSOUTDEV];
-	if (attr)
-		nfnl_queue_msg_set_physoutdev(pkt->nl_qmsg, ntohl(nla_get_u32(attr)));
+	pkt->packet_id = msg.packet_id;
+	DBG(3, "packet_id=%d\n", pkt->packet_id);
+	pkt->mark = msg.mark;
+	pkt->skb_info = msg.skb_info;
+	pkt->verdict = NF_ACCEPT;
 
-	attr = tb[NFQA_HWADDR];
-	if (attr) {
-		struct nfqnl_msg_packet_hw *hw = nla_data(attr);
+	if (msg.payload) {
+		DBG(3, "Set payload len=%d\n", msg.payload_len);
+		pkt->ip_packet_length = msg.payload_len;
+		pkt->ip_data = msg.payload;
 
-		nfnl_queue_msg_set_hwaddr(pkt->nl_qmsg, hw->hw_addr,
-				ntohs(hw->hw_addrlen));
-	}
-
-	attr = tb[NFQA_PAYLOAD];
-	if (attr) {
-		DBG(3, "Set payload len=%d\n", nla_len(attr));
-		pkt->ip_packet_length = nla_len(attr);
-		pkt->ip_data = nla_data(attr);
-		// 		err = nfnl_queue_msg_set_payload(msg, nla_data(attr),
-		// 						 nla_len(attr));
-
-		// TODO parse IP packet
 		Ipv4TcpPkt_parseIpPayload(pkt);
-		if (err < 0)
-			goto errout;
 	}
 
 	return 0;
-	errout:
-
-	return err;
 }
 
 #if 0
 void Ipv4TcpPkt_setNlVerictAccept(struct Ipv4TcpPkt *pkt)
 {
-	nfnl_queue_msg_set_verdict(pkt->nl_qmsg, NF_ACCEPT);
+	pkt->verdict = NF_ACCEPT;
 }
 #endif
 
 void Ipv4TcpPkt_setNlVerictDrop(struct Ipv4TcpPkt *pkt) {
-	nfnl_queue_msg_set_verdict(pkt->nl_qmsg, NF_DROP);
+	pkt->verdict = NF_DROP;
 }
 
 
 void Ipv4TcpPkt_resetTcpCon(struct Ipv4TcpPkt *pkt) {
 	Ipv4TcpPkt_setTcpFlag(pkt, (TCP_FLAG_FIN | TCP_FLAG_RST)); // set FIN RST
-	Ipv4TcpPkt_resetTcpCksum(pkt->ip_data, pkt->ip_packet_length, pkt->ip_hdr_len);
+
+	/* only the pseudo header is summed yet, and a modified packet no longer
+	gets its checksum filled in by the kernel */
+	if (pkt->skb_info & NFQA_SKB_CSUMNOTREADY)
+		Ipv4TcpPkt_resetTcpCksum(pkt->ip_data, pkt->ip_packet_length, pkt->ip_hdr_len);
+
 	pkt->modified_ip_data = pkt->ip_data; // mark modified
 	pkt->modified_ip_data_len = pkt->ip_packet_length;
 }
 
 void Ipv4TcpPkt_setMark(struct Ipv4TcpPkt *pkt, uint32_t mark, uint32_t mask) {
-	uint32_t old_mark;
-
 	if (mask == -1) {
-		nfnl_queue_msg_set_mark(pkt->nl_qmsg, mark);
+		pkt->mark = mark;
 	} else {
-		old_mark = nfnl_queue_msg_get_mark(pkt->nl_qmsg);
-		old_mark &= ~mask; // clear bits part of mask
-		old_mark |= mark & mask;
-		nfnl_queue_msg_set_mark(pkt->nl_qmsg, old_mark);
+		pkt->mark &= ~mask; // clear bits part of mask
+		pkt->mark |= mark & mask;
 	}
+	pkt->mark_changed = true;
 
 }
 
+/**
+* Set bits of the connection's conntrack mark with the verdict.
+* Later packets of the connection can be matched with -m connmark
+*/
+void Ipv4TcpPkt_setConnMark(struct Ipv4TcpPkt *pkt, uint32_t mark, uint32_t mask) {
+	pkt->connmark = mark & mask;
+	pkt->connmark_mask = mask;
+	pkt->connmark_changed = true;
+}
+
 
 /** @}  */
 
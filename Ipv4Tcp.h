@@ -42,7 +42,13 @@ THE SOFTWARE.
 //byte offset int TCP header
 #define TCP_FLAG_OFFSET 12
 
-#define TCP_SEQ_HI_WRAPZONE 0xFFFFFFFF - 1500
+// one max size IP packet, a GSO packet may be that large
+#define TCP_SEQ_HI_WRAPZONE 0xFFFFFFFF - 0xFFFF
+
+/** Inline data bytes in every pool slot, enough for a full size ethernet frame */
+#define IPV4_TCP_PKT_SLOT_DATA 2048
+
+struct Ipv4TcpPktPool;
 
 struct Ipv4TcpTuple {
 	in_addr_t src_ip;
@@ -67,19 +73,36 @@ struct Ipv4TcpPkt {
 	uint16_t ip_packet_length; /**< Length of IP packet */
 	uint16_t tcp_payload_length; /**< Length of TCP payload */
 	void *nl_buffer;  /**< pointer to raw netlink message buffer. */
+	unsigned int nl_buffer_size; /**< bytes owned by nl_buffer, 0 if it points into a receive buffer */
 	uint8_t *ip_data; /**< pointer to raw IP packet data */
 	uint8_t *tcp_payload; /**< pointer within data to TCP payload */
-	struct nfnl_queue_msg *nl_qmsg;
+	uint32_t verdict; /**< NF_ACCEPT, NF_DROP ... */
+	uint32_t mark; /**< skb mark, sent back with the verdict if mark_changed */
+	uint32_t skb_info; /**< NFQA_SKB_* flags, NFQA_SKB_GSO for a packet not yet segmented */
+	bool verify_cksum; /**< check the checksums even if the kernel already has */
 	uint8_t ip_hdr_len;
 	uint8_t *modified_ip_data; /**< if not NULL the payload has been modified */
 	unsigned int modified_ip_data_len;
+	bool mark_changed; /**< verdict must carry a new mark */
+	bool connmark_changed; /**< verdict must set connmark bits of the conntrack entry */
+	uint32_t connmark; /**< conntrack mark bits to set, under connmark_mask */
+	uint32_t connmark_mask;
+	bool held; /**< verdict deferred, a connection's out of order buffer owns the packet */
+	void *rx_buf; /**< receive buffer ip_data points into, pinned while held */
+	struct Ipv4TcpPktPool *pool; /**< pool to draw clones from and return to. NULL if plain heap */
 };
 
 unsigned short get_cksum16(const unsigned short *data, int len, int csum);
+uint16_t adjust_cksum16(uint16_t cksum, uint16_t old_val, uint16_t new_val);
+uint16_t adjust_cksum32(uint16_t cksum, uint32_t old_val, uint32_t new_val);
 
 void Ipv4TcpPkt_resetTcpCksum(unsigned char *ip_pkt, unsigned int ip_pkt_size, unsigned int ip_hdr_len);
 
-struct Ipv4TcpPkt *Ipv4TcpPkt_new(unsigned nl_buff_size);
+struct Ipv4TcpPktPool *Ipv4TcpPktPool_new(unsigned int n_slots);
+void Ipv4TcpPktPool_del(struct Ipv4TcpPktPool **pool);
+void Ipv4TcpPktPool_printStats(struct Ipv4TcpPktPool *pool, FILE *stream);
+
+struct Ipv4TcpPkt *Ipv4TcpPkt_new(struct Ipv4TcpPktPool *pool, unsigned nl_buff_size);
 void Ipv4TcpPkt_del(struct Ipv4TcpPkt **pkt);
 struct Ipv4TcpPkt * Ipv4TcpPkt_clone(struct Ipv4TcpPkt *in_pkt, bool copy_packet_data);
 
@@ -97,6 +120,7 @@ void Ipv4TcpPkt_resetTcpCon(struct Ipv4TcpPkt *pkt);
 void print_hex(const unsigned char* payload, int len);
 
 void Ipv4TcpPkt_setMark(struct Ipv4TcpPkt *pkt, uint32_t mark, uint32_t mask);
+void Ipv4TcpPkt_setConnMark(struct Ipv4TcpPkt *pkt, uint32_t mark, uint32_t mask);
 
 /** @}  */
 
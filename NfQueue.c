@@ -20,6 +20,8 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
 
+#define _GNU_SOURCE /* for recvmmsg */
+
 #include <pthread.h>
 #include <stdlib.h>
 #include <pthread.h>
@@ -27,8 +29,14 @@ THE SOFTWARE.
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <stddef.h>
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
 #include <linux/netfilter.h>
+#include <linux/netfilter/nfnetlink_queue.h>
 
 #include <netlink/netfilter/nfnl.h>
 #include <netlink/netfilter/queue.h>
@@ -44,10 +52,14 @@ THE SOFTWARE.
 
 #include "HttpReq.h"
 #include "HttpConn.h"
+#include "HttpConnTable.h"
 #include "NfQueue.h"
+#include "NfQueueMsg.h"
+#include "Slab.h"
 #include "FilterType.h"
 #include "FilterList.h"
 #include "Rules.h"
+#include "ContentFilter.h"
 #include "WfConfig.h"
 #include "nfq_wf_private.h"
 
@@ -58,6 +70,54 @@ THE SOFTWARE.
 #define MAX(a, b) (a > b ? a : b)
 #define MIN(a, b) (a < b ? a : b)
 
+/** HttpConn of an expiry timer */
+#define TIMER_TO_CON(t) ((struct HttpConn *) ((char *) (t) - offsetof(struct HttpConn, timer)))
+
+/** size of each netlink receive buffer.
+Large enough to hold several full sized queue messages, so one read can
+carry many packets when the kernel aggregates them. */
+#define NFQ_RECV_BUF_SIZE (16 * 1024)
+
+/** size of each netlink receive buffer with gso, a 64KB IP packet and
+the netlink and queue attribute headers in front of it */
+#define NFQ_RECV_BUF_GSO_SIZE (68 * 1024)
+
+/** receive buffers carved from the slab at a time */
+#define NFQ_RX_SLAB_CHUNK 8
+
+/** size of the verdict send buffer, must hold one verdict with a full size payload */
+#define NFQ_SEND_BUF_SIZE (96 * 1024)
+
+/** upper limit of messages per recvmmsg() */
+#define NFQ_MAX_RECV_BATCH 1024
+
+/** seconds between connection timer wheel ticks */
+#define NFQ_HOUSEKEEPING_INTERVAL 1
+
+/** max events handled per epoll_wait() */
+#define NFQ_MAX_EVENTS 16
+
+/** least entries in the memo of evicted flows, it grows to max_connections */
+#define NFQ_RETIRED_MEMO_SIZE 4096
+
+/** flag on a retired memo value, the flow was trusted and its
+later packets also get the trust_mark connmark */
+#define NFQ_RETIRED_TRUSTED 0x100
+/** flag on a retired memo value, a non HTTP flow that is accepted
+whole, its later packets also get non_http_mark */
+#define NFQ_RETIRED_NON_HTTP 0x200
+#define NFQ_RETIRED_BYPASS (NFQ_RETIRED_TRUSTED | NFQ_RETIRED_NON_HTTP)
+
+/** connections looked at from the LRU tail for one holding buffered packets */
+#define NFQ_EVICT_SCAN 16
+
+/** min seconds a queue stays overloaded, so it does not flap at the threshold */
+#define NFQ_OVERLOAD_MIN_TIME 2
+
+/** seconds after an overload that packets of unknown connections are
+accepted, those started or forgotten while overloaded */
+#define NFQ_FAIL_OPEN_WINDOW CONNECTION_TIMEOUT
+
 /**
 * @ingroup Object
 * @defgroup NFQueue NFQueue thread that operates on a single NF_QUEUE
@@ -66,6 +126,65 @@ THE SOFTWARE.
 */
 
 
+/**
+* Per queue counters
+*/
+struct NfQueue_stats {
+	uint64_t recv_calls;  /**< recvmmsg() calls that returned data */
+	uint64_t recv_msgs;   /**< netlink datagrams received */
+	uint64_t recv_full;   /**< recvmmsg() calls that filled the whole batch */
+	uint64_t recv_pkts;   /**< queue messages (packets) parsed */
+	uint64_t recv_truncated; /**< datagrams larger than a receive buffer, their packets are lost */
+	uint64_t gso_pkts;    /**< packets the kernel queued unsegmented, one verdict each */
+	uint64_t gso_bytes;   /**< IP bytes of those packets */
+	uint64_t verdict_msgs;   /**< single packet verdict messages sent */
+	uint64_t verdict_batches; /**< NFQNL_MSG_VERDICT_BATCH messages sent */
+	uint64_t verdict_batched; /**< packets accepted by a batch verdict */
+	uint64_t housekeeping_runs; /**< timer driven connection expiry runs */
+	uint64_t con_expired; /**< connections removed by timeout */
+	uint64_t con_timer_rearm; /**< timers that fired on a connection still active */
+	uint64_t con_evicted; /**< connections evicted by max_connections */
+	uint64_t con_evicted_bytes; /**< connections evicted by max_buffered_bytes */
+	uint64_t con_evicted_held; /**< connections evicted by a full hold buffer */
+	uint64_t retired_pkts; /**< packets of evicted connections */
+	uint64_t con_trusted; /**< connections no longer tracked after a trust rule matched */
+	uint64_t trusted_pkts; /**< packets of trusted or SYN accepted connections still queued */
+	uint64_t syn_accepted; /**< connections accepted from their SYN, never tracked */
+	uint64_t syn_rejected; /**< connections rejected from their SYN */
+	uint64_t syn_reaccepted; /**< packets of SYN accepted flows gone from the retired memo */
+	uint64_t non_http_offloaded; /**< non HTTP connections no longer tracked */
+	uint64_t non_http_offloaded_bytes; /**< bytes of their later packets accepted without connection state */
+	uint64_t held_pkts; /**< out of order packets with their verdict deferred */
+	uint64_t hold_timeouts; /**< connections that failed open waiting for a gap */
+	uint64_t rx_buf_allocs; /**< receive buffers taken from rx_slab to replace pinned ones */
+	uint64_t lost_pkts; /**< packet ids skipped, dropped or accepted by a full kernel queue */
+	uint64_t overloads; /**< times the queue went into overload */
+	uint64_t overload_pkts; /**< packets accepted unfiltered while overloaded */
+	uint64_t overload_cons; /**< connections forgotten while overloaded */
+	uint64_t unfiltered_pkts; /**< packets of unknown connections accepted after an overload */
+};
+
+/**
+* A file descriptor watched by the queue thread epoll loop
+*/
+struct NfQueue_fd_handler {
+	ubi_dlNode node; /**< ubiqx "internal" data */
+	int fd; /**< -1 once removed */
+	NfQueue_fd_cb cb;
+	void *arg;
+};
+
+/**
+* One receive buffer, from rx_slab, with rx_buf_size bytes of data.
+* Held packets point into it, so while any is held the buffer is pinned
+* and a spare takes its place in the receive ring.
+*/
+struct NfQueue_rx_buf {
+	unsigned int pins; /**< held packets with data in this buffer */
+	bool in_ring; /**< behind one of recv_iov */
+	unsigned char data[];
+};
+
 /**
 * NfQueue object.   This will be a thread that operates on one netfilter queue
 */
@@ -79,9 +198,15 @@ struct NfQueue
 	uint32_t last_packet_id;
 
 	bool keep_running; /*!< should we keep running */
-	int exit_pipe[2]; /*!< Write to this pipe to break out of select() */
+	bool config_changed; /*!< NfQueue_updateConfig() was called */
 	pthread_t thread_id;  /*!< This threads ID */
 
+	int epoll_fd; /*!< every fd the thread waits on */
+	int event_fd; /*!< written to wake the thread on stop or reload */
+	int timer_fd; /*!< periodic housekeeping, see NFQ_HOUSEKEEPING_INTERVAL */
+	ubi_dlList fd_handlers; /*!< struct NfQueue_fd_handler registered with epoll_fd */
+	ubi_dlList dead_fd_handlers; /*!< removed handlers, freed after the current epoll_wait() batch */
+
 	/** configuration, that contains rules, etc */
 	struct WfConfig *config;
 	pthread_mutex_t config_mutex;
@@ -92,14 +217,85 @@ struct NfQueue
 	/** libnl NF_QUEUE configuration. */
 	struct nfnl_queue *nl_queue;
 
-	/** Linked list of connections we are tracking */
+	/** Linked list of connections we are tracking.
+	Most recently active first, the tail is evicted first. */
 	HttpConn_list_t *con_list;
+
+	/** con_list indexed by 4-tuple */
+	struct HttpConnTable *con_table;
+
+	/** connection expiry, one tick per second of time(NULL) */
+	struct TimerWheel con_timers;
+
+	/** slabs HttpConn and HttpReq are allocated from */
+	struct HttpConnCtx con_ctx;
+
+	/** connection limits from WfConfig, 0 for no limit */
+	unsigned int max_connections;
+	unsigned int max_buffered_bytes;
+	enum non_http_action eviction_policy;
+	/** buffered_bytes of all connections, plus the receive buffers
+	pinned by held packets */
+	uint64_t buffered_bytes;
+
+	/** evicted flows, with the eviction_policy for their later packets */
+	struct HttpConnMemo *retired;
+
+	/** connmark bits for trusted connections, 0 for none */
+	uint32_t trust_mark;
+	/** connmark and mark bits for accepted non HTTP connections, 0 for none */
+	uint32_t non_http_mark;
+	enum non_http_action non_http_action;
+	enum syn_verdicts syn_verdicts;
+
+	/** kernel queue length and overload handling, see overload_action */
+	unsigned int queue_maxlen;
+	bool overload_accept;
+	unsigned int overload_backlog;
+	bool verify_checksums; /**< check checksums the kernel has already checked */
+	unsigned int backlog; /**< messages read in back to back full recvmmsg() batches */
+	bool overloaded; /**< every packet is accepted unfiltered */
+	time_t overload_start;
+	time_t fail_open_until; /**< unknown connections are accepted until then */
+
+	/** max number of netlink messages to read per recvmmsg() call */
+	unsigned int recv_batch;
+	struct mmsghdr *recv_msgs; /**< recvmmsg() vector, recv_batch long */
+	struct iovec *recv_iov; /**< one iovec per recv_msgs */
+	struct NfQueue_rx_buf **recv_bufs; /**< buffer behind each recv_iov */
+	struct NfQueue_rx_buf *cur_rx; /**< buffer being parsed */
+	struct Slab *rx_slab; /**< receive buffers, pinned ones are replaced from here */
+	unsigned int rx_buf_size; /**< data bytes of each receive buffer */
+	bool gso; /**< the kernel queues GSO packets whole, see WfConfig gso */
+
+	/** packets whose verdict waits in a connection, see reorder_mode */
+	unsigned int held_pkts;
+	unsigned int hold_timeout; /**< seconds before a connection fails open */
+
+	/** Preallocated packets, for received and buffered out of order packets */
+	struct Ipv4TcpPktPool *pkt_pool;
+	unsigned int pkt_pool_size; /**< slots in pkt_pool */
+
+	/** verdicts waiting to be sent */
+	struct NfQueueMsgTx tx;
+	uint32_t batch_packet_id; /**< highest packet id waiting for batch ACCEPT */
+	unsigned int batch_count; /**< packets waiting for batch ACCEPT */
+
+	struct NfQueue_stats stats;
 };
 
 
 
+static void __con_release_held(struct NfQueue* nfq_wf, struct HttpConn* con,
+	enum non_http_action action);
+
 static void __httpConnList_rmCon(struct NfQueue* nfq_wf, struct HttpConn* con)
 {
+	// held packets are still in the kernel and need a verdict
+	__con_release_held(nfq_wf, con, non_http_action_accept);
+	nfq_wf->buffered_bytes -= con->buffered_bytes;
+	HttpConnTable_remove(nfq_wf->con_table, con);
+	TimerWheel_del(&nfq_wf->con_timers, &con->timer);
 	ubi_dlRemThis(nfq_wf->con_list, con);
 	HttpConn_del(&con);
 }
@@ -151,6 +347,36 @@ int NfQueue_constructor(struct Object *obj)
 	nfq_wf->con_list = malloc(sizeof(HttpConn_list_t));
 	nfq_wf->con_list = ubi_dlInitList(nfq_wf->con_list);
 
+	nfq_wf->con_table = HttpConnTable_new(0);
+	if (!nfq_wf->con_table) {
+		ERROR_FATAL("No memory\n");
+	}
+
+	TimerWheel_init(&nfq_wf->con_timers, time(NULL));
+
+	if (HttpConnCtx_init(&nfq_wf->con_ctx)) {
+		ERROR_FATAL("No memory\n");
+	}
+
+	nfq_wf->retired = HttpConnMemo_new(NFQ_RETIRED_MEMO_SIZE);
+	if (!nfq_wf->retired) {
+		ERROR_FATAL("No memory\n");
+	}
+
+	ubi_dlInitList(&nfq_wf->fd_handlers);
+	ubi_dlInitList(&nfq_wf->dead_fd_handlers);
+	nfq_wf->timer_fd = -1;
+
+	nfq_wf->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (nfq_wf->epoll_fd < 0) {
+		ERROR_FATAL("Unable to create epoll fd %m\n");
+	}
+
+	nfq_wf->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (nfq_wf->event_fd < 0) {
+		ERROR_FATAL("Unable to create event fd %m\n");
+	}
+
 	return 0;
 }
 
@@ -163,20 +389,10 @@ int NfQueue_destructor(struct Object *obj)
 	struct NfQueue *nfq_wf = (struct NfQueue *)obj;
 	struct HttpConn* con = NULL;
 	struct HttpConn* next_con = NULL;
+	struct NfQueue_fd_handler *h;
 
 	DBG(5, " destructor %p\n", nfq_wf);
 
-	if (nfq_wf->nl_queue)
-		nfnl_queue_put(nfq_wf->nl_queue);
-
-	nl_socket_free(nfq_wf->nf_sock);
-
-	if (nfq_wf->exit_pipe[0])
-		close(nfq_wf->exit_pipe[0]);
-
-	if (nfq_wf->exit_pipe[1])
-		close(nfq_wf->exit_pipe[1]);
-
 	if (ubi_dlCount(nfq_wf->con_list)) {
 		DBG(1, "Warning %lu HTTP connections in list before free\n",
 			ubi_dlCount(nfq_wf->con_list));
@@ -189,8 +405,45 @@ int NfQueue_destructor(struct Object *obj)
 				__httpConnList_rmCon(nfq_wf, con);
 			}
 	}
+
+	// verdicts of packets that were still held
+	if (nfq_wf->tx.buf)
+		NfQueueMsgTx_flush(&nfq_wf->tx);
+
+	if (nfq_wf->nl_queue)
+		nfnl_queue_put(nfq_wf->nl_queue);
+
+	NfQueueMsgTx_free(&nfq_wf->tx);
+
+	nl_socket_free(nfq_wf->nf_sock);
+
+	while ((h = (struct NfQueue_fd_handler *) ubi_dlRemHead(&nfq_wf->fd_handlers)))
+		free(h);
+
+	while ((h = (struct NfQueue_fd_handler *) ubi_dlRemHead(&nfq_wf->dead_fd_handlers)))
+		free(h);
+
+	if (nfq_wf->timer_fd >= 0)
+		close(nfq_wf->timer_fd);
+
+	if (nfq_wf->event_fd >= 0)
+		close(nfq_wf->event_fd);
+
+	if (nfq_wf->epoll_fd >= 0)
+		close(nfq_wf->epoll_fd);
+
 	WfConfig_put(&nfq_wf->config);
 	free(nfq_wf->con_list);
+	HttpConnTable_del(&nfq_wf->con_table);
+	HttpConnMemo_del(&nfq_wf->retired);
+	HttpConnCtx_destroy(&nfq_wf->con_ctx);
+	// after the connections, which may still hold buffered packets
+	Ipv4TcpPktPool_del(&nfq_wf->pkt_pool);
+	free(nfq_wf->recv_msgs);
+	free(nfq_wf->recv_iov);
+	free(nfq_wf->recv_bufs);
+	if (nfq_wf->rx_slab)
+		Slab_del(&nfq_wf->rx_slab);
 	return 0;
 }
 /** @} */
@@ -281,92 +534,588 @@ static int __event_input(struct nl_msg *msg, void *arg)
 }
 #endif
 
-static struct HttpConn* __httpConnList_expire(struct NfQueue* nfq_wf)
+/**
+* When a connection should be removed if no more packets arrive.
+* Connections that one side has closed time out faster.
+* A connection holding packets must fill its gaps before hold_timeout.
+*/
+static time_t __con_deadline(struct NfQueue* nfq_wf, struct HttpConn* con)
 {
-	struct HttpConn* con = NULL;
-	struct HttpConn* next_con = NULL;
+	time_t deadline;
+
+	if (MAX(con->server_state, con->client_state) > TCP_CONNTRACK_CLOSE_WAIT)
+		deadline = con->last_pkt + CON_FIN_TIMEOUT + 1;
+	else
+		deadline = con->last_pkt + CONNECTION_TIMEOUT + 1;
+
+	if (con->held_pkts)
+		deadline = MIN(deadline, con->held_since + (time_t) nfq_wf->hold_timeout);
+
+	return deadline;
+}
+
+/**
+* Arm the expiry timer of a connection after a packet.
+* Moving a timer later is deferred until it fires, only a shorter
+* deadline (FIN/RST seen) moves it now.
+*/
+static void __con_timer_update(struct NfQueue* nfq_wf, struct HttpConn* con)
+{
+	time_t deadline = __con_deadline(nfq_wf, con);
+
+	if (!con->timer.pending || (uint64_t) deadline < con->timer.expires)
+		TimerWheel_mod(&nfq_wf->con_timers, &con->timer, deadline);
+}
+
+static void __con_timer_cb(struct TimerWheel_timer *t, void *arg)
+{
+	struct NfQueue* nfq_wf = arg;
+	struct HttpConn* con = TIMER_TO_CON(t);
 	time_t now = time(NULL);
-	time_t delta; // time difference between now and last packet
-
-	next_con = (struct HttpConn *)ubi_dlFirst(nfq_wf->con_list);
-
-	/*for each object in list */
-	while (next_con) {
-		con = next_con;
-		next_con = (struct HttpConn *)ubi_dlNext(con);
-		delta = now - con->last_pkt;
-
-		if (delta > CONNECTION_TIMEOUT) {
-			DBG(3, "Timeout Con ID=%d No packet in %d seconds.\n",
-				con->id, (int) delta);
-			__httpConnList_rmCon(nfq_wf, con);
-		} else if ( delta > CON_FIN_TIMEOUT
-			&& (MAX(con->server_state, con->client_state) > TCP_CONNTRACK_CLOSE_WAIT)) {
-			// Timeout connections that one side has closed faster.
-			DBG(3, "Close Timeout Con ID=%d No packet in %d seconds.\n",
-				con->id, (int) delta);
-			__httpConnList_rmCon(nfq_wf, con);
-		}
+	time_t deadline = __con_deadline(nfq_wf, con);
+
+	if (deadline > now) {
+		// packets arrived since the timer was set
+		nfq_wf->stats.con_timer_rearm++;
+		TimerWheel_add(&nfq_wf->con_timers, &con->timer, deadline);
+		return;
 	}
 
-	return NULL;
+	if (con->held_pkts && con->held_since + (time_t) nfq_wf->hold_timeout <= now) {
+		/* fail open: the gap never filled, let the held packets through.
+		The parser can not follow this stream any more, so stop tracking
+		it and accept the rest of the flow */
+		DBG(2, "Con ID=%d gave up on %u held packets after %d seconds\n",
+			con->id, con->held_pkts, (int) (now - con->held_since));
+		nfq_wf->stats.hold_timeouts++;
+		HttpConnMemo_insert(nfq_wf->retired, &con->tuple, non_http_action_accept,
+			CONNECTION_TIMEOUT, now);
+		__httpConnList_rmCon(nfq_wf, con);
+		return;
+	}
+
+	DBG(3, "Timeout Con ID=%d No packet in %d seconds.\n",
+		con->id, (int) (now - con->last_pkt));
+	nfq_wf->stats.con_expired++;
+	__httpConnList_rmCon(nfq_wf, con);
+}
+
+/**
+* Remove connections that timed out.
+* Cost is proportional to the timers that fire, not to the number of connections.
+*/
+static void __httpConnList_expire(struct NfQueue* nfq_wf)
+{
+	TimerWheel_advance(&nfq_wf->con_timers, time(NULL), __con_timer_cb, nfq_wf);
 }
+
 static struct HttpConn* __find_tcp_conn(struct NfQueue* nfq_wf, struct Ipv4TcpPkt *pkt)
 {
-	struct HttpConn* con = NULL;
+	return HttpConnTable_find(nfq_wf->con_table, &pkt->tuple);
+}
 
-#if 0
-char src_buf[INET_ADDRSTRLEN+2];
-char dst_buf[INET_ADDRSTRLEN+2];
+static void __add_tcp_conn(struct NfQueue* nfq_wf, struct HttpConn* con,
+	struct Ipv4TcpPkt *pkt)
+{
+	if (HttpConnTable_insert(nfq_wf->con_table, &pkt->tuple, con)) {
+		ERROR_FATAL("Unable to index connection id=%u\n", con->id);
+	}
+	con->tuple = pkt->tuple;
+	ubi_dlAddHead(nfq_wf->con_list, con);
+}
 
-	inet_ntop(AF_INET, &pkt->ip_data[12], src_buf, sizeof(src_buf));
-	inet_ntop(AF_INET, &pkt->ip_data[16], dst_buf, sizeof(dst_buf));
-	DBG(5, "Searching for SRC_IP=%s DST_IP=%s sport=%u dport=%u\n",
-		src_buf, dst_buf, pkt->tuple.src_port, con->tuple.dst_port);
-#endif
-	/*for each object in list */
-	for (con = (struct HttpConn *)ubi_dlFirst(nfq_wf->con_list);
-		con; con = (struct HttpConn *)ubi_dlNext(con)) {
-
-		if (!memcmp(&con->tuple, &pkt->tuple, sizeof(struct Ipv4TcpTuple))) {
-			return con;
-		} else if (con->tuple.dst_ip == pkt->tuple.src_ip &&
-				con->tuple.src_ip == pkt->tuple.dst_ip &&
-				con->tuple.dst_port == pkt->tuple.src_port &&
-				con->tuple.src_port == pkt->tuple.dst_port) {
-			return con;
-		}
+/** mark a connection as most recently active */
+static inline void __con_touch(struct NfQueue* nfq_wf, struct HttpConn* con)
+{
+	if ((struct HttpConn *) ubi_dlFirst(nfq_wf->con_list) == con)
+		return;
 
-#if DEBUG_LEVEL > 1
-// 		inet_ntop(AF_INET, &con->tuple.src_ip, src_buf, sizeof(src_buf));
-// 		inet_ntop(AF_INET, &con->tuple.dst_ip, dst_buf, sizeof(dst_buf));
-
-		DBG(5, "No match Con_ID=%u src_ip=0x%08X dst_ip=0x%08X sport=%u dport =%u \n"
-			" pkt_dst=0x%08X con_dst=0x%08X p_sport=%d c_sport=%d sstate=%d cstate=%d\n",
-			con->id,
-			con->tuple.src_ip, con->tuple.dst_ip,
-			con->tuple.src_port, con->tuple.dst_port,
-			pkt->tuple.src_ip, pkt->tuple.dst_ip,
-			pkt->tuple.src_port, con->tuple.src_port,
-			con->server_state, con->client_state);
-#endif
+	ubi_dlRemThis(nfq_wf->con_list, con);
+	ubi_dlAddHead(nfq_wf->con_list, con);
+}
+
+/**
+* Stop tracking a connection before it closed.
+* Its later packets get the eviction policy from the retired memo.
+*/
+static void __con_evict(struct NfQueue* nfq_wf, struct HttpConn* con)
+{
+	DBG(2, "Evict con id=%u buffered=%u q_id=%d\n",
+		con->id, con->buffered_bytes, nfq_wf->q_id);
+
+	HttpConnMemo_insert(nfq_wf->retired, &con->tuple, nfq_wf->eviction_policy,
+		CONNECTION_TIMEOUT, time(NULL));
+	__con_release_held(nfq_wf, con, nfq_wf->eviction_policy);
+	__httpConnList_rmCon(nfq_wf, con);
+}
+
+/**
+* Make room for one more connection under max_connections,
+* evicting from the LRU tail.
+*/
+static void __con_make_room(struct NfQueue* nfq_wf)
+{
+	struct HttpConn* con;
+
+	if (!nfq_wf->max_connections)
+		return;
+
+	while (ubi_dlCount(nfq_wf->con_list) >= nfq_wf->max_connections
+		&& (con = (struct HttpConn *) ubi_dlLast(nfq_wf->con_list))) {
+		nfq_wf->stats.con_evicted++;
+		__con_evict(nfq_wf, con);
 	}
+}
 
-	return NULL;
+/**
+* Evict connections until buffered packets fit max_buffered_bytes.
+* The victim is the least recently active connection holding buffered
+* packets within NFQ_EVICT_SCAN of the tail, or else cur, the connection
+* that just grew.
+*/
+static void __con_trim_buffers(struct NfQueue* nfq_wf, struct HttpConn* cur)
+{
+	struct HttpConn* con;
+	int i;
+
+	if (!nfq_wf->max_buffered_bytes)
+		return;
+
+	while (nfq_wf->buffered_bytes > nfq_wf->max_buffered_bytes) {
+		con = (struct HttpConn *) ubi_dlLast(nfq_wf->con_list);
+		for (i = 0; con && !con->buffered_bytes && i < NFQ_EVICT_SCAN; i++)
+			con = (struct HttpConn *) ubi_dlPrev(con);
+
+		if (!con || !con->buffered_bytes)
+			con = cur;
+		if (!con)
+			break;
+
+		nfq_wf->stats.con_evicted_bytes++;
+		if (con == cur)
+			cur = NULL;
+		__con_evict(nfq_wf, con);
+	}
 }
 
-static void __add_tcp_conn(struct NfQueue* nfq_wf, struct HttpConn* con)
+/**
+* Check if the rest of a connection can bypass the queue
+* @return NFQ_RETIRED_TRUSTED or NFQ_RETIRED_NON_HTTP, 0 to keep tracking it
+*/
+static uint32_t __con_bypass(struct NfQueue* nfq_wf, struct HttpConn* con)
 {
-	ubi_dlAddHead(nfq_wf->con_list, con);
+	/* a trust verdict can come from the host or URL and can not be asked
+	again, so without trust_mark to keep its packets out of the queue the
+	connection stays tracked instead of relying on the retired memo */
+	if (con->trusted && nfq_wf->trust_mark)
+		return NFQ_RETIRED_TRUSTED;
+
+	/* reset and drop act on every packet, only accept can skip the queue.
+	Without a mark the later packets keep coming through the queue, and
+	the retired memo may lose the flow to a colliding one, so it stays
+	tracked and __handle_non_http_pkt() accepts them */
+	if (con->not_http && !con->server_data_altered && nfq_wf->non_http_mark
+		&& nfq_wf->non_http_action == non_http_action_accept)
+		return NFQ_RETIRED_NON_HTTP;
+
+	return 0;
+}
+
+/**
+* Set the mark of a bypass on the verdict of a packet,
+* so the ruleset keeps the flow's later packets out of the queue.
+*/
+static void __bypass_mark_pkt(struct NfQueue* nfq_wf, struct Ipv4TcpPkt *pkt,
+	uint32_t bypass)
+{
+	if (bypass & NFQ_RETIRED_TRUSTED) {
+		if (nfq_wf->trust_mark)
+			Ipv4TcpPkt_setConnMark(pkt, nfq_wf->trust_mark, nfq_wf->trust_mark);
+	} else if (nfq_wf->non_http_mark) {
+		Ipv4TcpPkt_setConnMark(pkt, nfq_wf->non_http_mark, nfq_wf->non_http_mark);
+		Ipv4TcpPkt_setMark(pkt, nfq_wf->non_http_mark, nfq_wf->non_http_mark);
+	}
+}
+
+/**
+* Stop tracking a connection whose later packets are all accepted.
+* The verdict that marked its conntrack entry lets the ruleset keep
+* later packets out of the queue, the ones already queued are accepted
+* from the retired memo.
+*/
+static void __con_bypass_queue(struct NfQueue* nfq_wf, struct HttpConn* con,
+	uint32_t bypass)
+{
+	DBG(2, "Bypass queue con id=%u %s q_id=%d\n", con->id,
+		(bypass & NFQ_RETIRED_TRUSTED) ? "trusted" : "non HTTP", nfq_wf->q_id);
+
+	if (bypass & NFQ_RETIRED_TRUSTED)
+		nfq_wf->stats.con_trusted++;
+	else
+		nfq_wf->stats.non_http_offloaded++;
+
+	HttpConnMemo_insert(nfq_wf->retired, &con->tuple,
+		non_http_action_accept | bypass, CONNECTION_TIMEOUT, time(NULL));
+	__httpConnList_rmCon(nfq_wf, con);
+}
+
+/**
+* Mark a packet of a flow accepted from its tuple and remember the flow,
+* like a trusted one.
+* @param tuple  client to server tuple
+*/
+static void __NfQueue_tuple_accept(struct NfQueue* nfq_wf, struct Ipv4TcpPkt *pkt,
+	const struct Ipv4TcpTuple *tuple, struct Rule *rule)
+{
+	uint32_t mark;
+	uint32_t mask;
+
+	// the rule's mark goes on the packet and in the connmark,
+	// so the ruleset can restore it on packets that skip the queue
+	mark = mask = nfq_wf->trust_mark;
+	if (rule && Rule_getMark(rule)) {
+		Ipv4TcpPkt_setMark(pkt, Rule_getMark(rule), Rule_getMask(rule));
+		mark |= Rule_getMark(rule) & Rule_getMask(rule);
+		mask |= Rule_getMask(rule);
+	}
+	if (mask)
+		Ipv4TcpPkt_setConnMark(pkt, mark, mask);
+
+	HttpConnMemo_insert(nfq_wf->retired, tuple,
+		non_http_action_accept | NFQ_RETIRED_TRUSTED,
+		CONNECTION_TIMEOUT, time(NULL));
+}
+
+/**
+* Give a new connection its verdict from the SYN, when the rules decide
+* it from the IP/TCP tuple alone.  Called with config_mutex held.
+* An accepted connection is handled like a trusted one.
+* @return true if decided, the connection must not be tracked
+*/
+static bool __NfQueue_syn_verdict(struct NfQueue* nfq_wf, struct Ipv4TcpPkt *pkt)
+{
+	struct ContentFilter *cf;
+	struct Rule *rule;
+	enum Action verdict;
+
+	if (nfq_wf->syn_verdicts == syn_verdicts_off)
+		return false;
+
+	cf = WfConfig_getContentFilter(nfq_wf->config);
+	verdict = ContentFilter_getTupleVerdict(cf, &pkt->tuple, time(NULL), &rule);
+	if (verdict == Action_nomatch)
+		return false;
+
+	if (verdict & Action_reject) {
+		if (nfq_wf->syn_verdicts != syn_verdicts_all)
+			return false;
+
+		DBG(2, "Reject SYN rule id=%d q_id=%d\n",
+			rule ? Rule_getId(rule) : -1, nfq_wf->q_id);
+		nfq_wf->stats.syn_rejected++;
+		ContentFilter_logTuple(cf, rule, &pkt->tuple);
+		Ipv4TcpPkt_setNlVerictDrop(pkt);
+		return true;
+	}
+
+	DBG(2, "Accept SYN rule id=%d q_id=%d\n",
+		rule ? Rule_getId(rule) : -1, nfq_wf->q_id);
+	nfq_wf->stats.syn_accepted++;
+	ContentFilter_logTuple(cf, rule, &pkt->tuple);
+
+	__NfQueue_tuple_accept(nfq_wf, pkt, &pkt->tuple, rule);
+	return true;
+}
+
+/**
+* A packet with no connection and no retired memo entry.  If its flow was
+* accepted from the SYN, the memo slot may have been taken by another
+* flow since.  The tuple verdict keeps no state, so ask it again instead
+* of dropping the packet.  Called with config_mutex held.
+* @return true if accepted
+*/
+static bool __NfQueue_tuple_reaccept(struct NfQueue* nfq_wf, struct Ipv4TcpPkt *pkt)
+{
+	struct Ipv4TcpTuple tuple = pkt->tuple;
+	struct Rule *rule;
+	enum Action verdict;
+
+	if (nfq_wf->syn_verdicts == syn_verdicts_off)
+		return false;
+
+	// the rules look at the client to server tuple
+	if (tuple.src_port == HTTP_TCP_PORT) {
+		tuple.src_ip = pkt->tuple.dst_ip;
+		tuple.dst_ip = pkt->tuple.src_ip;
+		tuple.src_port = pkt->tuple.dst_port;
+		tuple.dst_port = pkt->tuple.src_port;
+	}
+
+	verdict = ContentFilter_getTupleVerdict(WfConfig_getContentFilter(nfq_wf->config),
+		&tuple, time(NULL), &rule);
+	if (verdict == Action_nomatch || (verdict & Action_reject))
+		return false;
+
+	DBG(2, "Accept again rule id=%d q_id=%d\n",
+		rule ? Rule_getId(rule) : -1, nfq_wf->q_id);
+	nfq_wf->stats.syn_reaccepted++;
+	__NfQueue_tuple_accept(nfq_wf, pkt, &tuple, rule);
+	return true;
+}
+
+/**
+* Verdict for a packet of an evicted connection
+*/
+static void __apply_eviction_policy(struct Ipv4TcpPkt *pkt, uint32_t policy)
+{
+	switch (policy) {
+		case non_http_action_accept:
+			break;
+		case non_http_action_drop:
+			Ipv4TcpPkt_setNlVerictDrop(pkt);
+			break;
+		case non_http_action_reset:
+		default:
+			if (!(pkt->tcp_flags & TCP_FLAG_RST))
+				Ipv4TcpPkt_resetTcpCon(pkt);
+			break;
+	}
+}
+
+/** take the connection limits of the current config */
+static void __NfQueue_load_limits(struct NfQueue* nfq_wf)
+{
+	nfq_wf->max_connections = WfConfig_getMaxConnections(nfq_wf->config);
+	nfq_wf->max_buffered_bytes = WfConfig_getMaxBufferedBytes(nfq_wf->config);
+	nfq_wf->eviction_policy = WfConfig_getEvictionPolicy(nfq_wf->config);
+	nfq_wf->hold_timeout = WfConfig_getHoldTimeout(nfq_wf->config);
+	nfq_wf->trust_mark = WfConfig_getTrustMark(nfq_wf->config);
+	nfq_wf->non_http_mark = WfConfig_getNonHttpMark(nfq_wf->config);
+	nfq_wf->non_http_action = WfConfig_getNonHttpAction(nfq_wf->config);
+	nfq_wf->syn_verdicts = WfConfig_getSynVerdicts(nfq_wf->config);
+	nfq_wf->queue_maxlen = WfConfig_getQueueMaxLen(nfq_wf->config);
+	nfq_wf->overload_accept = WfConfig_getOverloadAccept(nfq_wf->config);
+	nfq_wf->overload_backlog = WfConfig_getOverloadBacklog(nfq_wf->config);
+	nfq_wf->verify_checksums = WfConfig_getVerifyChecksums(nfq_wf->config);
+
+	/* every evicted connection needs its own entry for its later packets
+	to get the eviction_policy, a smaller memo would mostly overwrite them */
+	if (HttpConnMemo_grow(nfq_wf->retired, nfq_wf->max_connections)) {
+		ERROR("No memory for a retired memo of %u flows q_id=%d\n",
+			nfq_wf->max_connections, nfq_wf->q_id);
+	}
+}
+
+/**
+* Set the kernel queue length, and let the kernel accept the packets that
+* do not fit when overload_action is accept.
+* With gso the kernel queues GSO packets as they are instead of segmenting
+* them first.
+*/
+static void __NfQueue_config_queue(struct NfQueue* nfq_wf)
+{
+	uint32_t flags = 0;
+
+	if (nfq_wf->overload_accept)
+		flags |= NFQA_CFG_F_FAIL_OPEN;
+	if (nfq_wf->gso)
+		flags |= NFQA_CFG_F_GSO;
+
+	NfQueueMsgTx_addConfig(&nfq_wf->tx, nfq_wf->queue_maxlen,
+		flags, NFQA_CFG_F_FAIL_OPEN | NFQA_CFG_F_GSO);
+}
+
+/**
+* Stop filtering until the queue has caught up.
+* Only with overload_action accept, otherwise the kernel drops what does not fit.
+*/
+static void __NfQueue_enter_overload(struct NfQueue* nfq_wf, const char *why)
+{
+	if (nfq_wf->overloaded || !nfq_wf->overload_accept)
+		return;
+
+	nfq_wf->overloaded = true;
+	nfq_wf->overload_start = time(NULL);
+	nfq_wf->stats.overloads++;
+	WARN("Queue %d overloaded, %s. Accepting packets unfiltered\n", nfq_wf->q_id, why);
+}
+
+static void __NfQueue_leave_overload(struct NfQueue* nfq_wf)
+{
+	time_t now = time(NULL);
+
+	nfq_wf->overloaded = false;
+	nfq_wf->fail_open_until = now + NFQ_FAIL_OPEN_WINDOW;
+	WARN("Queue %d caught up after %ld seconds, filtering new connections\n",
+		nfq_wf->q_id, (long) (now - nfq_wf->overload_start));
+}
+
+/**
+* Queue one NFQNL_MSG_VERDICT_BATCH accepting every packet
+* up to and including batch_packet_id.
+*/
+static void __NfQueue_flush_verdicts(struct NfQueue* nfq_wf)
+{
+	if (!nfq_wf->batch_count)
+		return;
+
+	DBG(3, "batch ACCEPT %u packets up to id=%u q_id=%d\n",
+		nfq_wf->batch_count, nfq_wf->batch_packet_id, nfq_wf->q_id);
+
+	NfQueueMsgTx_addVerdictBatch(&nfq_wf->tx, nfq_wf->batch_packet_id, NF_ACCEPT);
+
+	nfq_wf->stats.verdict_batches++;
+	nfq_wf->stats.verdict_batched += nfq_wf->batch_count;
+	nfq_wf->batch_count = 0;
+}
+
+/**
+* Queue the verdict of a packet.
+* Plain ACCEPTs are coalesced and sent later with __NfQueue_flush_verdicts().
+* Anything else gets its own message, after the pending batch so the
+* kernel reinjects packets in the order they were queued.
+* While packets are held a batch would accept them too, so every
+* verdict is sent on its own.
+* Everything reaches the kernel on the next NfQueueMsgTx_flush().
+*/
+static void __NfQueue_send_verdict(struct NfQueue* nfq_wf, struct Ipv4TcpPkt *pkt)
+{
+	struct NfQueueVerdict v;
+
+	if (!pkt->modified_ip_data && !pkt->mark_changed && !pkt->connmark_changed
+		&& pkt->verdict == NF_ACCEPT && !nfq_wf->held_pkts) {
+		nfq_wf->batch_packet_id = pkt->packet_id;
+		nfq_wf->batch_count++;
+		return;
+	}
+
+	__NfQueue_flush_verdicts(nfq_wf);
+	nfq_wf->stats.verdict_msgs++;
+
+	v.packet_id = pkt->packet_id;
+	v.verdict = pkt->verdict;
+	v.set_mark = pkt->mark_changed;
+	v.mark = pkt->mark;
+	v.set_connmark = pkt->connmark_changed;
+	v.connmark = pkt->connmark;
+	v.connmark_mask = pkt->connmark_mask;
+	v.payload = pkt->modified_ip_data;
+	v.payload_len = pkt->modified_ip_data_len;
+
+	if(pkt->modified_ip_data) {
+		DBG(1, "Sending modified IP packet %p of len %d orig packet ptr =%p\n",
+			pkt->modified_ip_data, pkt->modified_ip_data_len, pkt->ip_data);
+	}
+
+	// the payload is copied into the send buffer
+	NfQueueMsgTx_addVerdict(&nfq_wf->tx, &v);
+
+	// if we allocated a new buffer
+	if (pkt->modified_ip_data && pkt->modified_ip_data != pkt->ip_data) {
+		free(pkt->modified_ip_data);
+		pkt->modified_ip_data = NULL;
+		pkt->modified_ip_data_len = 0;
+	}
+}
+
+/** memory a pinned receive buffer accounts for in buffered_bytes */
+static inline unsigned int __rx_buf_pinned_size(struct NfQueue* nfq_wf)
+{
+	return sizeof(struct NfQueue_rx_buf) + nfq_wf->rx_buf_size;
 }
 
+/**
+* Keep the receive buffer of a packet that is now held.
+* The whole buffer is charged to buffered_bytes once, however many
+* held packets share it.
+*/
+static void __rx_buf_pin(struct NfQueue* nfq_wf, struct Ipv4TcpPkt *pkt)
+{
+	pkt->rx_buf = nfq_wf->cur_rx;
+	if (!nfq_wf->cur_rx->pins++)
+		nfq_wf->buffered_bytes += __rx_buf_pinned_size(nfq_wf);
+	nfq_wf->held_pkts++;
+	nfq_wf->stats.held_pkts++;
+}
+
+static void __rx_buf_unpin(struct NfQueue* nfq_wf, struct Ipv4TcpPkt *pkt)
+{
+	struct NfQueue_rx_buf *rx = pkt->rx_buf;
+
+	pkt->rx_buf = NULL;
+	nfq_wf->held_pkts--;
+
+	if (!rx || --rx->pins)
+		return;
+
+	nfq_wf->buffered_bytes -= __rx_buf_pinned_size(nfq_wf);
+	if (rx->in_ring)
+		return;
+
+	// out of the ring and unused
+	Slab_free(nfq_wf->rx_slab, rx);
+}
+
+/**
+* Send the verdicts of the held packets a connection is done with.
+* They are sent one by one after the current packet, in sequence order.
+*/
+static void __con_send_released(struct NfQueue* nfq_wf, struct HttpConn* con)
+{
+	struct Ipv4TcpPkt *pkt;
+
+	while ((pkt = (struct Ipv4TcpPkt *) ubi_dlRemHead(&con->released))) {
+		DBG(3, "release held packet id=%u seq_num=%u verdict=%u\n",
+			pkt->packet_id, pkt->seq_num, pkt->verdict);
+		pkt->held = false;
+		// held_pkts is still counting it, so this is not batched
+		__NfQueue_send_verdict(nfq_wf, pkt);
+		__rx_buf_unpin(nfq_wf, pkt);
+		Ipv4TcpPkt_del(&pkt);
+	}
+}
+
+/**
+* Give every held packet of a connection its verdict now,
+* without waiting for the gaps.
+*/
+static void __con_release_held(struct NfQueue* nfq_wf, struct HttpConn* con,
+	enum non_http_action action)
+{
+	struct Ipv4TcpPkt *pkt;
+
+	if (!con->held_pkts && !ubi_dlCount(&con->released))
+		return;
+
+	nfq_wf->buffered_bytes -= con->buffered_bytes;
+	HttpConn_releaseHeld(con);
+	nfq_wf->buffered_bytes += con->buffered_bytes;
+
+	if (action != non_http_action_accept) {
+		for (pkt = (struct Ipv4TcpPkt *) ubi_dlFirst(&con->released);
+			pkt; pkt = (struct Ipv4TcpPkt *) ubi_dlNext(pkt))
+			__apply_eviction_policy(pkt, action);
+	}
+
+	__con_send_released(nfq_wf, con);
+}
+
+/**
+* @return 1 if a connection kept the packet to give its verdict later,
+* the caller must not free it
+*/
 static int __NfQueue_process_pkt(struct NfQueue* nfq_wf, struct Ipv4TcpPkt *pkt)
 {
 	struct HttpConn* con;
+	unsigned int buffered;
+	uint32_t policy;
+	uint32_t bypass = 0;
+	bool decided;
+	bool held;
 	int ret;
 
 	// by default, may be changed later
-	nfnl_queue_msg_set_verdict(pkt->nl_qmsg, NF_ACCEPT);
+	pkt->verdict = NF_ACCEPT;
 
 	con = __find_tcp_conn(nfq_wf, pkt);
 	if (!con) {
@@ -374,17 +1123,57 @@ static int __NfQueue_process_pkt(struct NfQueue* nfq_wf, struct Ipv4TcpPkt *pkt)
 		if (pkt->tcp_flags &
 			(TCP_FLAG_PSH | TCP_FLAG_RST |TCP_FLAG_FIN | TCP_FLAG_ACK )) {
 
+			if (HttpConnMemo_lookup(nfq_wf->retired, &pkt->tuple, time(NULL), &policy)) {
+				nfq_wf->stats.retired_pkts++;
+				if (policy & NFQ_RETIRED_BYPASS) {
+					// queued before the connmark was set, or not marked
+					if (policy & NFQ_RETIRED_TRUSTED)
+						nfq_wf->stats.trusted_pkts++;
+					else
+						nfq_wf->stats.non_http_offloaded_bytes += pkt->ip_packet_length;
+					__bypass_mark_pkt(nfq_wf, pkt, policy);
+					policy &= ~NFQ_RETIRED_BYPASS;
+				}
+				__apply_eviction_policy(pkt, policy);
+				__NfQueue_send_verdict(nfq_wf, pkt);
+				return 0;
+			}
+
+			pthread_mutex_lock(&nfq_wf->config_mutex);
+			decided = __NfQueue_tuple_reaccept(nfq_wf, pkt);
+			pthread_mutex_unlock(&nfq_wf->config_mutex);
+			if (decided) {
+				__NfQueue_send_verdict(nfq_wf, pkt);
+				return 0;
+			}
+
 			DBG(2, "Ignore packet no connection found q_id=%d\n", nfq_wf->q_id);
 
 			if (pkt->tcp_payload_length) {
-				nfnl_queue_msg_set_verdict(pkt->nl_qmsg, NF_DROP);
+				if (time(NULL) < nfq_wf->fail_open_until)
+					nfq_wf->stats.unfiltered_pkts++;
+				else
+					pkt->verdict = NF_DROP;
 			}
-			nfnl_queue_msg_send_verdict(nfq_wf->nf_sock, pkt->nl_qmsg);
+			__NfQueue_send_verdict(nfq_wf, pkt);
+			return 0;
+		}
+
+		// new SYN, the tuple may be reused from an evicted flow
+		HttpConnMemo_remove(nfq_wf->retired, &pkt->tuple);
+
+		pthread_mutex_lock(&nfq_wf->config_mutex);
+		decided = __NfQueue_syn_verdict(nfq_wf, pkt);
+		pthread_mutex_unlock(&nfq_wf->config_mutex);
+		if (decided) {
+			__NfQueue_send_verdict(nfq_wf, pkt);
 			return 0;
 		}
 
+		__con_make_room(nfq_wf);
+
 		pthread_mutex_lock(&nfq_wf->config_mutex);
-		con = HttpConn_new(nfq_wf->config);
+		con = HttpConn_new(nfq_wf->config, &nfq_wf->con_ctx);
 		pthread_mutex_unlock(&nfq_wf->config_mutex);
 
 		DBG(1, "No TCP connection for this packet. Create New id = %u q_id=%d\n",
@@ -392,107 +1181,206 @@ static int __NfQueue_process_pkt(struct NfQueue* nfq_wf, struct Ipv4TcpPkt *pkt)
 		if (!con) {
 			ERROR_FATAL("No memory\n");
 		}
-		__add_tcp_conn(nfq_wf, con);
+		__add_tcp_conn(nfq_wf, con, pkt);
 	} else {
 		DBG(1, "Packet for TCP connection id = %u q_id=%d\n",
 			con->id, nfq_wf->q_id);
+		__con_touch(nfq_wf, con);
 	}
 
+	buffered = con->buffered_bytes;
 	ret = HttpConn_processsPkt(con, pkt);
 	DBG(3, "HttpConn_processsPkt returned %d \n", ret)
+	nfq_wf->buffered_bytes += con->buffered_bytes;
+	nfq_wf->buffered_bytes -= buffered;
+
+	// verdict of this packet first, then of held ones it let through
+	held = pkt->held;
+	if (ret != TCP_CONNTRACK_CLOSE && !con->hold_full)
+		bypass = __con_bypass(nfq_wf, con);
+	if (bypass && !held)
+		__bypass_mark_pkt(nfq_wf, pkt, bypass);
+	if (held)
+		__rx_buf_pin(nfq_wf, pkt);
+	else
+		__NfQueue_send_verdict(nfq_wf, pkt);
+	__con_send_released(nfq_wf, con);
 
 	if (ret == TCP_CONNTRACK_CLOSE) {
 		__httpConnList_rmCon(nfq_wf, con);
-	}
-
-	if(pkt->modified_ip_data) {
-		DBG(1, "Sending modified IP packet %p of len %d orig packet ptr =%p\n",
-			pkt->modified_ip_data, pkt->modified_ip_data_len, pkt->ip_data);
-		nfnl_queue_msg_send_verdict_payload(nfq_wf->nf_sock, pkt->nl_qmsg,
-			pkt->modified_ip_data, pkt->modified_ip_data_len);
-
-		// if we allocated a new buffer
-		if (pkt->modified_ip_data != pkt->ip_data) {
-			free(pkt->modified_ip_data);
-			pkt->modified_ip_data = NULL;
-			pkt->modified_ip_data_len = 0;
-		}
+	} else if (con->hold_full) {
+		// the reset went out, the held packets get the eviction policy
+		nfq_wf->stats.con_evicted_held++;
+		__con_evict(nfq_wf, con);
+	} else if (bypass) {
+		__con_bypass_queue(nfq_wf, con, bypass);
 	} else {
-		if (pkt->nl_qmsg)
-			nfnl_queue_msg_send_verdict(nfq_wf->nf_sock, pkt->nl_qmsg);
-		else {
-			ERROR_FATAL("Skip sending queue verdict \n");
-		}
+		__con_timer_update(nfq_wf, con);
+		__con_trim_buffers(nfq_wf, con);
 	}
 
+	return held;
+}
 
-	return 0;
+/**
+* Overloaded, accept the packet without looking at it.
+* Its connection is forgotten, the packets it misses would leave it
+* with a wrong state.
+*/
+static void __NfQueue_overload_pkt(struct NfQueue* nfq_wf, struct Ipv4TcpPkt *pkt)
+{
+	struct HttpConn* con;
+
+	nfq_wf->stats.overload_pkts++;
+
+	con = __find_tcp_conn(nfq_wf, pkt);
+	if (con) {
+		nfq_wf->stats.overload_cons++;
+		__httpConnList_rmCon(nfq_wf, con);
+	}
+
+	pkt->verdict = NF_ACCEPT;
+	__NfQueue_send_verdict(nfq_wf, pkt);
 }
 
 static void __NfQueue_check_packet_id(struct NfQueue* nfq_wf, struct Ipv4TcpPkt *pkt)
 {
-	struct nfnl_queue_msg *lost_msg;
+	struct NfQueueVerdict lost = { .verdict = NF_DROP };
 	uint32_t next_packet_id = nfq_wf->last_packet_id + 1;
 
 	if (pkt->packet_id > next_packet_id) {
 		WARN("Queue %d overload packet_id=%d next_packet_id=%d delta=%d\n",
 			 nfq_wf->q_id, pkt->packet_id, next_packet_id, pkt->packet_id - next_packet_id);
+		nfq_wf->stats.lost_pkts += pkt->packet_id - next_packet_id;
+
+		/* the kernel accepted the missing packets, nothing to clear,
+		but connections missed some of their data */
+		if (nfq_wf->overload_accept) {
+			__NfQueue_enter_overload(nfq_wf, "kernel queue full");
+			nfq_wf->last_packet_id = pkt->packet_id;
+			return;
+		}
 #if 1
-		lost_msg = nfnl_queue_msg_alloc();
-
 		do {
-			nfnl_queue_msg_set_group(lost_msg, nfq_wf->q_id);
-			nfnl_queue_msg_set_family(lost_msg, AF_INET);
-			nfnl_queue_msg_set_packetid(lost_msg, next_packet_id);
 			/* drop this packet so it clears the netlink buffer */
-			nfnl_queue_msg_set_verdict(lost_msg, NF_DROP);
-			nfnl_queue_msg_send_verdict(nfq_wf->nf_sock, lost_msg);
+			lost.packet_id = next_packet_id;
+			NfQueueMsgTx_addVerdict(&nfq_wf->tx, &lost);
 			next_packet_id++;
 		} while (pkt->packet_id > next_packet_id);
-		nfnl_queue_msg_put(lost_msg);
 #endif
 	}
 
 	nfq_wf->last_packet_id = pkt->packet_id;
 }
 
-static int __NfQueue_recv_pkt(struct NfQueue* nfq_wf)
+/**
+* Allocate the recvmmsg() vector and its buffers.
+* Called from the queue thread before entering the main loop
+*/
+static int __NfQueue_alloc_recv_batch(struct NfQueue* nfq_wf)
 {
-	int n, err = 0, multipart = 0;
-	unsigned char *buf = NULL;
-	struct nlmsghdr *hdr;
-	struct sockaddr_nl nla = {0};
-	int pkt_counter;
-	struct iovec iov;
-	struct Ipv4TcpPkt *pkt;
-	struct msghdr msg = {
-		.msg_name = (void *) &nla,
-		.msg_namelen = sizeof(struct sockaddr_nl),
-		.msg_iov = &iov,
-		.msg_iovlen = 1,
-		.msg_control = NULL,
-		.msg_controllen = 0,
-		.msg_flags = 0,
-	};
+	unsigned int i;
+
+	// a GSO packet is up to 64KB, and must arrive whole in one buffer
+	nfq_wf->rx_buf_size = nfq_wf->gso ? NFQ_RECV_BUF_GSO_SIZE : NFQ_RECV_BUF_SIZE;
+
+	nfq_wf->recv_msgs = calloc(nfq_wf->recv_batch, sizeof(struct mmsghdr));
+	nfq_wf->recv_iov = calloc(nfq_wf->recv_batch, sizeof(struct iovec));
+	nfq_wf->recv_bufs = calloc(nfq_wf->recv_batch, sizeof(struct NfQueue_rx_buf *));
+	nfq_wf->rx_slab = Slab_new("RxBuf",
+		sizeof(struct NfQueue_rx_buf) + nfq_wf->rx_buf_size, NFQ_RX_SLAB_CHUNK);
+
+	if (!nfq_wf->recv_msgs || !nfq_wf->recv_iov || !nfq_wf->recv_bufs || !nfq_wf->rx_slab)
+		return -ENOMEM;
+
+	for (i = 0; i < nfq_wf->recv_batch; i++) {
+		nfq_wf->recv_bufs[i] = Slab_alloc(nfq_wf->rx_slab);
+		if (!nfq_wf->recv_bufs[i])
+			return -ENOMEM;
+		nfq_wf->recv_bufs[i]->pins = 0;
+		nfq_wf->recv_bufs[i]->in_ring = true;
+		nfq_wf->recv_iov[i].iov_base = nfq_wf->recv_bufs[i]->data;
+		nfq_wf->recv_iov[i].iov_len = nfq_wf->rx_buf_size;
+		nfq_wf->recv_msgs[i].msg_hdr.msg_iov = &nfq_wf->recv_iov[i];
+		nfq_wf->recv_msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	DBG(2, "q_id=%d recv batch=%u buffers of %u bytes gso=%d\n",
+		nfq_wf->q_id, nfq_wf->recv_batch, nfq_wf->rx_buf_size, nfq_wf->gso);
+	return 0;
+}
+
+/**
+* Take a pinned buffer out of the receive ring, a spare takes its place
+*/
+static void __rx_buf_replace(struct NfQueue* nfq_wf, unsigned int i)
+{
+	struct NfQueue_rx_buf *rx = Slab_alloc(nfq_wf->rx_slab);
 
-	continue_reading:
+	if (!rx) {
+		ERROR_FATAL("No memory for receive buffer\n");
+	}
+	nfq_wf->stats.rx_buf_allocs++;
 
-	iov.iov_len = 2000;
-	pkt = Ipv4TcpPkt_new(iov.iov_len);
+	rx->pins = 0;
+	rx->in_ring = true;
+	nfq_wf->recv_bufs[i]->in_ring = false;
+	nfq_wf->recv_bufs[i] = rx;
+	nfq_wf->recv_iov[i].iov_base = rx->data;
+}
+
+/**
+* Handle one NF_QUEUE packet message.
+* Each message gets its own packet object and verdict.
+*/
+static int __NfQueue_process_queue_msg(struct NfQueue* nfq_wf, struct nlmsghdr *hdr)
+{
+	struct Ipv4TcpPkt *pkt;
+	int err;
 
-	// 	iov.iov_len = getpagesize();
-	iov.iov_base = buf = pkt->nl_buffer;
+	// packet data points into the receive buffer, which is owned by the receive batch
+	pkt = Ipv4TcpPkt_new(nfq_wf->pkt_pool, 0);
+	if (!pkt) {
+		ERROR_FATAL("No memory\n");
+	}
 
-	//TODO OPTIMIZE look into new kernel recvmmsg() to reduce system calls
-	n = recvmsg(nl_socket_get_fd(nfq_wf->nf_sock), &msg, 0);
+	nfq_wf->stats.recv_pkts++;
 
-	if (n <= 0) {
-		Ipv4TcpPkt_del(&pkt);
-		return n;
+	pkt->verify_cksum = nfq_wf->verify_checksums;
+	err = Ipv4TcpPkt_parseNlHdrMsg(pkt, hdr);
+	if (err) {
+		ERROR("packet parse error = %d\n", err);
+	} else {
+		__NfQueue_check_packet_id(nfq_wf, pkt);
+		if (pkt->skb_info & NFQA_SKB_GSO) {
+			nfq_wf->stats.gso_pkts++;
+			nfq_wf->stats.gso_bytes += pkt->ip_packet_length;
+		}
+		if (nfq_wf->overloaded) {
+			__NfQueue_overload_pkt(nfq_wf, pkt);
+		} else {
+			err = __NfQueue_process_pkt(nfq_wf, pkt);
+			DBG(3, "__NfQueue_process_pkt= %d\n", err);
+			if (err == 1)
+				return 0; // held by its connection
+		}
 	}
 
-	DBG(3, "Read %d bytes\n", n);
+	Ipv4TcpPkt_del(&pkt);
+	return err;
+}
+
+/**
+* Parse every netlink message in one received buffer
+* @return 1 if a multipart message is not yet complete
+*/
+static int __NfQueue_process_buf(struct NfQueue* nfq_wf, unsigned char *buf, int n)
+{
+	int multipart = 0;
+	struct nlmsghdr *hdr;
+	int pkt_counter;
 
+	DBG(3, "Read %d bytes\n", n);
 	hdr = (struct nlmsghdr *) buf;
 	for(pkt_counter = 0; nlmsg_ok(hdr, n); pkt_counter++) {
 		DBG(3, "Processing valid message... hdr=%p buf=%p n=%d\n", hdr, buf, n);
@@ -565,61 +1453,194 @@ static int __NfQueue_recv_pkt(struct NfQueue* nfq_wf)
 				* effect on this.  */
 				DBG(3, "recvmsgs VALID\n");
 
-				if (NFNL_SUBSYS_ID(hdr->nlmsg_type) != NFNL_SUBSYS_QUEUE) {
-					DBG(1, "WARNING NOT QUEUE MESSAGE\n");
-				}
-
-				DBG(3, "q_id=%d family=%d\n",nfnlmsg_res_id(hdr), nfnlmsg_family(hdr));
-				err = Ipv4TcpPkt_parseNlHdrMsg(pkt, hdr);
-				if (err) {
-					ERROR("packet parse error = %d\n", err);
+				if (NFNL_SUBSYS_ID(hdr->nlmsg_type) != NFNL_SUBSYS_QUEUE
+					|| NFNL_MSG_TYPE(hdr->nlmsg_type) != NFQNL_MSG_PACKET) {
+					DBG(1, "WARNING NOT QUEUE PACKET MESSAGE type=0x%x\n",
+						hdr->nlmsg_type);
 				} else {
-					__NfQueue_check_packet_id(nfq_wf, pkt);
-					err = __NfQueue_process_pkt(nfq_wf, pkt);
-					DBG(3, "__NfQueue_process_pkt= %d\n", err);
+					DBG(3, "q_id=%d family=%d\n",nfnlmsg_res_id(hdr), nfnlmsg_family(hdr));
+					__NfQueue_process_queue_msg(nfq_wf, hdr);
 				}
-
-
 			}
 
-		err = 0;
 		hdr = nlmsg_next(hdr, &n);
 	}
 
-	Ipv4TcpPkt_del(&pkt);
-	if (pkt_counter > 1) {
-		//NOTE if this occurs Now this is note handled properly
-		printf("Multiple messages processed %d\n", pkt_counter);
-		abort();
-	}
+	DBG(3, "Processed %d messages in buffer\n", pkt_counter);
+	return multipart;
+}
+
+/**
+* A queue message did not fit in the receive buffer.
+* The packet header comes before the payload, so the packet id arrived
+* and the packet still gets a verdict, without being filtered.
+*/
+static void __NfQueue_truncated_msg(struct NfQueue* nfq_wf, unsigned char *buf, unsigned int len)
+{
+	struct nlmsghdr *hdr = (struct nlmsghdr *) buf;
+	struct NfQueuePktMsg msg;
+	struct NfQueueVerdict v = {
+		.verdict = nfq_wf->overload_accept ? NF_ACCEPT : NF_DROP
+	};
+
+	nfq_wf->stats.recv_truncated++;
+
+	if (len < NLMSG_HDRLEN)
+		return;
+	hdr->nlmsg_len = len;
+	if (NfQueueMsg_parsePkt(hdr, &msg))
+		return;
+
+	WARN("Queue %d packet_id=%u truncated to %u bytes, verdict=%u\n",
+		nfq_wf->q_id, msg.packet_id, len, v.verdict);
+
+	v.packet_id = msg.packet_id;
+	__NfQueue_flush_verdicts(nfq_wf);
+	NfQueueMsgTx_addVerdict(&nfq_wf->tx, &v);
+	nfq_wf->last_packet_id = msg.packet_id;
+}
+
+static int __NfQueue_recv_pkt(struct NfQueue* nfq_wf)
+{
+	int fd = nl_socket_get_fd(nfq_wf->nf_sock);
+	int i, n, multipart;
+
+	do {
+		multipart = 0;
+
+		n = recvmmsg(fd, nfq_wf->recv_msgs, nfq_wf->recv_batch, MSG_DONTWAIT, NULL);
+		if (n <= 0) {
+			if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+				DBG(1, "recvmmsg q_id=%d errno=%d %m\n", nfq_wf->q_id, errno);
+				return -errno;
+			}
+			return 0;
+		}
+
+		nfq_wf->stats.recv_calls++;
+		nfq_wf->stats.recv_msgs += n;
+		/* a full batch means more is waiting, the queue is falling
+		behind once that goes on for overload_backlog messages */
+		if (n == nfq_wf->recv_batch) {
+			nfq_wf->stats.recv_full++;
+			nfq_wf->backlog += n;
+			if (nfq_wf->overload_backlog && nfq_wf->backlog >= nfq_wf->overload_backlog)
+				__NfQueue_enter_overload(nfq_wf, "receive backlog");
+		} else {
+			nfq_wf->backlog = 0;
+			if (nfq_wf->overloaded
+				&& time(NULL) - nfq_wf->overload_start >= NFQ_OVERLOAD_MIN_TIME)
+				__NfQueue_leave_overload(nfq_wf);
+		}
+
+		DBG(3, "recvmmsg q_id=%d got %d messages\n", nfq_wf->q_id, n);
+
+		/* process in the order the kernel queued them */
+		for (i = 0; i < n; i++) {
+			if (nfq_wf->recv_msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+				__NfQueue_truncated_msg(nfq_wf, nfq_wf->recv_iov[i].iov_base,
+					nfq_wf->recv_msgs[i].msg_len);
+				continue;
+			}
+			nfq_wf->cur_rx = nfq_wf->recv_bufs[i];
+			multipart |= __NfQueue_process_buf(nfq_wf, nfq_wf->recv_iov[i].iov_base,
+				nfq_wf->recv_msgs[i].msg_len);
 
-// 	if (buf)
-// 		free(buf);
-// 	buf = NULL;
+			// held packets point into it, do not receive over them
+			if (nfq_wf->recv_bufs[i]->pins)
+				__rx_buf_replace(nfq_wf, i);
+		}
+
+		/* end of batch, release the coalesced ACCEPTs and
+		send every verdict of this batch in one go */
+		__NfQueue_flush_verdicts(nfq_wf);
+		NfQueueMsgTx_flush(&nfq_wf->tx);
 
-	if (multipart) {
 		/* Multipart message not yet complete, continue reading */
-		goto continue_reading;
+	} while (multipart);
+
+	return 0;
+}
+
+/** netlink socket readable */
+static void __NfQueue_nf_sock_cb(struct NfQueue* nfq_wf, int fd, uint32_t events, void *arg)
+{
+	DBG(5, " nf_sock fd %d set\n", fd);
+	__NfQueue_recv_pkt(nfq_wf);
+}
+
+/** housekeeping timer expired */
+static void __NfQueue_timer_cb(struct NfQueue* nfq_wf, int fd, uint32_t events, void *arg)
+{
+	uint64_t expirations;
+
+	if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+		return;
+
+	DBG(5, " Timer. Cleaning old connections q_id=%d\n", nfq_wf->q_id);
+	nfq_wf->stats.housekeeping_runs++;
+	__httpConnList_expire(nfq_wf);
+}
+
+/** woken by NfQueue_stop() or NfQueue_updateConfig() */
+static void __NfQueue_event_cb(struct NfQueue* nfq_wf, int fd, uint32_t events, void *arg)
+{
+	uint64_t count;
+
+	if (read(fd, &count, sizeof(count)) != sizeof(count))
+		return;
+
+	DBG(1, " event fd %d set keep_running=%d q_id=%d\n", fd,
+		nfq_wf->keep_running, nfq_wf->q_id);
+
+	pthread_mutex_lock(&nfq_wf->config_mutex);
+	if (nfq_wf->config_changed) {
+		nfq_wf->config_changed = false;
+		__NfQueue_load_limits(nfq_wf);
+		__NfQueue_config_queue(nfq_wf);
+		if (nfq_wf->overloaded && !nfq_wf->overload_accept)
+			__NfQueue_leave_overload(nfq_wf);
+		DBG(1, " q_id=%d using new config\n", nfq_wf->q_id);
 	}
-	// 	stop:
-	err = 0;
-	// 	out:
-// 	free(buf);
+	pthread_mutex_unlock(&nfq_wf->config_mutex);
+}
 
-	return err;
+/** wake the thread out of epoll_wait() */
+static void __NfQueue_wake(struct NfQueue* nfq_wf)
+{
+	uint64_t one = 1;
+	int ret;
+
+	ret = write(nfq_wf->event_fd, &one, sizeof(one));
+	if (ret < 0) {
+		DBG(1," error writing to event_fd=%d\n", nfq_wf->event_fd);
+	}
+}
 
+static int __NfQueue_start_timer(struct NfQueue* nfq_wf)
+{
+	struct itimerspec its = {
+		.it_interval = { .tv_sec = NFQ_HOUSEKEEPING_INTERVAL, .tv_nsec = 0 },
+		.it_value = { .tv_sec = NFQ_HOUSEKEEPING_INTERVAL, .tv_nsec = 0 },
+	};
+
+	nfq_wf->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (nfq_wf->timer_fd < 0)
+		return -errno;
+
+	if (timerfd_settime(nfq_wf->timer_fd, 0, &its, NULL))
+		return -errno;
 
+	return NfQueue_addFd(nfq_wf, nfq_wf->timer_fd, EPOLLIN, __NfQueue_timer_cb, NULL);
 }
 
 static void* __NfQueue_main(void *arg)
 {
 	struct NfQueue* nfq_wf = arg;
-	fd_set rfds;
-	int fd, retval;
+	struct epoll_event events[NFQ_MAX_EVENTS];
+	struct NfQueue_fd_handler *h;
+	int i, n;
 	int err;
-	int max_fd;
-	struct timeval timeout  = { .tv_sec = 120, .tv_usec = 0 };
-	int timeout_pkt_count = 0;
 
 	DBG(5, " thread main startup %p q=%d\n", nfq_wf, nfq_wf->q_id);
 // 	nl_socket_modify_cb(nfq_wf->nf_sock, NL_CB_VALID, NL_CB_CUSTOM, __event_input, nfq_wf);
@@ -637,7 +1658,7 @@ static void* __NfQueue_main(void *arg)
 	}
 	nfq_wf->nl_queue = nfnl_queue_alloc();
 	nfnl_queue_set_group(nfq_wf->nl_queue, nfq_wf->q_id);
-	nfnl_queue_set_maxlen(nfq_wf->nl_queue, 5000);
+	nfnl_queue_set_maxlen(nfq_wf->nl_queue, nfq_wf->queue_maxlen);
 	nfnl_queue_set_copy_mode(nfq_wf->nl_queue, NFNL_QUEUE_COPY_PACKET);
 
 	nfnl_queue_set_copy_range(nfq_wf->nl_queue, 0xFFFF);
@@ -646,55 +1667,226 @@ static void* __NfQueue_main(void *arg)
 		ERROR_FATAL("Unable to bind queue: %d %s", err, nl_geterror(err));
 	}
 
-	max_fd = fd = nl_socket_get_fd(nfq_wf->nf_sock);
+	// from here on libnl is only used for the socket, verdicts are built in tree
+	if (NfQueueMsgTx_init(&nfq_wf->tx, nl_socket_get_fd(nfq_wf->nf_sock),
+			nfq_wf->q_id, NFQ_SEND_BUF_SIZE)) {
+		ERROR_FATAL("Unable to allocate verdict send buffer\n");
+	}
+
+	// libnl has no queue flags, fail open and gso are set here
+	__NfQueue_config_queue(nfq_wf);
+	NfQueueMsgTx_flush(&nfq_wf->tx);
+
+	if (__NfQueue_alloc_recv_batch(nfq_wf)) {
+		ERROR_FATAL("Unable to allocate receive batch of %u\n", nfq_wf->recv_batch);
+	}
+
+	nfq_wf->pkt_pool = Ipv4TcpPktPool_new(nfq_wf->pkt_pool_size);
+	if (!nfq_wf->pkt_pool) {
+		ERROR_FATAL("Unable to allocate packet pool of %u\n", nfq_wf->pkt_pool_size);
+	}
 
 	// NOTE not sure if we can make this bigger, or if we should
 	nl_socket_set_buffer_size(nfq_wf->nf_sock, 1024*127, 1024*127);
 
-	if (nfq_wf->exit_pipe[0] > fd)
-		max_fd = nfq_wf->exit_pipe[0];
+	if (NfQueue_addFd(nfq_wf, nl_socket_get_fd(nfq_wf->nf_sock), EPOLLIN,
+			__NfQueue_nf_sock_cb, NULL)
+		|| NfQueue_addFd(nfq_wf, nfq_wf->event_fd, EPOLLIN, __NfQueue_event_cb, NULL)
+		|| __NfQueue_start_timer(nfq_wf)) {
+		ERROR_FATAL("Unable to set up event loop q_id=%d\n", nfq_wf->q_id);
+	}
 
 	while (nfq_wf->keep_running) {
 		DBG(5, " running thread main loop %p q=%d\n", nfq_wf, nfq_wf->q_id);
 
-		FD_ZERO(&rfds);
+		n = epoll_wait(nfq_wf->epoll_fd, events, NFQ_MAX_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			ERROR("epoll_wait q_id=%d errno=%d %m\n", nfq_wf->q_id, errno);
+			break;
+		}
 
-		FD_SET(fd, &rfds);
-		FD_SET(nfq_wf->exit_pipe[0], &rfds);
+		for (i = 0; i < n; i++) {
+			h = events[i].data.ptr;
+			// skip handlers removed by an earlier callback of this batch
+			if (h->fd >= 0)
+				h->cb(nfq_wf, h->fd, events[i].events, h->arg);
+		}
 
-		/* wait for an incoming message on the netlink socket */
-		retval = select(max_fd + 1, &rfds, NULL, NULL, &timeout);
+		while ((h = (struct NfQueue_fd_handler *) ubi_dlRemHead(&nfq_wf->dead_fd_handlers)))
+			free(h);
 
-		if (retval > 0) {
-			if (FD_ISSET(fd, &rfds)) {
-				DBG(5, " nf_sock fd %d set\n", fd);
-// 				nl_recvmsgs_default(nfq_wf->nf_sock);
-				__NfQueue_recv_pkt(nfq_wf);
-			}
+		// verdicts queued by timers or other fds
+		NfQueueMsgTx_flush(&nfq_wf->tx);
+	}
 
-			if (FD_ISSET(nfq_wf->exit_pipe[0], &rfds)) {
-				DBG(1," exit pipe %d set\n", nfq_wf->exit_pipe[0]);
-			}
-			timeout.tv_sec = 60;
-			timeout.tv_usec = 0;
-			timeout_pkt_count++;
-		} else if (retval == 0) {
-			DBG(5, " Timeout. Cleaning old connections\n");
-			__httpConnList_expire(nfq_wf);
-			timeout.tv_sec = 240;
-			timeout.tv_usec = 0;
-			timeout_pkt_count = 0;
-		}
+	if (DEBUG_LEVEL > 0)
+		NfQueue_printStats(nfq_wf, stderr);
 
-		// after 12345 packets processed force timeout check to free memory under heavy load
-		if (timeout_pkt_count > 12345) {
-			DBG(5, " Force expired connection check. Cleaning old connections\n");
-			__httpConnList_expire(nfq_wf);
-			timeout_pkt_count = 0;
-		}
+	return NULL;
+}
+
+/**
+* Watch another file descriptor from the queue thread.
+* The callback runs in the queue thread, so it may touch connections and
+* queue verdicts without locking. Call from the queue thread or before NfQueue_start().
+* @arg nfq_wf  queue object
+* @arg fd      file descriptor
+* @arg events  epoll events, e.g. EPOLLIN
+* @arg cb      called when fd is ready
+* @arg arg     passed to cb
+* @return 0 or -errno
+*/
+int NfQueue_addFd(struct NfQueue *nfq_wf, int fd, uint32_t events,
+	NfQueue_fd_cb cb, void *arg)
+{
+	struct NfQueue_fd_handler *h;
+	struct epoll_event ev;
+
+	h = calloc(1, sizeof(struct NfQueue_fd_handler));
+	if (!h)
+		return -ENOMEM;
+
+	h->fd = fd;
+	h->cb = cb;
+	h->arg = arg;
+
+	ev.events = events;
+	ev.data.ptr = h;
+	if (epoll_ctl(nfq_wf->epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+		free(h);
+		return -errno;
 	}
 
-	return NULL;
+	ubi_dlAddTail(&nfq_wf->fd_handlers, h);
+	return 0;
+}
+
+/**
+* Stop watching a file descriptor added with NfQueue_addFd().
+* Does not close fd. Call from the queue thread or before NfQueue_start().
+* @return 0 or -ENOENT
+*/
+int NfQueue_delFd(struct NfQueue *nfq_wf, int fd)
+{
+	struct NfQueue_fd_handler *h;
+
+	for (h = (struct NfQueue_fd_handler *) ubi_dlFirst(&nfq_wf->fd_handlers);
+		h; h = (struct NfQueue_fd_handler *) ubi_dlNext(h)) {
+		if (h->fd == fd)
+			break;
+	}
+
+	if (!h)
+		return -ENOENT;
+
+	epoll_ctl(nfq_wf->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+	ubi_dlRemThis(&nfq_wf->fd_handlers, h);
+
+	// events for it may still be pending in this epoll_wait() batch
+	h->fd = -1;
+	ubi_dlAddTail(&nfq_wf->dead_fd_handlers, h);
+	return 0;
+}
+
+/**
+* Set how many netlink messages are read per recvmmsg() call.
+* Only has effect before NfQueue_start()
+* @arg nfq_wf  queue object
+* @arg batch   number of messages. 1 disables batching
+*/
+void NfQueue_setRecvBatch(struct NfQueue *nfq_wf, unsigned int batch)
+{
+	if (batch < 1)
+		batch = 1;
+	else if (batch > NFQ_MAX_RECV_BATCH)
+		batch = NFQ_MAX_RECV_BATCH;
+
+	nfq_wf->recv_batch = batch;
+}
+
+/**
+* Print queue counters
+* @arg nfq_wf  queue object
+* @arg stream  where to print
+*/
+void NfQueue_printStats(struct NfQueue *nfq_wf, FILE *stream)
+{
+	struct NfQueue_stats *st = &nfq_wf->stats;
+
+	fprintf(stream, "q_id=%d recv_batch=%u recv_calls=%llu recv_msgs=%llu "
+		"recv_full=%llu avg_batch_fill=%.2f\n",
+		nfq_wf->q_id, nfq_wf->recv_batch,
+		(unsigned long long) st->recv_calls,
+		(unsigned long long) st->recv_msgs,
+		(unsigned long long) st->recv_full,
+		st->recv_calls ? (double) st->recv_msgs / st->recv_calls : 0.0);
+	fprintf(stream, "q_id=%d recv_pkts=%llu pkts_per_msg=%.2f\n",
+		nfq_wf->q_id, (unsigned long long) st->recv_pkts,
+		st->recv_msgs ? (double) st->recv_pkts / st->recv_msgs : 0.0);
+	fprintf(stream, "q_id=%d verdict_msgs=%llu verdict_batches=%llu verdict_batched=%llu\n",
+		nfq_wf->q_id,
+		(unsigned long long) st->verdict_msgs,
+		(unsigned long long) st->verdict_batches,
+		(unsigned long long) st->verdict_batched);
+	fprintf(stream, "q_id=%d verdict_sends=%llu verdict_nlmsgs=%llu verdict_send_errors=%llu\n",
+		nfq_wf->q_id,
+		(unsigned long long) nfq_wf->tx.sends,
+		(unsigned long long) nfq_wf->tx.msgs,
+		(unsigned long long) nfq_wf->tx.errors);
+	fprintf(stream, "q_id=%d connections=%lu housekeeping_runs=%llu con_expired=%llu "
+		"con_timer_rearm=%llu\n",
+		nfq_wf->q_id, ubi_dlCount(nfq_wf->con_list),
+		(unsigned long long) st->housekeeping_runs,
+		(unsigned long long) st->con_expired,
+		(unsigned long long) st->con_timer_rearm);
+	fprintf(stream, "q_id=%d buffered_bytes=%llu con_evicted=%llu con_evicted_bytes=%llu "
+		"con_evicted_held=%llu retired_pkts=%llu con_trusted=%llu trusted_pkts=%llu\n",
+		nfq_wf->q_id, (unsigned long long) nfq_wf->buffered_bytes,
+		(unsigned long long) st->con_evicted,
+		(unsigned long long) st->con_evicted_bytes,
+		(unsigned long long) st->con_evicted_held,
+		(unsigned long long) st->retired_pkts,
+		(unsigned long long) st->con_trusted,
+		(unsigned long long) st->trusted_pkts);
+	fprintf(stream, "q_id=%d syn_accepted=%llu syn_rejected=%llu syn_reaccepted=%llu "
+		"non_http_offloaded=%llu non_http_offloaded_bytes=%llu\n",
+		nfq_wf->q_id,
+		(unsigned long long) st->syn_accepted,
+		(unsigned long long) st->syn_rejected,
+		(unsigned long long) st->syn_reaccepted,
+		(unsigned long long) st->non_http_offloaded,
+		(unsigned long long) st->non_http_offloaded_bytes);
+	fprintf(stream, "q_id=%d held=%u held_pkts=%llu hold_timeouts=%llu rx_buf_allocs=%llu\n",
+		nfq_wf->q_id, nfq_wf->held_pkts,
+		(unsigned long long) st->held_pkts,
+		(unsigned long long) st->hold_timeouts,
+		(unsigned long long) st->rx_buf_allocs);
+	fprintf(stream, "q_id=%d gso=%d gso_pkts=%llu gso_bytes=%llu recv_truncated=%llu\n",
+		nfq_wf->q_id, nfq_wf->gso,
+		(unsigned long long) st->gso_pkts,
+		(unsigned long long) st->gso_bytes,
+		(unsigned long long) st->recv_truncated);
+	fprintf(stream, "q_id=%d overloaded=%d lost_pkts=%llu overloads=%llu overload_pkts=%llu "
+		"overload_cons=%llu unfiltered_pkts=%llu\n",
+		nfq_wf->q_id, nfq_wf->overloaded,
+		(unsigned long long) st->lost_pkts,
+		(unsigned long long) st->overloads,
+		(unsigned long long) st->overload_pkts,
+		(unsigned long long) st->overload_cons,
+		(unsigned long long) st->unfiltered_pkts);
+	fprintf(stream, "q_id=%d ", nfq_wf->q_id);
+	HttpConnMemo_printStats(nfq_wf->retired, "retired", stream);
+	fprintf(stream, "q_id=%d ", nfq_wf->q_id);
+	HttpConnTable_printStats(nfq_wf->con_table, stream);
+	if (nfq_wf->pkt_pool) {
+		fprintf(stream, "q_id=%d ", nfq_wf->q_id);
+		Ipv4TcpPktPool_printStats(nfq_wf->pkt_pool, stream);
+	}
+	HttpConnCtx_printStats(&nfq_wf->con_ctx, stream);
+	if (nfq_wf->rx_slab)
+		Slab_printStats(nfq_wf->rx_slab, stream);
 }
 
 /**
@@ -705,16 +1897,14 @@ static void* __NfQueue_main(void *arg)
 struct NfQueue* NfQueue_new(int q_id, struct WfConfig *conf)
 {
 	struct NfQueue *nfq_wf = NfQueue_alloc(&obj_ops);
-	int ret;
 
 	nfq_wf->q_id = q_id;
 	WfConfig_get(conf);
 	nfq_wf->config = conf;
-
-	ret = pipe(nfq_wf->exit_pipe);
-	if (ret) {
-		DBG(1," Error opening pipe %d\n", ret);
-	}
+	NfQueue_setRecvBatch(nfq_wf, WfConfig_getRecvBatch(conf));
+	nfq_wf->pkt_pool_size = WfConfig_getPktPoolSize(conf);
+	nfq_wf->gso = WfConfig_getGso(conf);
+	__NfQueue_load_limits(nfq_wf);
 
 	return nfq_wf;
 }
@@ -742,15 +1932,8 @@ int NfQueue_start(struct NfQueue* nfq_wf)
 */
 int NfQueue_stop(struct NfQueue* nfq_wf)
 {
-	int ret = 0xFEEDF00D;
-
 	nfq_wf->keep_running = false;
-	ret = write(nfq_wf->exit_pipe[1], &ret, sizeof(ret));
-	if (ret < 0) {
-		DBG(1," error writing to exit_pipe[1]=%d\n", nfq_wf->exit_pipe[1]);
-	} else if (ret > 0) {
-		DBG(1," wrote %d bytes to exit_pipe[1]=%d\n",ret, nfq_wf->exit_pipe[1]);
-	}
+	__NfQueue_wake(nfq_wf);
 	return 0;
 }
 
@@ -774,9 +1957,12 @@ int NfQueue_updateConfig(struct NfQueue *nfq_wf, struct WfConfig *new_config)
 	WfConfig_get(new_config);
 
 	nfq_wf->config = new_config;
+	nfq_wf->config_changed = true;
 
 	WfConfig_put(&old_config);
 	pthread_mutex_unlock(&nfq_wf->config_mutex);
+
+	__NfQueue_wake(nfq_wf);
 	return 0;
 }
 /** @} */
@@ -23,10 +23,15 @@ THE SOFTWARE.
 #ifndef NFQUEUE_H
 #define NFQUEUE_H 1
 
+#include <stdio.h>
+#include <stdint.h>
 
 struct WfConfig;
 struct NfQueue;
 
+/** Called from the queue thread when a watched fd is ready */
+typedef void (*NfQueue_fd_cb)(struct NfQueue *nfq_wf, int fd, uint32_t events, void *arg);
+
 void NfQueue_put(struct NfQueue **nfq_wf);
 
 struct NfQueue* NfQueue_new(int q_id, struct WfConfig *config);
@@ -39,4 +44,13 @@ int NfQueue_stop(struct NfQueue* nfq_wf);
 
 int NfQueue_join(struct NfQueue* nfq_wf);
 
+void NfQueue_setRecvBatch(struct NfQueue *nfq_wf, unsigned int batch);
+
+void NfQueue_printStats(struct NfQueue *nfq_wf, FILE *stream);
+
+int NfQueue_addFd(struct NfQueue *nfq_wf, int fd, uint32_t events,
+	NfQueue_fd_cb cb, void *arg);
+
+int NfQueue_delFd(struct NfQueue *nfq_wf, int fd);
+
 #endif
@@ -0,0 +1,383 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nfnetlink.h>
+
+/*note this check for older kernels */
+#ifndef aligned_be64
+#define aligned_be64 u_int64_t __attribute__((aligned(8)))
+#endif
+
+#include <linux/netfilter/nfnetlink_queue.h>
+#include <linux/netfilter/nfnetlink_conntrack.h>
+
+#include "NfQueueMsg.h"
+#include "nfq_wf_private.h"
+
+/**
+* @ingroup NfQueueMsg
+* @{
+*/
+
+static inline uint32_t __attr_u32(const struct nlattr *attr)
+{
+	uint32_t val;
+
+	memcpy(&val, (const uint8_t *) attr + NLA_HDRLEN, sizeof(val));
+	return ntohl(val);
+}
+
+/**
+* Decode a NFQNL_MSG_PACKET
+* @arg nlh  message as received from the kernel
+* @arg msg  where to store the attributes
+* @return 0 or -EINVAL if the message is truncated or has no packet header
+*/
+int NfQueueMsg_parsePkt(const struct nlmsghdr *nlh, struct NfQueuePktMsg *msg)
+{
+	const struct nfgenmsg *nfg;
+	const struct nlattr *attr;
+	const struct nfqnl_msg_packet_hdr *pkt_hdr;
+	unsigned int attr_len;
+	int rem;
+	bool have_hdr = false;
+
+	if (nlh->nlmsg_len < NLMSG_SPACE(sizeof(struct nfgenmsg)))
+		return -EINVAL;
+
+	memset(msg, 0, sizeof(struct NfQueuePktMsg));
+
+	nfg = NLMSG_DATA(nlh);
+	msg->q_id = ntohs(nfg->res_id);
+
+	attr = (const struct nlattr *) ((const uint8_t *) nfg + NLMSG_ALIGN(sizeof(struct nfgenmsg)));
+	rem = nlh->nlmsg_len - NLMSG_SPACE(sizeof(struct nfgenmsg));
+
+	while (rem >= (int) sizeof(struct nlattr)
+		&& attr->nla_len >= sizeof(struct nlattr)
+		&& attr->nla_len <= rem) {
+
+		attr_len = attr->nla_len - NLA_HDRLEN;
+
+		switch (attr->nla_type & NLA_TYPE_MASK) {
+		case NFQA_PACKET_HDR:
+			if (attr_len < sizeof(struct nfqnl_msg_packet_hdr))
+				return -EINVAL;
+			pkt_hdr = (const struct nfqnl_msg_packet_hdr *) ((const uint8_t *) attr + NLA_HDRLEN);
+			msg->packet_id = ntohl(pkt_hdr->packet_id);
+			msg->hw_protocol = pkt_hdr->hw_protocol;
+			msg->hook = pkt_hdr->hook;
+			have_hdr = true;
+			break;
+		case NFQA_MARK:
+			if (attr_len < sizeof(uint32_t))
+				return -EINVAL;
+			msg->mark = __attr_u32(attr);
+			msg->has_mark = true;
+			break;
+		case NFQA_IFINDEX_INDEV:
+			if (attr_len < sizeof(uint32_t))
+				return -EINVAL;
+			msg->indev = __attr_u32(attr);
+			break;
+		case NFQA_IFINDEX_OUTDEV:
+			if (attr_len < sizeof(uint32_t))
+				return -EINVAL;
+			msg->outdev = __attr_u32(attr);
+			break;
+		case NFQA_SKB_INFO:
+			if (attr_len < sizeof(uint32_t))
+				return -EINVAL;
+			msg->skb_info = __attr_u32(attr);
+			break;
+		case NFQA_PAYLOAD:
+			msg->payload = (uint8_t *) attr + NLA_HDRLEN;
+			msg->payload_len = attr_len;
+			break;
+		default:
+			break;
+		}
+
+		rem -= NLA_ALIGN(attr->nla_len);
+		attr = (const struct nlattr *) ((const uint8_t *) attr + NLA_ALIGN(attr->nla_len));
+	}
+
+	if (!have_hdr)
+		return -EINVAL;
+
+	DBG(5, "q_id=%hu packet_id=%u hook=%hhu mark=0x%x payload_len=%u\n",
+		msg->q_id, msg->packet_id, msg->hook, msg->mark, msg->payload_len);
+	return 0;
+}
+
+/**
+* Initialize a send buffer
+* @arg tx    send buffer
+* @arg fd    netlink socket, already bound
+* @arg q_id  queue the verdicts are for
+* @arg size  bytes to allocate. Must hold a verdict with a full size payload
+*/
+int NfQueueMsgTx_init(struct NfQueueMsgTx *tx, int fd, uint16_t q_id, size_t size)
+{
+	memset(tx, 0, sizeof(struct NfQueueMsgTx));
+	tx->buf = malloc(size);
+	if (!tx->buf)
+		return -ENOMEM;
+
+	tx->fd = fd;
+	tx->q_id = q_id;
+	tx->size = size;
+	return 0;
+}
+
+void NfQueueMsgTx_free(struct NfQueueMsgTx *tx)
+{
+	free(tx->buf);
+	tx->buf = NULL;
+	tx->size = tx->len = 0;
+}
+
+/**
+* Start a nfnetlink queue message at the end of the buffer.
+* Caller has checked there is room
+*/
+static struct nlmsghdr *__begin_msg(struct NfQueueMsgTx *tx, uint16_t msg_type)
+{
+	struct nlmsghdr *nlh = (struct nlmsghdr *) &tx->buf[tx->len];
+	struct nfgenmsg *nfg;
+
+	nlh->nlmsg_type = (NFNL_SUBSYS_QUEUE << 8) | msg_type;
+	nlh->nlmsg_flags = NLM_F_REQUEST;
+	nlh->nlmsg_seq = ++tx->seq;
+	nlh->nlmsg_pid = 0;
+	tx->len += NLMSG_HDRLEN;
+
+	nfg = (struct nfgenmsg *) &tx->buf[tx->len];
+	nfg->nfgen_family = AF_UNSPEC;
+	nfg->version = NFNETLINK_V0;
+	nfg->res_id = htons(tx->q_id);
+	tx->len += NLMSG_ALIGN(sizeof(struct nfgenmsg));
+
+	return nlh;
+}
+
+static void __put_attr(struct NfQueueMsgTx *tx, uint16_t type, const void *data, unsigned int len)
+{
+	struct nlattr *attr = (struct nlattr *) &tx->buf[tx->len];
+	unsigned int pad = NLA_ALIGN(NLA_HDRLEN + len) - (NLA_HDRLEN + len);
+
+	attr->nla_type = type;
+	attr->nla_len = NLA_HDRLEN + len;
+	memcpy((uint8_t *) attr + NLA_HDRLEN, data, len);
+	if (pad)
+		memset((uint8_t *) attr + NLA_HDRLEN + len, 0, pad);
+
+	tx->len += NLA_ALIGN(NLA_HDRLEN + len);
+}
+
+/** open a nested attribute, close it with __end_nest() */
+static struct nlattr *__begin_nest(struct NfQueueMsgTx *tx, uint16_t type)
+{
+	struct nlattr *attr = (struct nlattr *) &tx->buf[tx->len];
+
+	attr->nla_type = type | NLA_F_NESTED;
+	tx->len += NLA_HDRLEN;
+	return attr;
+}
+
+static void __end_nest(struct NfQueueMsgTx *tx, struct nlattr *attr)
+{
+	attr->nla_len = &tx->buf[tx->len] - (uint8_t *) attr;
+}
+
+static void __end_msg(struct NfQueueMsgTx *tx, struct nlmsghdr *nlh)
+{
+	nlh->nlmsg_len = &tx->buf[tx->len] - (uint8_t *) nlh;
+	tx->pending++;
+}
+
+static void __put_verdict_hdr(struct NfQueueMsgTx *tx, uint32_t packet_id, uint32_t verdict)
+{
+	struct nfqnl_msg_verdict_hdr vh;
+
+	vh.verdict = htonl(verdict);
+	vh.id = htonl(packet_id);
+	__put_attr(tx, NFQA_VERDICT_HDR, &vh, sizeof(vh));
+}
+
+/** make room for a message of len bytes, sending what is pending if needed */
+static int __reserve(struct NfQueueMsgTx *tx, size_t len)
+{
+	if (len > tx->size)
+		return -EMSGSIZE;
+
+	if (tx->len + len > tx->size)
+		return NfQueueMsgTx_flush(tx);
+
+	return 0;
+}
+
+/**
+* Queue a NFQNL_MSG_VERDICT for one packet
+*/
+int NfQueueMsgTx_addVerdict(struct NfQueueMsgTx *tx, const struct NfQueueVerdict *v)
+{
+	struct nlmsghdr *nlh;
+	struct nlattr *nest;
+	size_t len;
+	uint32_t mark;
+
+	len = NLMSG_SPACE(sizeof(struct nfgenmsg))
+		+ NLA_ALIGN(NLA_HDRLEN + sizeof(struct nfqnl_msg_verdict_hdr))
+		+ NLA_ALIGN(NLA_HDRLEN + sizeof(uint32_t));
+	if (v->set_connmark)
+		len += NLA_HDRLEN + 2 * NLA_ALIGN(NLA_HDRLEN + sizeof(uint32_t));
+	if (v->payload)
+		len += NLA_ALIGN(NLA_HDRLEN + v->payload_len);
+
+	if (__reserve(tx, len) == -EMSGSIZE) {
+		ERROR("verdict of %zu bytes does not fit in send buffer\n", len);
+		return -EMSGSIZE;
+	}
+
+	nlh = __begin_msg(tx, NFQNL_MSG_VERDICT);
+	__put_verdict_hdr(tx, v->packet_id, v->verdict);
+
+	if (v->set_mark) {
+		mark = htonl(v->mark);
+		__put_attr(tx, NFQA_MARK, &mark, sizeof(mark));
+	}
+
+	/* the kernel hands NFQA_CT to ctnetlink, which sets
+	 (ct->mark & ~mask) ^ mark on the packet's conntrack entry */
+	if (v->set_connmark) {
+		nest = __begin_nest(tx, NFQA_CT);
+		mark = htonl(v->connmark & v->connmark_mask);
+		__put_attr(tx, CTA_MARK, &mark, sizeof(mark));
+		mark = htonl(v->connmark_mask);
+		__put_attr(tx, CTA_MARK_MASK, &mark, sizeof(mark));
+		__end_nest(tx, nest);
+	}
+
+	if (v->payload)
+		__put_attr(tx, NFQA_PAYLOAD, v->payload, v->payload_len);
+
+	__end_msg(tx, nlh);
+	return 0;
+}
+
+/**
+* Queue a NFQNL_MSG_VERDICT_BATCH.
+* The kernel applies verdict to every queued packet with an id up to packet_id.
+*/
+int NfQueueMsgTx_addVerdictBatch(struct NfQueueMsgTx *tx, uint32_t packet_id, uint32_t verdict)
+{
+	struct nlmsghdr *nlh;
+	size_t len;
+
+	len = NLMSG_SPACE(sizeof(struct nfgenmsg))
+		+ NLA_ALIGN(NLA_HDRLEN + sizeof(struct nfqnl_msg_verdict_hdr));
+
+	__reserve(tx, len);
+
+	nlh = __begin_msg(tx, NFQNL_MSG_VERDICT_BATCH);
+	__put_verdict_hdr(tx, packet_id, verdict);
+	__end_msg(tx, nlh);
+	return 0;
+}
+
+/**
+* Queue a NFQNL_MSG_CONFIG setting the queue length and flags.
+* @arg maxlen  packets the kernel keeps queued, 0 to leave it unchanged
+* @arg flags   NFQA_CFG_F_* bits to set, among those in mask
+* @arg mask    NFQA_CFG_F_* bits to change, 0 to leave the flags unchanged
+*/
+int NfQueueMsgTx_addConfig(struct NfQueueMsgTx *tx, uint32_t maxlen,
+	uint32_t flags, uint32_t mask)
+{
+	struct nlmsghdr *nlh;
+	size_t len;
+	uint32_t val;
+
+	len = NLMSG_SPACE(sizeof(struct nfgenmsg))
+		+ 3 * NLA_ALIGN(NLA_HDRLEN + sizeof(uint32_t));
+
+	__reserve(tx, len);
+
+	nlh = __begin_msg(tx, NFQNL_MSG_CONFIG);
+	if (maxlen) {
+		val = htonl(maxlen);
+		__put_attr(tx, NFQA_CFG_QUEUE_MAXLEN, &val, sizeof(val));
+	}
+	if (mask) {
+		val = htonl(flags & mask);
+		__put_attr(tx, NFQA_CFG_FLAGS, &val, sizeof(val));
+		val = htonl(mask);
+		__put_attr(tx, NFQA_CFG_MASK, &val, sizeof(val));
+	}
+	__end_msg(tx, nlh);
+	return 0;
+}
+
+/**
+* Send every pending message in one datagram
+* @return 0 or -errno
+*/
+int NfQueueMsgTx_flush(struct NfQueueMsgTx *tx)
+{
+	struct sockaddr_nl peer = { .nl_family = AF_NETLINK };
+	ssize_t ret;
+	int err = 0;
+
+	if (!tx->len)
+		return 0;
+
+	do {
+		ret = sendto(tx->fd, tx->buf, tx->len, 0,
+			(struct sockaddr *) &peer, sizeof(peer));
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0) {
+		err = -errno;
+		tx->errors++;
+		ERROR("q_id=%hu sending %u verdicts len=%zu errno=%d %m\n",
+			tx->q_id, tx->pending, tx->len, errno);
+	} else {
+		tx->sends++;
+		tx->msgs += tx->pending;
+	}
+
+	tx->len = 0;
+	tx->pending = 0;
+	return err;
+}
+
+/** @}  */
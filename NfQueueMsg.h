@@ -0,0 +1,105 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef NFQUEUEMSG_H
+#define NFQUEUEMSG_H 1
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <linux/netlink.h>
+
+/**
+* @defgroup NfQueueMsg NF_QUEUE netlink message codec
+* @brief Read packet messages and write verdicts straight from/to netlink buffers.
+*
+* libnl is only used to set up the queue. On the packet path we avoid
+* allocating and filling a nfnl_queue_msg per packet.
+* @{
+*/
+
+/**
+* Attributes of a NFQNL_MSG_PACKET that we use.
+* payload points into the receive buffer.
+*/
+struct NfQueuePktMsg {
+	uint16_t q_id;       /**< queue number, from nfgenmsg res_id */
+	uint32_t packet_id;
+	uint16_t hw_protocol; /**< network byte order */
+	uint8_t hook;
+	bool has_mark;
+	uint32_t mark;
+	uint32_t indev;
+	uint32_t outdev;
+	uint32_t skb_info;   /**< NFQA_SKB_* flags, 0 from kernels without NFQA_SKB_INFO */
+	uint8_t *payload;
+	unsigned int payload_len;
+};
+
+/**
+* One verdict to send
+*/
+struct NfQueueVerdict {
+	uint32_t packet_id;
+	uint32_t verdict; /**< NF_ACCEPT, NF_DROP ... */
+	bool set_mark; /**< send mark */
+	uint32_t mark;
+	/** set connmark bits under connmark_mask on the packet's conntrack
+	entry. Needs the nf_conntrack_netlink module */
+	bool set_connmark;
+	uint32_t connmark;
+	uint32_t connmark_mask;
+	const void *payload; /**< if not NULL replaces the packet */
+	unsigned int payload_len;
+};
+
+/**
+* Per queue send buffer.
+* Verdicts are appended as netlink messages and go to the kernel
+* together in one send() on NfQueueMsgTx_flush().
+*/
+struct NfQueueMsgTx {
+	int fd;         /**< netlink socket */
+	uint16_t q_id;
+	uint32_t seq;
+	uint8_t *buf;
+	size_t size;
+	size_t len;     /**< bytes waiting in buf */
+	unsigned int pending; /**< messages waiting in buf */
+	uint64_t sends;   /**< send() calls */
+	uint64_t msgs;    /**< netlink messages sent */
+	uint64_t errors;  /**< failed send() calls */
+};
+
+int NfQueueMsg_parsePkt(const struct nlmsghdr *nlh, struct NfQueuePktMsg *msg);
+
+int NfQueueMsgTx_init(struct NfQueueMsgTx *tx, int fd, uint16_t q_id, size_t size);
+void NfQueueMsgTx_free(struct NfQueueMsgTx *tx);
+int NfQueueMsgTx_addVerdict(struct NfQueueMsgTx *tx, const struct NfQueueVerdict *v);
+int NfQueueMsgTx_addVerdictBatch(struct NfQueueMsgTx *tx, uint32_t packet_id, uint32_t verdict);
+int NfQueueMsgTx_addConfig(struct NfQueueMsgTx *tx, uint32_t maxlen,
+	uint32_t flags, uint32_t mask);
+int NfQueueMsgTx_flush(struct NfQueueMsgTx *tx);
+
+/** @}  */
+
+#endif
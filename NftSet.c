@@ -0,0 +1,414 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nf_tables.h>
+
+#ifdef HAVE_CONFIG_H
+#include "nfq-web-filter-config.h"
+#endif
+
+#include "NftSet.h"
+#include "ContentFilter.h"
+#include "WfConfig.h"
+#include "nfq_wf_private.h"
+
+/**
+* @ingroup NftSet
+* @{
+*/
+
+/** elements per NFT_MSG_NEWSETELEM message */
+#define NFT_SET_ELEMS_PER_MSG 512
+
+/** seconds to wait for the kernel to acknowledge the transaction */
+#define NFT_SET_ACK_TIMEOUT 2
+
+/** interval of host order addresses, end is exclusive */
+struct nft_interval {
+	uint64_t start;
+	uint64_t end;
+};
+
+/** growing buffer of netlink messages */
+struct nft_buf {
+	uint8_t *data;
+	size_t len;
+	size_t size;
+	uint32_t seq;
+};
+
+static void __reserve(struct nft_buf *b, size_t len)
+{
+	if (b->len + len <= b->size)
+		return;
+
+	while (b->len + len > b->size)
+		b->size = b->size ? b->size * 2 : 4096;
+
+	b->data = realloc(b->data, b->size);
+	if (!b->data)
+		ERROR_FATAL("realloc error. nomem\n");
+}
+
+static struct nlmsghdr *__begin_msg(struct nft_buf *b, uint16_t type, uint16_t flags,
+	uint8_t family, uint16_t res_id)
+{
+	struct nlmsghdr *nlh;
+	struct nfgenmsg *nfg;
+
+	__reserve(b, NLMSG_SPACE(sizeof(struct nfgenmsg)));
+
+	nlh = (struct nlmsghdr *) &b->data[b->len];
+	nlh->nlmsg_type = type;
+	nlh->nlmsg_flags = NLM_F_REQUEST | flags;
+	nlh->nlmsg_seq = b->seq++;
+	nlh->nlmsg_pid = 0;
+	b->len += NLMSG_HDRLEN;
+
+	nfg = (struct nfgenmsg *) &b->data[b->len];
+	nfg->nfgen_family = family;
+	nfg->version = NFNETLINK_V0;
+	nfg->res_id = htons(res_id);
+	b->len += NLMSG_ALIGN(sizeof(struct nfgenmsg));
+
+	return nlh;
+}
+
+/** the buffer may move, so messages are found again by offset */
+static void __end_msg(struct nft_buf *b, size_t msg_off)
+{
+	struct nlmsghdr *nlh = (struct nlmsghdr *) &b->data[msg_off];
+
+	nlh->nlmsg_len = b->len - msg_off;
+}
+
+static void __put_attr(struct nft_buf *b, uint16_t type, const void *data, unsigned int len)
+{
+	struct nlattr *attr;
+
+	__reserve(b, NLA_ALIGN(NLA_HDRLEN + len));
+
+	attr = (struct nlattr *) &b->data[b->len];
+	attr->nla_type = type;
+	attr->nla_len = NLA_HDRLEN + len;
+	memcpy((uint8_t *) attr + NLA_HDRLEN, data, len);
+	memset((uint8_t *) attr + NLA_HDRLEN + len, 0,
+		NLA_ALIGN(NLA_HDRLEN + len) - (NLA_HDRLEN + len));
+
+	b->len += NLA_ALIGN(NLA_HDRLEN + len);
+}
+
+static void __put_str(struct nft_buf *b, uint16_t type, const char *str)
+{
+	__put_attr(b, type, str, strlen(str) + 1);
+}
+
+/** @return offset of the nested attribute, to close with __end_nest() */
+static size_t __begin_nest(struct nft_buf *b, uint16_t type)
+{
+	struct nlattr *attr;
+	size_t off = b->len;
+
+	__reserve(b, NLA_HDRLEN);
+
+	attr = (struct nlattr *) &b->data[b->len];
+	attr->nla_type = type | NLA_F_NESTED;
+	b->len += NLA_HDRLEN;
+	return off;
+}
+
+static void __end_nest(struct nft_buf *b, size_t off)
+{
+	struct nlattr *attr = (struct nlattr *) &b->data[off];
+
+	attr->nla_len = b->len - off;
+}
+
+static void __put_elem(struct nft_buf *b, uint32_t addr, bool interval_end)
+{
+	size_t elem, key;
+	uint32_t val = htonl(addr);
+	uint32_t flags = htonl(NFT_SET_ELEM_INTERVAL_END);
+
+	elem = __begin_nest(b, NFTA_LIST_ELEM);
+	key = __begin_nest(b, NFTA_SET_ELEM_KEY);
+	__put_attr(b, NFTA_DATA_VALUE, &val, sizeof(val));
+	__end_nest(b, key);
+	if (interval_end)
+		__put_attr(b, NFTA_SET_ELEM_FLAGS, &flags, sizeof(flags));
+	__end_nest(b, elem);
+}
+
+static size_t __begin_setelem_msg(struct nft_buf *b, uint16_t type, uint16_t flags,
+	uint8_t family, const char *table, const char *set)
+{
+	size_t off = b->len;
+
+	__begin_msg(b, (NFNL_SUBSYS_NFTABLES << 8) | type, flags, family, 0);
+	__put_str(b, NFTA_SET_ELEM_LIST_TABLE, table);
+	__put_str(b, NFTA_SET_ELEM_LIST_SET, set);
+	return off;
+}
+
+static int __interval_cmp(const void *a, const void *b)
+{
+	const struct nft_interval *x = a;
+	const struct nft_interval *y = b;
+
+	if (x->start != y->start)
+		return x->start < y->start ? -1 : 1;
+	return 0;
+}
+
+/**
+* Turn networks into sorted intervals, overlapping and adjacent ones
+* merged, as the kernel refuses overlapping elements.
+* @return number of intervals
+*/
+static unsigned int __nets_to_intervals(const struct Ipv4Net *nets, unsigned int count,
+	struct nft_interval *iv)
+{
+	uint32_t addr, mask;
+	unsigned int i, n = 0, m;
+
+	for (i = 0; i < count; i++) {
+		addr = ntohl(nets[i].addr);
+		mask = ntohl(nets[i].mask);
+
+		// only prefixes map to one interval
+		if (~mask & (~mask + 1)) {
+			WARN("network mask 0x%08x is not a prefix, not exported\n", mask);
+			continue;
+		}
+		iv[n].start = addr & mask;
+		iv[n].end = (uint64_t) (addr & mask) + (uint64_t) ~mask + 1;
+		n++;
+	}
+
+	if (!n)
+		return 0;
+
+	qsort(iv, n, sizeof(struct nft_interval), __interval_cmp);
+
+	for (i = 1, m = 0; i < n; i++) {
+		if (iv[i].start <= iv[m].end) {
+			if (iv[i].end > iv[m].end)
+				iv[m].end = iv[i].end;
+		} else {
+			iv[++m] = iv[i];
+		}
+	}
+	return m + 1;
+}
+
+/**
+* Read the kernel's replies until every message asking for one was
+* acknowledged.
+* @return 0 or the first -errno reported
+*/
+static int __wait_acks(int fd, uint32_t first_seq, unsigned int acks)
+{
+	uint8_t buf[8192];
+	struct nlmsghdr *nlh;
+	struct nlmsgerr *err;
+	int ret = 0;
+	ssize_t n;
+	int len;
+
+	while (acks) {
+		n = recv(fd, buf, sizeof(buf), 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		len = n;
+		for (nlh = (struct nlmsghdr *) buf; NLMSG_OK(nlh, len);
+			nlh = NLMSG_NEXT(nlh, len)) {
+			if (nlh->nlmsg_type != NLMSG_ERROR || nlh->nlmsg_seq < first_seq)
+				continue;
+
+			err = NLMSG_DATA(nlh);
+			if (err->error && !ret) {
+				ret = err->error;
+				ERROR("nftables seq=%u error=%d %s\n", nlh->nlmsg_seq,
+					err->error, strerror(-err->error));
+			}
+			acks--;
+		}
+	}
+
+	return ret;
+}
+
+static uint8_t __family_from_str(const char *family)
+{
+	if (!strcmp(family, "ip"))
+		return NFPROTO_IPV4;
+	if (!strcmp(family, "bridge"))
+		return NFPROTO_BRIDGE;
+	if (!strcmp(family, "netdev"))
+		return NFPROTO_NETDEV;
+
+	return NFPROTO_INET;
+}
+
+/**
+* Replace every element of an nftables interval set of ipv4_addr
+* with the given networks, in one transaction.
+* @param family  ip, inet, bridge or netdev
+* @return 0 or -errno
+*/
+int NftSet_replace(const char *family, const char *table, const char *set,
+	const struct Ipv4Net *nets, unsigned int count)
+{
+	struct sockaddr_nl addr = { .nl_family = AF_NETLINK };
+	struct timeval tv = { .tv_sec = NFT_SET_ACK_TIMEOUT };
+	struct nft_buf b = { .seq = time(NULL) };
+	struct nft_interval *iv;
+	unsigned int n, i, acks = 0;
+	uint32_t first_seq = b.seq;
+	uint8_t fam = __family_from_str(family);
+	size_t msg, list = 0;
+	int sndbuf;
+	ssize_t sent;
+	int fd;
+	int ret;
+
+	iv = calloc(count ? count : 1, sizeof(struct nft_interval));
+	if (!iv)
+		return -ENOMEM;
+	n = __nets_to_intervals(nets, count, iv);
+
+	msg = b.len;
+	__begin_msg(&b, NFNL_MSG_BATCH_BEGIN, 0, AF_UNSPEC, NFNL_SUBSYS_NFTABLES);
+	__end_msg(&b, msg);
+
+	// no elements flushes the set
+	msg = __begin_setelem_msg(&b, NFT_MSG_DELSETELEM, NLM_F_ACK, fam, table, set);
+	__end_msg(&b, msg);
+	acks++;
+
+	for (i = 0; i < n; i++) {
+		if (!(i % NFT_SET_ELEMS_PER_MSG)) {
+			msg = __begin_setelem_msg(&b, NFT_MSG_NEWSETELEM,
+				NLM_F_CREATE | NLM_F_ACK, fam, table, set);
+			list = __begin_nest(&b, NFTA_SET_ELEM_LIST_ELEMENTS);
+			acks++;
+		}
+
+		__put_elem(&b, iv[i].start, false);
+		// an interval reaching 255.255.255.255 has no end element
+		if (iv[i].end <= UINT32_MAX)
+			__put_elem(&b, iv[i].end, true);
+
+		if (i % NFT_SET_ELEMS_PER_MSG == NFT_SET_ELEMS_PER_MSG - 1 || i == n - 1) {
+			__end_nest(&b, list);
+			__end_msg(&b, msg);
+		}
+	}
+
+	msg = b.len;
+	__begin_msg(&b, NFNL_MSG_BATCH_END, 0, AF_UNSPEC, NFNL_SUBSYS_NFTABLES);
+	__end_msg(&b, msg);
+	free(iv);
+
+	fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_NETFILTER);
+	if (fd < 0) {
+		ret = -errno;
+		ERROR("netlink socket errno=%d %m\n", errno);
+		free(b.data);
+		return ret;
+	}
+
+	// the whole transaction has to go in one datagram
+	sndbuf = b.len + 4096;
+	if (setsockopt(fd, SOL_SOCKET, SO_SNDBUFFORCE, &sndbuf, sizeof(sndbuf)))
+		setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr))) {
+		ret = -errno;
+		ERROR("netlink bind errno=%d %m\n", errno);
+		goto out;
+	}
+
+	do {
+		sent = sendto(fd, b.data, b.len, 0, (struct sockaddr *) &addr, sizeof(addr));
+	} while (sent < 0 && errno == EINTR);
+
+	if (sent < 0) {
+		ret = -errno;
+		ERROR("sending %zu bytes to nftables errno=%d %m\n", b.len, errno);
+		goto out;
+	}
+
+	ret = __wait_acks(fd, first_seq, acks);
+	DBG(1, "nftables set %s %s %s: %u networks in %u intervals ret=%d\n",
+		family, table, set, count, n, ret);
+
+out:
+	close(fd);
+	free(b.data);
+	return ret;
+}
+
+/**
+* Export the IP only reject rules of a config, if it names an nftables set.
+* See nft_table and nft_set in the config.
+* @return 0 or -errno
+*/
+int NftSet_exportConfig(struct WfConfig *conf)
+{
+	struct Ipv4Net *nets;
+	unsigned int count;
+	int ret;
+
+	if (!WfConfig_getNftTable(conf) || !WfConfig_getNftSet(conf))
+		return 0;
+
+	count = ContentFilter_getRejectNets(WfConfig_getContentFilter(conf), &nets);
+	ret = NftSet_replace(WfConfig_getNftFamily(conf), WfConfig_getNftTable(conf),
+		WfConfig_getNftSet(conf), nets, count);
+	free(nets);
+
+	if (ret)
+		ERROR("Failed to export %u networks to nftables set '%s' error=%d\n",
+			count, WfConfig_getNftSet(conf), ret);
+	return ret;
+}
+
+/** @}  */
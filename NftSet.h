@@ -0,0 +1,52 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef NFTSET_H
+#define NFTSET_H 1
+
+#include "Filter.h"
+
+struct WfConfig;
+
+/**
+* @defgroup NftSet nftables set exporter
+* @brief Put the networks of IP only reject rules in an nftables interval set.
+*
+* The set is filled over nf_tables netlink, so the kernel can drop
+* those flows before they are queued.  The rules stay the source of
+* truth: the set is flushed and refilled in one transaction on every
+* config load.  The table and set must exist, e.g.
+* @code
+* nft add table inet nfqwf
+* nft add set inet nfqwf reject_nets '{ type ipv4_addr; flags interval; }'
+* @endcode
+* @{
+*/
+
+int NftSet_replace(const char *family, const char *table, const char *set,
+	const struct Ipv4Net *nets, unsigned int count);
+
+int NftSet_exportConfig(struct WfConfig *conf);
+
+/** @}  */
+
+#endif
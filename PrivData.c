@@ -33,44 +33,43 @@ THE SOFTWARE.
 #include "PrivData.h"
 #include "nfq_wf_private.h"
 
-struct priv_data {
-	int key;
-	void *data;
-	void (*free_fn)(void *ptr);
-};
+/** Initialize private data embedded in another struct */
+void PrivData_init(struct PrivData *pd)
+{
+	pd->vec = pd->inline_vec;
+	pd->size = PRIV_DATA_INLINE;
+	pd->count = 0;
+}
 
-struct PrivData
+/** Free every item of embedded private data */
+void PrivData_destroy(struct PrivData *pd)
 {
-	/* array of pointers to private data*/
-	struct priv_data **priv_data_vec;
-	unsigned int priv_data_count;
-};
+	unsigned int i;
 
+	for (i = 0; i < pd->count; i++) {
+		if (pd->vec[i].data)
+			pd->vec[i].free_fn(pd->vec[i].data);
+	}
+
+	if (pd->vec != pd->inline_vec)
+		free(pd->vec);
+
+	PrivData_init(pd);
+}
 
 /** Allocate new private data structure */
 struct PrivData *PrivData_new(void) {
 	struct PrivData *pd;
-	pd = calloc(1, sizeof(struct PrivData));
-	pd->priv_data_vec = calloc(1, sizeof(struct priv_data*) * 2);
+	pd = malloc(sizeof(struct PrivData));
+	if (pd)
+		PrivData_init(pd);
 	return pd;
 }
 
 /** Release memory */
 void PrivData_del(struct PrivData **pd_in) {
-	struct PrivData *pd = *pd_in;
-	int i;
-
-	// free private data
-	for (i = 0 ; i <= pd->priv_data_count; i++) {
-		if (pd->priv_data_vec[i]) {
-			if (pd->priv_data_vec[i]->data)
-				pd->priv_data_vec[i]->free_fn(pd->priv_data_vec[i]->data);
-
-			free(pd->priv_data_vec[i]);
-		}
-	}
-	free(pd->priv_data_vec);
-	free(pd);
+	PrivData_destroy(*pd_in);
+	free(*pd_in);
 	*pd_in = NULL;
 }
 
@@ -84,20 +83,31 @@ void PrivData_del(struct PrivData **pd_in) {
 */
 void *PrivData_newData(struct PrivData* pd, int key, int size, void (*free_fn)(void *))
 {
+	struct priv_data *vec;
 	void *data;
 
 	//NOTE we could check if the key already exists, but that would just slow us down,
 	// this would become O(N) where N is number of priv data.   Now we are O(1)
 
-	pd->priv_data_vec = realloc(pd->priv_data_vec,
-		(pd->priv_data_count+2) * sizeof(struct priv_data*));
+	if (pd->count == pd->size) {
+		vec = malloc(pd->size * 2 * sizeof(struct priv_data));
+		if (!vec)
+			return NULL;
+		memcpy(vec, pd->vec, pd->count * sizeof(struct priv_data));
+		if (pd->vec != pd->inline_vec)
+			free(pd->vec);
+		pd->vec = vec;
+		pd->size *= 2;
+	}
+
+	data = calloc(1, size);
+	if (!data)
+		return NULL;
 
-	pd->priv_data_vec[pd->priv_data_count] = calloc(1, sizeof(struct priv_data));
-	data = pd->priv_data_vec[pd->priv_data_count]->data = calloc(1, size);
-	pd->priv_data_vec[pd->priv_data_count]->key = key;
-	pd->priv_data_vec[pd->priv_data_count]->free_fn = free_fn;
-	pd->priv_data_count++;
-	pd->priv_data_vec[pd->priv_data_count] = NULL; // NULL term
+	pd->vec[pd->count].data = data;
+	pd->vec[pd->count].key = key;
+	pd->vec[pd->count].free_fn = free_fn;
+	pd->count++;
 	return data;
 }
 
@@ -109,13 +119,13 @@ void *PrivData_newData(struct PrivData* pd, int key, int size, void (*free_fn)(v
 */
 void *PrivData_getData(struct PrivData* pd, int key)
 {
-	int i;
+	unsigned int i;
 
-	for (i = 0; i < pd->priv_data_count; i++) {
-		if (pd->priv_data_vec[i] && pd->priv_data_vec[i]->key == key) {
+	for (i = 0; i < pd->count; i++) {
+		if (pd->vec[i].key == key) {
 			DBG(5, "found data %p with key %d=0x%08x\n",
-				pd->priv_data_vec[i]->data, key, key);
-			return pd->priv_data_vec[i]->data;
+				pd->vec[i].data, key, key);
+			return pd->vec[i].data;
 		}
 	}
 	return NULL;
@@ -20,10 +20,39 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
 
+#ifndef PRIV_DATA_H
+#define PRIV_DATA_H 1
+
 #ifdef HAVE_CONFIG_H
 #include "nfq-web-filter-config.h"
 #endif
 
+/** items stored in struct PrivData itself before the vector moves to the heap */
+#define PRIV_DATA_INLINE 4
+
+struct priv_data {
+	int key;
+	void *data;
+	void (*free_fn)(void *ptr);
+};
+
+/**
+* Private data that filters attach to a connection or request.
+* Embedded in its owner, so the common case of a few items
+* costs no allocation besides the items data.
+*/
+struct PrivData
+{
+	struct priv_data inline_vec[PRIV_DATA_INLINE];
+	struct priv_data *vec; /**< inline_vec or a heap copy when it grew */
+	unsigned int count;
+	unsigned int size; /**< entries in vec */
+};
+
+void PrivData_init(struct PrivData *pd);
+
+void PrivData_destroy(struct PrivData *pd);
+
 struct PrivData *PrivData_new(void);
 
 void PrivData_del(struct PrivData **pd_in);
@@ -32,3 +61,5 @@ void PrivData_del(struct PrivData **pd_in);
 void *PrivData_newData(struct PrivData* pd, int key, int size, void (*free_fn)(void *));
 
 void *PrivData_getData(struct PrivData* pd, int key);
+
+#endif
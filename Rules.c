@@ -265,6 +265,116 @@ enum Action Rule_getVerdict(struct Rule *r,  struct HttpReq *req)
 	return r->action;
 }
 
+static int __tuple_filter_cb(struct Filter *fo, void *data)
+{
+	return fo->fo_ops->foo_matches_tuple == NULL;
+}
+
+/**
+* Check if every filter of the rule can be matched from the IP/TCP tuple
+* alone, so the rule is decided when the connection starts.
+*/
+bool Rule_isTupleOnly(struct Rule *r)
+{
+	int i;
+
+	for (i = 0 ; i < MAX_FITER_GROUPS; i++) {
+		if (FilterList_foreach(r->filter_groups[i], NULL, __tuple_filter_cb))
+			return false;
+	}
+	return true;
+}
+
+struct tuple_match_args {
+	const struct Ipv4TcpTuple *tuple;
+	time_t now;
+};
+
+static int rule_filter_match_tuple_cb(struct Filter *fo, void *data)
+{
+	struct tuple_match_args *args = (struct tuple_match_args *) data;
+
+	return fo->fo_ops->foo_matches_tuple(fo, args->tuple, args->now);
+}
+
+/**
+* Same as Rule_getVerdict() for a rule where Rule_isTupleOnly() is true
+* @param tuple client to server tuple
+*/
+enum Action Rule_getTupleVerdict(struct Rule *r, const struct Ipv4TcpTuple *tuple,
+	time_t now)
+{
+	struct tuple_match_args args = { .tuple = tuple, .now = now };
+	int i;
+
+	for (i = 0 ; i < MAX_FITER_GROUPS; i++) {
+		/*if group is empty it matches the ANY '*' case */
+		if (FilterList_count(r->filter_groups[i])
+			&& !FilterList_foreach(r->filter_groups[i], &args,
+				rule_filter_match_tuple_cb))
+			return Action_nomatch;
+	}
+	return r->action;
+}
+
+struct dst_net_args {
+	struct Ipv4Net *nets;
+	unsigned int count;
+	unsigned int size;
+	bool other; /**< a filter matches on something else */
+};
+
+static int __dst_net_cb(struct Filter *fo, void *data)
+{
+	struct dst_net_args *args = (struct dst_net_args *) data;
+	struct Ipv4Net net;
+
+	if (!fo->fo_ops->foo_dst_net || fo->fo_ops->foo_dst_net(fo, &net)) {
+		args->other = true;
+		return 0;
+	}
+
+	if (args->count == args->size) {
+		args->size = args->size ? args->size * 2 : 16;
+		args->nets = realloc(args->nets, args->size * sizeof(struct Ipv4Net));
+		if (!args->nets)
+			ERROR_FATAL("realloc error. nomem\n");
+	}
+	args->nets[args->count++] = net;
+	return 0;
+}
+
+/**
+* Append the destination networks of a rule that matches only on them,
+* with a single group of filters.
+* @param nets   malloc()ed array to append to, may be NULL
+* @param count  networks in nets
+* @return networks appended, or -1 if the rule matches on anything else
+*/
+int Rule_getDstNets(struct Rule *r, struct Ipv4Net **nets, unsigned int *count)
+{
+	struct dst_net_args args = { .nets = *nets, .count = *count, .size = *count };
+	int groups = 0;
+	int i;
+
+	for (i = 0 ; i < MAX_FITER_GROUPS; i++) {
+		if (FilterList_count(r->filter_groups[i])) {
+			groups++;
+			FilterList_foreach(r->filter_groups[i], &args, __dst_net_cb);
+		}
+	}
+
+	*nets = args.nets;
+	if (groups != 1 || args.other) {
+		// drop what was appended
+		return -1;
+	}
+
+	i = args.count - *count;
+	*count = args.count;
+	return i;
+}
+
 bool Rule_containsFilter(struct Rule *r, struct Filter *fo, unsigned int *group)
 {
 	int i;
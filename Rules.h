@@ -117,6 +117,11 @@ static inline const char *Rule_getComment(struct Rule *r) {
 
 enum Action Rule_getVerdict(struct Rule *r,  struct HttpReq *req);
 
+bool Rule_isTupleOnly(struct Rule *r);
+enum Action Rule_getTupleVerdict(struct Rule *r, const struct Ipv4TcpTuple *tuple,
+	time_t now);
+int Rule_getDstNets(struct Rule *r, struct Ipv4Net **nets, unsigned int *count);
+
 static inline void Rule_setMark(struct Rule *r, uint32_t mark) {
 	r->mark = mark;
 }
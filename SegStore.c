@@ -0,0 +1,194 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Ipv4Tcp.h"
+#include "SegStore.h"
+#include "Slab.h"
+#include "nfq_wf_private.h"
+
+/**
+* @ingroup SegStore
+* @{
+*/
+
+struct SegNode {
+	struct Ipv4TcpPkt *pkt;
+	uint8_t level;
+	struct SegNode *next[SEG_STORE_LEVELS];
+};
+
+/** one past the last sequence number of a segment */
+static inline uint32_t __seg_end(const struct Ipv4TcpPkt *pkt)
+{
+	return pkt->seq_num + pkt->tcp_payload_length;
+}
+
+/** random level, each level is 1/4 as likely as the one below */
+static uint8_t __random_level(struct SegStore *st)
+{
+	uint32_t x = st->rnd;
+	uint8_t level = 1;
+
+	// xorshift32
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	st->rnd = x;
+
+	while (level < SEG_STORE_LEVELS && !(x & 3)) {
+		level++;
+		x >>= 2;
+	}
+	return level;
+}
+
+static struct SegNode *__node_alloc(struct SegStore *st)
+{
+	if (st->slab)
+		return Slab_alloc(st->slab);
+	return malloc(sizeof(struct SegNode));
+}
+
+static void __node_free(struct SegStore *st, struct SegNode *node)
+{
+	if (st->slab)
+		Slab_free(st->slab, node);
+	else
+		free(node);
+}
+
+/** object size for a Slab of nodes */
+size_t SegStore_nodeSize(void)
+{
+	return sizeof(struct SegNode);
+}
+
+/**
+* @arg slab  node allocator, NULL to use malloc()
+*/
+void SegStore_init(struct SegStore *st, struct Slab *slab)
+{
+	memset(st, 0, sizeof(*st));
+	st->slab = slab;
+	st->level = 1;
+	st->rnd = (uint32_t) (uintptr_t) st | 1;
+}
+
+/**
+* Add a packet.
+* If a stored segment starts at the same seq_num the longer of the two
+* is kept.  A packet inside the span of its predecessor is refused.
+* @return packet the caller still owns and should free: NULL if pkt was
+* stored, pkt if refused, or a stored packet that pkt replaced
+*/
+struct Ipv4TcpPkt *SegStore_insert(struct SegStore *st, struct Ipv4TcpPkt *pkt)
+{
+	struct SegNode **update[SEG_STORE_LEVELS];
+	struct SegNode **link = st->head;
+	struct SegNode *prev = NULL;
+	struct SegNode *node;
+	struct Ipv4TcpPkt *old;
+	int i;
+	uint8_t level;
+
+	for (i = st->level - 1; i >= 0; i--) {
+		while (link[i] && SEQ_LEQ(link[i]->pkt->seq_num, pkt->seq_num)) {
+			prev = link[i];
+			link = prev->next;
+		}
+		update[i] = &link[i];
+	}
+
+	if (prev) {
+		if (prev->pkt->seq_num == pkt->seq_num) {
+			if (pkt->tcp_payload_length <= prev->pkt->tcp_payload_length)
+				return pkt;
+
+			old = prev->pkt;
+			prev->pkt = pkt;
+			return old;
+		}
+
+		if (SEQ_LEQ(__seg_end(pkt), __seg_end(prev->pkt)))
+			return pkt;
+	}
+
+	node = __node_alloc(st);
+	if (!node) {
+		ERROR("No memory for segment seq=%u\n", pkt->seq_num);
+		return pkt;
+	}
+
+	level = __random_level(st);
+	for (i = st->level; i < level; i++)
+		update[i] = &st->head[i];
+	if (level > st->level)
+		st->level = level;
+
+	node->pkt = pkt;
+	node->level = level;
+	for (i = 0; i < level; i++) {
+		node->next[i] = *update[i];
+		*update[i] = node;
+	}
+
+	st->count++;
+	return NULL;
+}
+
+/** lowest segment, NULL if empty */
+struct Ipv4TcpPkt *SegStore_first(struct SegStore *st)
+{
+	return st->head[0] ? st->head[0]->pkt : NULL;
+}
+
+/**
+* Remove the lowest segment
+* @return the packet, now owned by the caller, or NULL if empty
+*/
+struct Ipv4TcpPkt *SegStore_popFirst(struct SegStore *st)
+{
+	struct SegNode *node = st->head[0];
+	struct Ipv4TcpPkt *pkt;
+	int i;
+
+	if (!node)
+		return NULL;
+
+	// the first node is first on every level it is linked in
+	for (i = 0; i < node->level; i++)
+		st->head[i] = node->next[i];
+
+	while (st->level > 1 && !st->head[st->level - 1])
+		st->level--;
+
+	pkt = node->pkt;
+	__node_free(st, node);
+	st->count--;
+	return pkt;
+}
+
+/** @}  */
@@ -0,0 +1,75 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SEG_STORE_H
+#define SEG_STORE_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+* @defgroup SegStore  Out of order TCP segment store
+* @brief Buffered packets of one direction of a connection, ordered by sequence number.
+*
+* A skiplist keyed by seq_num, compared modulo 2^32 so a window across
+* the wrap point sorts correctly.  Insert is O(log n), the lowest segment
+* is always at the head so draining is O(1) per segment.
+* Segments that are fully covered by one already stored are refused.
+* Nodes come from a Slab when one is given, otherwise from the heap.
+* @{
+*/
+
+/** levels of the skiplist, enough for 4^8 segments */
+#define SEG_STORE_LEVELS 8
+
+/** a before b, modulo 2^32 */
+#define SEQ_LT(a, b) ((int32_t) ((uint32_t) (a) - (uint32_t) (b)) < 0)
+#define SEQ_LEQ(a, b) ((int32_t) ((uint32_t) (a) - (uint32_t) (b)) <= 0)
+
+struct Ipv4TcpPkt;
+struct SegNode;
+struct Slab;
+
+struct SegStore {
+	struct SegNode *head[SEG_STORE_LEVELS];
+	struct Slab *slab; /**< node allocator, NULL for the heap */
+	unsigned int count;
+	uint8_t level; /**< levels in use */
+	uint32_t rnd; /**< level generator state */
+};
+
+size_t SegStore_nodeSize(void);
+
+void SegStore_init(struct SegStore *st, struct Slab *slab);
+
+struct Ipv4TcpPkt *SegStore_insert(struct SegStore *st, struct Ipv4TcpPkt *pkt);
+struct Ipv4TcpPkt *SegStore_first(struct SegStore *st);
+struct Ipv4TcpPkt *SegStore_popFirst(struct SegStore *st);
+
+static inline unsigned int SegStore_count(const struct SegStore *st)
+{
+	return st->count;
+}
+
+/** @}  */
+
+#endif
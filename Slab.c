@@ -0,0 +1,186 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "Slab.h"
+#include "nfq_wf_private.h"
+
+/**
+* @ingroup Slab
+* @{
+*/
+
+#define SLAB_ALIGN 16
+
+/** a free object, overlays the start of the object */
+struct slab_free_obj {
+	struct slab_free_obj *next;
+};
+
+/** a block of objects, chunks are chained so they can be freed */
+struct slab_chunk {
+	struct slab_chunk *next;
+};
+
+struct Slab {
+	const char *name;
+	size_t obj_size; /**< rounded up to SLAB_ALIGN */
+	unsigned int objs_per_chunk;
+	struct slab_free_obj *free_list;
+	struct slab_chunk *chunks;
+	unsigned int n_chunks;
+	unsigned int in_use;
+	unsigned int high_water;
+	uint64_t allocs;
+};
+
+/** header of a chunk, rounded so objects stay aligned */
+#define SLAB_CHUNK_HDR ((sizeof(struct slab_chunk) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1))
+
+/**
+* Create a slab
+* @arg name  for stats, not copied
+* @arg obj_size  size of each object
+* @arg objs_per_chunk  objects allocated at a time when the free list is empty
+*/
+struct Slab *Slab_new(const char *name, size_t obj_size, unsigned int objs_per_chunk)
+{
+	struct Slab *slab;
+
+	slab = calloc(1, sizeof(struct Slab));
+	if (!slab)
+		return NULL;
+
+	if (obj_size < sizeof(struct slab_free_obj))
+		obj_size = sizeof(struct slab_free_obj);
+
+	slab->name = name;
+	slab->obj_size = (obj_size + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1);
+	slab->objs_per_chunk = objs_per_chunk ? objs_per_chunk : 1;
+	return slab;
+}
+
+/**
+* Free a slab and every chunk, objects still in use become invalid
+*/
+void Slab_del(struct Slab **in_slab)
+{
+	struct Slab *slab = *in_slab;
+	struct slab_chunk *chunk;
+
+	if (!slab)
+		return;
+
+	if (slab->in_use) {
+		DBG(1, "Warning slab %s freed with %u objects in use\n",
+			slab->name, slab->in_use);
+	}
+
+	while ((chunk = slab->chunks)) {
+		slab->chunks = chunk->next;
+		free(chunk);
+	}
+
+	free(slab);
+	*in_slab = NULL;
+}
+
+static int __grow(struct Slab *slab)
+{
+	struct slab_chunk *chunk;
+	struct slab_free_obj *obj;
+	unsigned char *base;
+	unsigned int i;
+
+	if (posix_memalign((void **) &chunk, SLAB_ALIGN,
+			SLAB_CHUNK_HDR + slab->obj_size * slab->objs_per_chunk))
+		return -1;
+
+	chunk->next = slab->chunks;
+	slab->chunks = chunk;
+	slab->n_chunks++;
+
+	// push in reverse so objects are handed out in address order
+	base = (unsigned char *) chunk + SLAB_CHUNK_HDR;
+	for (i = slab->objs_per_chunk; i > 0; i--) {
+		obj = (struct slab_free_obj *) (base + (i - 1) * slab->obj_size);
+		obj->next = slab->free_list;
+		slab->free_list = obj;
+	}
+
+	DBG(4, "slab %s grew to %u chunks\n", slab->name, slab->n_chunks);
+	return 0;
+}
+
+/**
+* Get an object, contents undefined
+* @return object or NULL if out of memory
+*/
+void *Slab_alloc(struct Slab *slab)
+{
+	struct slab_free_obj *obj;
+
+	if (!slab->free_list && __grow(slab))
+		return NULL;
+
+	obj = slab->free_list;
+	slab->free_list = obj->next;
+
+	slab->allocs++;
+	if (++slab->in_use > slab->high_water)
+		slab->high_water = slab->in_use;
+
+	return obj;
+}
+
+/** Get a zeroed object */
+void *Slab_zalloc(struct Slab *slab)
+{
+	void *obj = Slab_alloc(slab);
+
+	if (obj)
+		memset(obj, 0, slab->obj_size);
+
+	return obj;
+}
+
+/** Return an object to the slab it came from */
+void Slab_free(struct Slab *slab, void *obj)
+{
+	struct slab_free_obj *fobj = obj;
+
+	fobj->next = slab->free_list;
+	slab->free_list = fobj;
+	slab->in_use--;
+}
+
+void Slab_printStats(struct Slab *slab, FILE *stream)
+{
+	fprintf(stream, "slab %s obj_size=%zu chunks=%u in_use=%u high_water=%u allocs=%llu\n",
+		slab->name, slab->obj_size, slab->n_chunks, slab->in_use, slab->high_water,
+		(unsigned long long) slab->allocs);
+}
+
+/** @}  */
@@ -0,0 +1,52 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SLAB_H
+#define SLAB_H 1
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+* @defgroup Slab  Fixed size object cache
+* @brief Objects of one type carved from larger chunks and recycled on a free list.
+*
+* A slab is owned by one thread, there is no locking.
+* Memory goes back to the system only when the slab is deleted.
+* @{
+*/
+
+struct Slab;
+
+struct Slab *Slab_new(const char *name, size_t obj_size, unsigned int objs_per_chunk);
+void Slab_del(struct Slab **slab);
+
+void *Slab_alloc(struct Slab *slab);
+void *Slab_zalloc(struct Slab *slab);
+void Slab_free(struct Slab *slab, void *obj);
+
+void Slab_printStats(struct Slab *slab, FILE *stream);
+
+/** @}  */
+
+#endif
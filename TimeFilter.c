@@ -112,12 +112,11 @@ static int TimeFilter_load_from_xml(struct Filter *fobj, xmlNode *node)
 	return 0;
 }
 
-static int time_filter_matches(struct TimeFilter *filt, struct HttpReq *req)
+static int time_filter_matches(struct TimeFilter *filt, time_t now)
 {
-	struct HttpConn *con = req->con;
 	struct tm tm;
 
-	if (!localtime_r(&con->last_pkt, &tm)) {
+	if (!localtime_r(&now, &tm)) {
 		ERROR(" calling localtime\n");
 	}
 
@@ -156,7 +155,7 @@ static int TimeFilter_start_req(struct Filter *fobj, struct HttpReq *req)
 		return -1;
 	}
 
-	(*(int *)data) = time_filter_matches(filt, req);
+	(*(int *)data) = time_filter_matches(filt, con->last_pkt);
 
 	return 0; // OK
 }
@@ -177,9 +176,16 @@ static int TimeFilter_matches_req(struct Filter *fobj, struct HttpReq *req)
 	#else
 	struct TimeFilter *filt = (struct TimeFilter *) fobj; /* Host filter object */
 
-	return time_filter_matches(filt, req);
+	return time_filter_matches(filt, req->con->last_pkt);
 	#endif
 }
+
+static int TimeFilter_matches_tuple(struct Filter *fobj,
+	const struct Ipv4TcpTuple *tuple, time_t now)
+{
+	return time_filter_matches((struct TimeFilter *) fobj, now);
+}
+
 static struct Object_ops obj_ops = {
 	.obj_type           = "filter/time",
 	.obj_size           = sizeof(struct TimeFilter),
@@ -196,6 +202,7 @@ static struct Filter_ops TimeFilter_obj_ops = {
 	.foo_request_start  = TimeFilter_start_req,
 #endif
 	.foo_matches_req    = TimeFilter_matches_req,
+	.foo_matches_tuple  = TimeFilter_matches_tuple,
 };
 
 
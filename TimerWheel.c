@@ -0,0 +1,184 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <stdint.h>
+
+#include "TimerWheel.h"
+
+/**
+* @ingroup TimerWheel
+* @{
+*/
+
+static inline void __list_init(struct TimerWheel_timer *head)
+{
+	head->next = head->prev = head;
+}
+
+static inline void __list_add_tail(struct TimerWheel_timer *head, struct TimerWheel_timer *t)
+{
+	t->next = head;
+	t->prev = head->prev;
+	head->prev->next = t;
+	head->prev = t;
+}
+
+static inline void __list_unlink(struct TimerWheel_timer *t)
+{
+	t->prev->next = t->next;
+	t->next->prev = t->prev;
+	t->next = t->prev = NULL;
+}
+
+/**
+* Initialize an empty wheel
+* @arg now  current tick
+*/
+void TimerWheel_init(struct TimerWheel *tw, uint64_t now)
+{
+	int l, s;
+
+	for (l = 0; l < TW_LEVELS; l++)
+		for (s = 0; s < TW_SLOTS; s++)
+			__list_init(&tw->slots[l][s]);
+
+	tw->next_tick = now + 1;
+	tw->count = 0;
+}
+
+/** link into the slot for t->expires relative to next_tick */
+static void __place(struct TimerWheel *tw, struct TimerWheel_timer *t)
+{
+	uint64_t delta = t->expires - tw->next_tick;
+	int level = 0;
+
+	while (level < TW_LEVELS - 1 && delta >> (TW_BITS * (level + 1)))
+		level++;
+
+	__list_add_tail(&tw->slots[level][(t->expires >> (TW_BITS * level)) & TW_MASK], t);
+}
+
+/**
+* Start a timer
+* @arg expires  tick to fire at, ticks in the past fire on the next advance
+*/
+void TimerWheel_add(struct TimerWheel *tw, struct TimerWheel_timer *t, uint64_t expires)
+{
+	if (expires < tw->next_tick)
+		expires = tw->next_tick;
+	else if (expires - tw->next_tick > TW_MAX_TICKS)
+		expires = tw->next_tick + TW_MAX_TICKS;
+
+	t->expires = expires;
+	t->pending = true;
+	tw->count++;
+	__place(tw, t);
+}
+
+/** Stop a timer, does nothing if it is not pending */
+void TimerWheel_del(struct TimerWheel *tw, struct TimerWheel_timer *t)
+{
+	if (!t->pending)
+		return;
+
+	__list_unlink(t);
+	t->pending = false;
+	tw->count--;
+}
+
+/** Change when a timer fires, start it if not pending */
+void TimerWheel_mod(struct TimerWheel *tw, struct TimerWheel_timer *t, uint64_t expires)
+{
+	TimerWheel_del(tw, t);
+	TimerWheel_add(tw, t, expires);
+}
+
+/** take every timer of a slot onto head, leaving the slot empty */
+static void __detach_slot(struct TimerWheel_timer *slot, struct TimerWheel_timer *head)
+{
+	if (slot->next == slot) {
+		__list_init(head);
+		return;
+	}
+
+	head->next = slot->next;
+	head->prev = slot->prev;
+	head->next->prev = head;
+	head->prev->next = head;
+	__list_init(slot);
+}
+
+/** move every timer of a slot to lower levels, return the slot index */
+static int __cascade(struct TimerWheel *tw, int level)
+{
+	int idx = (tw->next_tick >> (TW_BITS * level)) & TW_MASK;
+	struct TimerWheel_timer head;
+	struct TimerWheel_timer *t;
+
+	__detach_slot(&tw->slots[level][idx], &head);
+
+	while (head.next != &head) {
+		t = head.next;
+		__list_unlink(t);
+		__place(tw, t);
+	}
+
+	return idx;
+}
+
+/**
+* Fire every timer that expires up to and including now
+* @return number of timers fired
+*/
+unsigned int TimerWheel_advance(struct TimerWheel *tw, uint64_t now,
+	TimerWheel_cb cb, void *arg)
+{
+	struct TimerWheel_timer head;
+	struct TimerWheel_timer *t;
+	unsigned int fired = 0;
+	int idx, level;
+
+	while (tw->next_tick <= now) {
+		idx = tw->next_tick & TW_MASK;
+
+		// level 0 wrapped, pull the next slot of each higher level down
+		for (level = 1; !idx && level < TW_LEVELS; level++)
+			idx = __cascade(tw, level);
+
+		// detach first, callbacks may add timers to this same slot for a later round
+		__detach_slot(&tw->slots[0][tw->next_tick & TW_MASK], &head);
+		tw->next_tick++;
+
+		while (head.next != &head) {
+			t = head.next;
+			__list_unlink(t);
+			t->pending = false;
+			tw->count--;
+			fired++;
+			cb(t, arg);
+		}
+	}
+
+	return fired;
+}
+
+/** @}  */
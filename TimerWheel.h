@@ -0,0 +1,75 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H 1
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+* @defgroup TimerWheel  Hierarchical timer wheel
+* @brief O(1) add/remove timers, expiry cost proportional to timers that fire.
+*
+* Time is in ticks, the caller chooses the unit.
+* TW_LEVELS wheels of TW_SLOTS slots each, level n slots are TW_SLOTS^n ticks wide.
+* Timers in higher levels cascade down as time advances.
+* Timers are embedded in the object they time, no allocation.
+* @{
+*/
+
+#define TW_BITS 6
+#define TW_SLOTS (1 << TW_BITS)
+#define TW_MASK (TW_SLOTS - 1)
+#define TW_LEVELS 4
+
+/** longest timeout, longer ones are clamped */
+#define TW_MAX_TICKS ((UINT64_C(1) << (TW_BITS * TW_LEVELS)) - 1)
+
+struct TimerWheel_timer {
+	struct TimerWheel_timer *next;
+	struct TimerWheel_timer *prev;
+	uint64_t expires; /**< tick it fires at */
+	bool pending; /**< in a wheel */
+};
+
+struct TimerWheel {
+	uint64_t next_tick; /**< next tick to process */
+	unsigned int count; /**< pending timers */
+	/** list heads, only next and prev are used */
+	struct TimerWheel_timer slots[TW_LEVELS][TW_SLOTS];
+};
+
+/** called with the timer already removed, so it may be added again */
+typedef void (*TimerWheel_cb)(struct TimerWheel_timer *t, void *arg);
+
+void TimerWheel_init(struct TimerWheel *tw, uint64_t now);
+void TimerWheel_add(struct TimerWheel *tw, struct TimerWheel_timer *t, uint64_t expires);
+void TimerWheel_del(struct TimerWheel *tw, struct TimerWheel_timer *t);
+void TimerWheel_mod(struct TimerWheel *tw, struct TimerWheel_timer *t, uint64_t expires);
+unsigned int TimerWheel_advance(struct TimerWheel *tw, uint64_t now,
+	TimerWheel_cb cb, void *arg);
+
+/** @}  */
+
+#endif
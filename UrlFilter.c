@@ -95,13 +95,13 @@ static int UrlFilter_matches_req(struct Filter *fobj, struct HttpReq *req)
 {
 	struct UrlFilter *fo = (struct UrlFilter *) fobj; /* Host filter object */
 
-	DBG(5, "check if req url='%s' contains = '%s'\n", req->url, fo->url);
-	if (!req->url) {
+	DBG(5, "check if req url='%s' contains = '%s'\n", req->url.str, fo->url);
+	if (!req->url.str) {
 		// NOTE can be NULL on 403 cases where we get blocked, with no HTTP request
 		return 0;
 	}
 
-	if (!fnmatch(fo->url, req->url, FNM_CASEFOLD))
+	if (!fnmatch(fo->url, req->url.str, FNM_CASEFOLD))
 		return 1;
 
 	return 0;
@@ -71,8 +71,53 @@ struct WfConfig
 	*/
 	unsigned int pkt_buf_size;
 
+	/** Number of netlink messages each queue reads per system call */
+	unsigned int recv_batch;
+
+	/** Number of preallocated packets in each queue's packet pool */
+	unsigned int pkt_pool_size;
+
+	/** Per queue limits on tracked connections and on bytes of
+		buffered out of order packets, 0 for no limit.
+		Past a limit the least recently active connections are evicted.
+	*/
+	unsigned int max_connections;
+	unsigned int max_buffered_bytes;
+	/** what happens to later packets of an evicted connection */
+	enum non_http_action eviction_policy;
+
+	/** Out of order packets are kept in the kernel with their verdict
+		deferred, instead of being accepted and copied */
+	bool hold_out_of_order;
+	/** seconds a connection may hold packets before they are accepted uninspected */
+	unsigned int hold_timeout;
+
+	/** connmark bits set on connections a trust rule matched, 0 for none */
+	uint32_t trust_mark;
+	/** connmark and mark bits set on non HTTP connections that are accepted, 0 for none */
+	uint32_t non_http_mark;
+	/** connections decided from their SYN */
+	enum syn_verdicts syn_verdicts;
+
+	/** packets the kernel keeps in each queue before it is overloaded */
+	unsigned int queue_maxlen;
+	/** on overload packets are accepted unfiltered instead of dropped */
+	bool overload_accept;
+	/** packets read back to back before a queue goes into overload, 0 never */
+	unsigned int overload_backlog;
+	/** the kernel queues GSO packets whole instead of segmenting them */
+	bool gso;
+	/** checksums are computed again even when the kernel has checked them */
+	bool verify_checksums;
+
 	char *tmp_dir; /* where to store tmp files if AV file scan active */
 
+	/** nftables interval set that gets the networks of IP only reject rules,
+	NULL if not exported */
+	char *nft_family;
+	char *nft_table;
+	char *nft_set;
+
 	/// TODO a configurable error page.
 	char *error_page;
 	struct ContentFilter *cf; /* content filter object */
@@ -132,6 +177,10 @@ int WfConfig_destructor(struct Object *obj)
 	if (conf->tmp_dir)
 		free(conf->tmp_dir);
 
+	free(conf->nft_family);
+	free(conf->nft_table);
+	free(conf->nft_set);
+
 	return 0;
 }
 
@@ -168,6 +217,7 @@ int WfConfig_loadConfig(struct WfConfig* conf, const char *config_xml_file)
 	xmlDoc *doc = NULL;
 	xmlNode *root_node = NULL;
 	xmlChar *prop = NULL;
+	char *endptr;
 	struct stat tmp_dir_stat;
 	char *cmd;
 
@@ -232,6 +282,195 @@ int WfConfig_loadConfig(struct WfConfig* conf, const char *config_xml_file)
 	} else {
 		conf->pkt_buf_size = 2048;
 	}
+	prop = xmlGetProp(root_node, BAD_CAST "recv_batch");
+	if (prop) {
+		conf->recv_batch = atoi((const char*)prop);
+		xmlFree(prop);
+		if (conf->recv_batch < 1) {
+			WARN(" invalid 'recv_batch' XML prop. using default \n");
+			conf->recv_batch = 16;
+		}
+	} else {
+		conf->recv_batch = 16;
+	}
+
+	prop = xmlGetProp(root_node, BAD_CAST "pkt_pool_size");
+	if (prop) {
+		conf->pkt_pool_size = atoi((const char*)prop);
+		xmlFree(prop);
+		if (conf->pkt_pool_size < 1) {
+			WARN(" invalid 'pkt_pool_size' XML prop. using default \n");
+			conf->pkt_pool_size = 1024;
+		}
+	} else {
+		conf->pkt_pool_size = 1024;
+	}
+
+	prop = xmlGetProp(root_node, BAD_CAST "max_connections");
+	if (prop) {
+		conf->max_connections = atoi((const char*)prop);
+		xmlFree(prop);
+	} else {
+		conf->max_connections = 65536;
+	}
+
+	prop = xmlGetProp(root_node, BAD_CAST "max_buffered_bytes");
+	if (prop) {
+		conf->max_buffered_bytes = atoi((const char*)prop);
+		xmlFree(prop);
+	} else {
+		conf->max_buffered_bytes = 64*1024*1024;
+	}
+
+	// set default
+	conf->eviction_policy = non_http_action_accept;
+	prop = xmlGetProp(root_node, BAD_CAST "eviction_policy");
+	if (prop) {
+		if (!strncasecmp((const char*) prop, "reset", 6)) {
+			conf->eviction_policy = non_http_action_reset;
+		} else if (!strncasecmp((const char*) prop, "accept", 6)) {
+			conf->eviction_policy = non_http_action_accept;
+		} else if (!strncasecmp((const char*) prop, "drop", 5)) {
+			conf->eviction_policy = non_http_action_drop;
+		} else {
+			WARN(" invalid 'eviction_policy' XML prop. using default \n");
+		}
+		xmlFree(prop);
+	}
+
+	conf->hold_out_of_order = false;
+	prop = xmlGetProp(root_node, BAD_CAST "reorder_mode");
+	if (prop) {
+		if (!strncasecmp((const char*) prop, "hold", 5)) {
+			conf->hold_out_of_order = true;
+		} else if (strncasecmp((const char*) prop, "copy", 5)) {
+			WARN(" invalid 'reorder_mode' XML prop. using default \n");
+		}
+		xmlFree(prop);
+	}
+
+	prop = xmlGetProp(root_node, BAD_CAST "hold_timeout");
+	if (prop) {
+		conf->hold_timeout = atoi((const char*)prop);
+		xmlFree(prop);
+		if (conf->hold_timeout < 1) {
+			WARN(" invalid 'hold_timeout' XML prop. using default \n");
+			conf->hold_timeout = 2;
+		}
+	} else {
+		conf->hold_timeout = 2;
+	}
+
+	conf->trust_mark = 0;
+	prop = xmlGetProp(root_node, BAD_CAST "trust_mark");
+	if (prop) {
+		conf->trust_mark = strtoul((const char*)prop, &endptr, 0);
+		if (*endptr) {
+			WARN(" invalid 'trust_mark' XML prop. not marking trusted connections\n");
+			conf->trust_mark = 0;
+		}
+		xmlFree(prop);
+	}
+
+	conf->non_http_mark = 0;
+	prop = xmlGetProp(root_node, BAD_CAST "non_http_mark");
+	if (prop) {
+		conf->non_http_mark = strtoul((const char*)prop, &endptr, 0);
+		if (*endptr) {
+			WARN(" invalid 'non_http_mark' XML prop. not marking non HTTP connections\n");
+			conf->non_http_mark = 0;
+		}
+		xmlFree(prop);
+	}
+
+	conf->syn_verdicts = syn_verdicts_accept;
+	prop = xmlGetProp(root_node, BAD_CAST "syn_verdicts");
+	if (prop) {
+		if (!strncasecmp((const char*) prop, "off", 4)) {
+			conf->syn_verdicts = syn_verdicts_off;
+		} else if (!strncasecmp((const char*) prop, "accept", 7)) {
+			conf->syn_verdicts = syn_verdicts_accept;
+		} else if (!strncasecmp((const char*) prop, "all", 4)) {
+			conf->syn_verdicts = syn_verdicts_all;
+		} else {
+			WARN(" invalid 'syn_verdicts' XML prop. using default \n");
+		}
+		xmlFree(prop);
+	}
+
+	prop = xmlGetProp(root_node, BAD_CAST "queue_maxlen");
+	if (prop) {
+		conf->queue_maxlen = atoi((const char*)prop);
+		xmlFree(prop);
+		if (conf->queue_maxlen < 1) {
+			WARN(" invalid 'queue_maxlen' XML prop. using default \n");
+			conf->queue_maxlen = 5000;
+		}
+	} else {
+		conf->queue_maxlen = 5000;
+	}
+
+	conf->overload_accept = false;
+	prop = xmlGetProp(root_node, BAD_CAST "overload_action");
+	if (prop) {
+		if (!strncasecmp((const char*) prop, "accept", 7)) {
+			conf->overload_accept = true;
+		} else if (strncasecmp((const char*) prop, "drop", 5)) {
+			WARN(" invalid 'overload_action' XML prop. using default \n");
+		}
+		xmlFree(prop);
+	}
+
+	prop = xmlGetProp(root_node, BAD_CAST "overload_backlog");
+	if (prop) {
+		conf->overload_backlog = atoi((const char*)prop);
+		xmlFree(prop);
+	} else {
+		conf->overload_backlog = 2048;
+	}
+
+	conf->gso = true;
+	prop = xmlGetProp(root_node, BAD_CAST "gso");
+	if (prop) {
+		if (!strncasecmp((const char*) prop, "off", 4)) {
+			conf->gso = false;
+		} else if (strncasecmp((const char*) prop, "on", 3)) {
+			WARN(" invalid 'gso' XML prop. using default \n");
+		}
+		xmlFree(prop);
+	}
+
+	conf->verify_checksums = false;
+	prop = xmlGetProp(root_node, BAD_CAST "verify_checksums");
+	if (prop) {
+		if (!strncasecmp((const char*) prop, "on", 3)) {
+			conf->verify_checksums = true;
+		} else if (strncasecmp((const char*) prop, "off", 4)) {
+			WARN(" invalid 'verify_checksums' XML prop. using default \n");
+		}
+		xmlFree(prop);
+	}
+
+	prop = xmlGetProp(root_node, BAD_CAST "nft_family");
+	if (prop) {
+		conf->nft_family = strdup((const char*)prop);
+		xmlFree(prop);
+	} else {
+		conf->nft_family = strdup("inet");
+	}
+
+	prop = xmlGetProp(root_node, BAD_CAST "nft_table");
+	if (prop) {
+		conf->nft_table = strdup((const char*)prop);
+		xmlFree(prop);
+	}
+
+	prop = xmlGetProp(root_node, BAD_CAST "nft_set");
+	if (prop) {
+		conf->nft_set = strdup((const char*)prop);
+		xmlFree(prop);
+	}
+
 	prop = xmlGetProp(root_node, BAD_CAST "tmp_dir");
 	if (prop) {
 		conf->tmp_dir = strdup((const char*)prop);
@@ -314,6 +553,96 @@ unsigned int WfConfig_getPktBuffSize(struct WfConfig* conf)
 	return conf->pkt_buf_size;
 }
 
+unsigned int WfConfig_getRecvBatch(struct WfConfig* conf)
+{
+	return conf->recv_batch;
+}
+
+unsigned int WfConfig_getPktPoolSize(struct WfConfig* conf)
+{
+	return conf->pkt_pool_size;
+}
+
+unsigned int WfConfig_getMaxConnections(struct WfConfig* conf)
+{
+	return conf->max_connections;
+}
+
+unsigned int WfConfig_getMaxBufferedBytes(struct WfConfig* conf)
+{
+	return conf->max_buffered_bytes;
+}
+
+enum non_http_action WfConfig_getEvictionPolicy(struct WfConfig* conf)
+{
+	return conf->eviction_policy;
+}
+
+bool WfConfig_getHoldOutOfOrder(struct WfConfig* conf)
+{
+	return conf->hold_out_of_order;
+}
+
+unsigned int WfConfig_getHoldTimeout(struct WfConfig* conf)
+{
+	return conf->hold_timeout;
+}
+
+uint32_t WfConfig_getTrustMark(struct WfConfig* conf)
+{
+	return conf->trust_mark;
+}
+
+uint32_t WfConfig_getNonHttpMark(struct WfConfig* conf)
+{
+	return conf->non_http_mark;
+}
+
+enum syn_verdicts WfConfig_getSynVerdicts(struct WfConfig* conf)
+{
+	return conf->syn_verdicts;
+}
+
+unsigned int WfConfig_getQueueMaxLen(struct WfConfig* conf)
+{
+	return conf->queue_maxlen;
+}
+
+bool WfConfig_getOverloadAccept(struct WfConfig* conf)
+{
+	return conf->overload_accept;
+}
+
+unsigned int WfConfig_getOverloadBacklog(struct WfConfig* conf)
+{
+	return conf->overload_backlog;
+}
+
+bool WfConfig_getGso(struct WfConfig* conf)
+{
+	return conf->gso;
+}
+
+bool WfConfig_getVerifyChecksums(struct WfConfig* conf)
+{
+	return conf->verify_checksums;
+}
+
+const char *WfConfig_getNftFamily(struct WfConfig* conf)
+{
+	return conf->nft_family;
+}
+
+const char *WfConfig_getNftTable(struct WfConfig* conf)
+{
+	return conf->nft_table;
+}
+
+const char *WfConfig_getNftSet(struct WfConfig* conf)
+{
+	return conf->nft_set;
+}
+
 
 #if 0
 void WfConfig_setNonHttpAction(struct WfConfig* conf, enum non_http_action action) {
@@ -48,6 +48,16 @@ enum non_http_action {
 	non_http_action_last  /// last invalid.
 };
 
+/**
+* New connections that get their verdict from the SYN, when IP and
+* time filters alone decide it.  Those are never tracked.
+*/
+enum syn_verdicts {
+	syn_verdicts_off,    /// track every connection
+	syn_verdicts_accept, /// accepted connections are not tracked
+	syn_verdicts_all,    /// also drop the SYN of rejected connections, no error page is sent
+};
+
 
 void WfConfig_get(struct WfConfig *conf);
 
@@ -78,4 +88,40 @@ unsigned int WfConfig_getPktBuffSize(struct WfConfig* conf);
 
 const char *WfConfig_getTmpDir(struct WfConfig* conf);
 
+unsigned int WfConfig_getRecvBatch(struct WfConfig* conf);
+
+unsigned int WfConfig_getPktPoolSize(struct WfConfig* conf);
+
+unsigned int WfConfig_getMaxConnections(struct WfConfig* conf);
+
+unsigned int WfConfig_getMaxBufferedBytes(struct WfConfig* conf);
+
+enum non_http_action WfConfig_getEvictionPolicy(struct WfConfig* conf);
+
+bool WfConfig_getHoldOutOfOrder(struct WfConfig* conf);
+
+unsigned int WfConfig_getHoldTimeout(struct WfConfig* conf);
+
+uint32_t WfConfig_getTrustMark(struct WfConfig* conf);
+
+uint32_t WfConfig_getNonHttpMark(struct WfConfig* conf);
+
+enum syn_verdicts WfConfig_getSynVerdicts(struct WfConfig* conf);
+
+unsigned int WfConfig_getQueueMaxLen(struct WfConfig* conf);
+
+bool WfConfig_getOverloadAccept(struct WfConfig* conf);
+
+unsigned int WfConfig_getOverloadBacklog(struct WfConfig* conf);
+
+bool WfConfig_getGso(struct WfConfig* conf);
+
+bool WfConfig_getVerifyChecksums(struct WfConfig* conf);
+
+const char *WfConfig_getNftFamily(struct WfConfig* conf);
+
+const char *WfConfig_getNftTable(struct WfConfig* conf);
+
+const char *WfConfig_getNftSet(struct WfConfig* conf);
+
 #endif
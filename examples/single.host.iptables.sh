@@ -14,6 +14,22 @@ $IPT -X
 
 echo -n 1 > /proc/sys/net/ipv4/ip_forward
 
-$IPT -t mangle -A INPUT -i eth0 -p tcp --sport 80 -j NFQUEUE --queue-balance 1:10
-$IPT -t mangle -A OUTPUT  -o eth0 -p tcp  --dport 80 -j NFQUEUE --queue-balance 1:10
-$IPT -t mangle -A FORWARD  -p tcp -m multiport --ports 80 -j NFQUEUE --queue-balance 1:10
+# connections a TRUST rule matched get this connmark, trust_mark in the config.
+# Their packets skip the queue.
+TRUST_MARK=0x40000000
+# accepted non HTTP connections, non_http_mark in the config
+NON_HTTP_MARK=0x20000000
+for MARK in $TRUST_MARK $NON_HTTP_MARK; do
+	$IPT -t mangle -A INPUT -m connmark --mark $MARK/$MARK -j ACCEPT
+	$IPT -t mangle -A OUTPUT -m connmark --mark $MARK/$MARK -j ACCEPT
+	$IPT -t mangle -A FORWARD -m connmark --mark $MARK/$MARK -j ACCEPT
+done
+
+# with overload_action="accept" in the config, also let traffic through
+# while nfqwf is not running:
+# QUEUE_BYPASS=--queue-bypass
+QUEUE_BYPASS=
+
+$IPT -t mangle -A INPUT -i eth0 -p tcp --sport 80 -j NFQUEUE --queue-balance 1:10 $QUEUE_BYPASS
+$IPT -t mangle -A OUTPUT  -o eth0 -p tcp  --dport 80 -j NFQUEUE --queue-balance 1:10 $QUEUE_BYPASS
+$IPT -t mangle -A FORWARD  -p tcp -m multiport --ports 80 -j NFQUEUE --queue-balance 1:10 $QUEUE_BYPASS
@@ -0,0 +1,162 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+* Connection lookup cost at 1k, 10k and 100k connections:
+* HttpConnTable against the linear list scan it replaced.
+*
+* usage: conn_table_bench [lookups]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "HttpConn.h"
+#include "HttpConnTable.h"
+
+int debug_level = 0;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/** what __find_tcp_conn() used to do */
+static struct HttpConn *linear_find(struct HttpConn **cons, unsigned int n,
+	const struct Ipv4TcpTuple *t)
+{
+	unsigned int i;
+	struct HttpConn *con;
+
+	for (i = 0; i < n; i++) {
+		con = cons[i];
+		if (!memcmp(&con->tuple, t, sizeof(struct Ipv4TcpTuple)))
+			return con;
+		if (con->tuple.dst_ip == t->src_ip && con->tuple.src_ip == t->dst_ip
+			&& con->tuple.dst_port == t->src_port && con->tuple.src_port == t->dst_port)
+			return con;
+	}
+	return NULL;
+}
+
+/** random packet tuple of a connection, in either direction */
+static void pkt_tuple(struct HttpConn *con, struct Ipv4TcpTuple *t)
+{
+	if (rand() & 1) {
+		*t = con->tuple;
+	} else {
+		t->src_ip = con->tuple.dst_ip;
+		t->dst_ip = con->tuple.src_ip;
+		t->src_port = con->tuple.dst_port;
+		t->dst_port = con->tuple.src_port;
+	}
+}
+
+static int run(unsigned int n_cons, long lookups)
+{
+	struct HttpConnTable *tbl;
+	struct HttpConn **cons;
+	struct Ipv4TcpTuple t;
+	unsigned int i;
+	long l, linear_lookups;
+	double t0, t1;
+	int errors = 0;
+
+	tbl = HttpConnTable_new(0);
+	cons = calloc(n_cons, sizeof(struct HttpConn *));
+
+	for (i = 0; i < n_cons; i++) {
+		cons[i] = calloc(1, sizeof(struct HttpConn));
+		cons[i]->id = i;
+		cons[i]->hash_slot = HTTP_CONN_NO_SLOT;
+		// clients in 10.0.0.0/8 to a few servers on port 80
+		cons[i]->tuple.src_ip = htonl(0x0A000000 | (rand() & 0xFFFFFF));
+		cons[i]->tuple.dst_ip = htonl(0xC0A80000 | (rand() & 0xFF));
+		cons[i]->tuple.src_port = 1024 + (i % 60000);
+		cons[i]->tuple.dst_port = HTTP_TCP_PORT;
+		if (HttpConnTable_insert(tbl, &cons[i]->tuple, cons[i])) {
+			// duplicate random tuple, drop it
+			free(cons[i]);
+			i--;
+			n_cons--;
+		}
+	}
+
+	t0 = now_ns();
+	for (l = 0; l < lookups; l++) {
+		pkt_tuple(cons[rand() % n_cons], &t);
+		if (!HttpConnTable_find(tbl, &t))
+			errors++;
+	}
+	t1 = now_ns();
+	printf("%7u connections  hash   %8.1f ns/lookup\n", n_cons, (t1 - t0) / lookups);
+
+	// the scan is slow, keep its run time bounded
+	linear_lookups = lookups / (n_cons / 100 + 1) + 1;
+	t0 = now_ns();
+	for (l = 0; l < linear_lookups; l++) {
+		pkt_tuple(cons[rand() % n_cons], &t);
+		if (!linear_find(cons, n_cons, &t))
+			errors++;
+	}
+	t1 = now_ns();
+	printf("%7u connections  linear %8.1f ns/lookup\n", n_cons, (t1 - t0) / linear_lookups);
+	HttpConnTable_printStats(tbl, stdout);
+
+	// empty the table again, checks backward shift deletion
+	for (i = 0; i < n_cons; i++) {
+		HttpConnTable_remove(tbl, cons[i]);
+		if (i + 1 < n_cons && HttpConnTable_find(tbl, &cons[i + 1]->tuple) != cons[i + 1])
+			errors++;
+		free(cons[i]);
+	}
+	if (HttpConnTable_count(tbl))
+		errors++;
+
+	free(cons);
+	HttpConnTable_del(&tbl);
+
+	if (errors)
+		printf("%d lookup errors\n", errors);
+	return errors;
+}
+
+int main(int argc, char *argv[])
+{
+	long lookups = 1000000;
+	int errors = 0;
+
+	if (argc > 1)
+		lookups = atol(argv[1]);
+
+	srand(1);
+	errors += run(1000, lookups);
+	errors += run(10000, lookups);
+	errors += run(100000, lookups);
+
+	return errors ? 1 : 0;
+}
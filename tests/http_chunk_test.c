@@ -0,0 +1,119 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+* Chunked bodies through HttpChunk_parse(), whole and split at every
+* byte, checking the decoded data, the end of the body and the bytes
+* left after it.  Prints each failure, exits 1 if any.
+*
+* usage: http_chunk_test
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "HttpChunk.h"
+
+int debug_level = 0;
+
+static const struct {
+	const char *in;
+	const char *out;  /* decoded body, NULL if the body is broken */
+	const char *rest; /* bytes after the body */
+} cases[] = {
+	{ "5\r\nhello\r\n0\r\n\r\n", "hello", "" },
+	{ "5\r\nhello\r\n6\r\n world\r\n0\r\n\r\nHTTP/1.1 200 OK\r\n", "hello world", "HTTP/1.1 200 OK\r\n" },
+	{ "A\r\n0123456789\r\n0\r\n\r\n", "0123456789", "" },
+	{ "a;name=value\r\n0123456789\r\n000\r\n\r\n", "0123456789", "" },
+	{ "3\r\nabc\r\n0\r\nExpires: never\r\nX-Trailer: 1\r\n\r\nnext", "abc", "next" },
+	{ "3\nabc\n0\n\n", "abc", "" },
+	{ "0\r\n\r\n", "", "" },
+	{ "3 \r\nabc\r\n0\r\n\r\n", "abc", "" },
+	{ "\r\n3\r\nabc\r\n0\r\n\r\n", NULL, NULL },
+	{ "3\r\nabcd\r\n0\r\n\r\n", NULL, NULL },
+	{ "g\r\n", NULL, NULL },
+	{ "1234567890123456\r\n", NULL, NULL },
+	{ "0\r\n\rx", NULL, NULL },
+};
+
+/** feed in as pieces of at most step bytes */
+static int run(unsigned int c, unsigned int step)
+{
+	const unsigned char *in = (const unsigned char *) cases[c].in;
+	unsigned int in_len = strlen(cases[c].in);
+	const unsigned char *p, *body;
+	char out[256];
+	unsigned int out_len = 0, off, len, piece, n;
+	struct HttpChunk chunk;
+
+	HttpChunk_init(&chunk);
+	for (off = 0; off < in_len && !HttpChunk_done(&chunk) && !HttpChunk_error(&chunk); off += piece) {
+		piece = in_len - off < step ? in_len - off : step;
+		p = in + off;
+		len = piece;
+		while ((n = HttpChunk_parse(&chunk, &p, &len, &body))) {
+			memcpy(out + out_len, body, n);
+			out_len += n;
+		}
+		if (len && !HttpChunk_done(&chunk) && !HttpChunk_error(&chunk)) {
+			printf("FAIL case %u step %u: %u bytes not used\n", c, step, len);
+			return 1;
+		}
+		if (HttpChunk_done(&chunk)) {
+			// whatever is left belongs to the next message
+			if (strcmp((const char *) p, cases[c].rest ? cases[c].rest : "")) {
+				printf("FAIL case %u step %u: rest '%s'\n", c, step, p);
+				return 1;
+			}
+		}
+	}
+
+	if (!cases[c].out) {
+		if (!HttpChunk_error(&chunk)) {
+			printf("FAIL case %u step %u: broken body accepted\n", c, step);
+			return 1;
+		}
+		return 0;
+	}
+
+	if (!HttpChunk_done(&chunk) || out_len != strlen(cases[c].out)
+			|| memcmp(out, cases[c].out, out_len) || chunk.body_len != out_len) {
+		printf("FAIL case %u step %u: done=%d body '%.*s'\n", c, step,
+			HttpChunk_done(&chunk), out_len, out);
+		return 1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	unsigned int c, step;
+	int failed = 0;
+
+	for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+		for (step = 1; step <= strlen(cases[c].in); step++)
+			failed += run(c, step);
+	}
+
+	printf("%s, %d failures\n", failed ? "FAILED" : "ok", failed);
+	return failed ? 1 : 0;
+}
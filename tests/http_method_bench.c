@@ -0,0 +1,166 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+* Cost of finding the method of a request, with the memmem() chain
+* __processs_req_payload() used to have and with HttpMethod_parse().
+* The mix of requests is mostly GET and POST, like real traffic.
+*
+* usage: http_method_bench [iterations]
+*/
+
+#define _GNU_SOURCE /* for memmem */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "HttpMethod.h"
+
+int debug_level = 0;
+
+#define MIN(a, b) (a < b ? a : b)
+
+static const char *requests[] = {
+	"GET /index.html HTTP/1.1\r\n",
+	"GET /favicon.ico HTTP/1.1\r\n",
+	"GET /css/site.css HTTP/1.1\r\n",
+	"POST /api/v1/login HTTP/1.1\r\n",
+	"GET /js/app.js HTTP/1.1\r\n",
+	"HEAD /download.iso HTTP/1.1\r\n",
+	"GET /img/logo.png HTTP/1.1\r\n",
+	"PUT /upload/a.txt HTTP/1.1\r\n",
+	"OPTIONS * HTTP/1.1\r\n",
+	"PROPFIND /dav/ HTTP/1.1\r\n",
+	"REPORT /svn/repo/!svn/vcc/default HTTP/1.1\r\n",
+	"MKWORKSPACE /svn/ws HTTP/1.1\r\n",
+};
+
+#define NUM_REQUESTS (sizeof(requests) / sizeof(requests[0]))
+
+/** the memmem() chain, as it was */
+static int method_memmem(const unsigned char *payload, unsigned int payload_len)
+{
+	unsigned int len = MIN(payload_len, 15);
+
+	if (memmem(payload, len, "GET ", 4))
+		return http_method_get;
+	else if (memmem(payload, len, "OPTIONS ", 8))
+		return http_method_options;
+	else if (memmem(payload, len, "HEAD ", 5))
+		return http_method_head;
+	else if (memmem(payload, len, "POST ", 5))
+		return http_method_post;
+	else if (memmem(payload, len, "PUT ", 4))
+		return http_method_put;
+	else if (memmem(payload, len, "DELETE ", 6))
+		return http_method_delete;
+	else if (memmem(payload, len, "TRACE ", 6))
+		return http_method_trace;
+	else if (memmem(payload, len, "CONNECT ", 5))
+		return http_method_connect;
+	else if (memmem(payload, len, "PROPFIND ", 8))
+		return http_method_propfind;
+	else if (memmem(payload, len, "PROPPATCH ", 9))
+		return http_method_proppatch;
+	else if (memmem(payload, len, "COPY ", 5))
+		return http_method_copy;
+	else if (memmem(payload, len, "MOVE ", 5))
+		return http_method_move;
+	else if (memmem(payload, len, "LOCK ", 5))
+		return http_method_lock;
+	else if (memmem(payload, len, "UNLOCK ", 7))
+		return http_method_unlock;
+	else if (memmem(payload, len, "REPORT ", 6))
+		return http_method_report;
+	else if (memmem(payload, len, "VERSION-CONTROL  ", 15))
+		return http_method_version_control;
+	else if (memmem(payload, len, "CHECKOUT ", 9))
+		return http_method_checkout;
+	else if (memmem(payload, len, "CHECKIN  ", 8))
+		return http_method_checkin;
+	else if (memmem(payload, len, "UNCHECKOUT ", 11))
+		return http_method_uncheckout;
+	else if (memmem(payload, len, "MKWORKSPACE ", 11))
+		return http_method_mkworkspace;
+	return -1;
+}
+
+static int method_hash(const unsigned char *payload, unsigned int payload_len)
+{
+	enum http_method m;
+
+	if (!HttpMethod_parse(payload, payload_len, &m))
+		return -1;
+	return m;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(const char *name, int (*fn)(const unsigned char *, unsigned int),
+		long iterations, const unsigned int *lens)
+{
+	volatile int sink = 0;
+	double t0, t1;
+	long i;
+
+	t0 = now_ns();
+	for (i = 0; i < iterations; i++) {
+		unsigned int r = i % NUM_REQUESTS;
+
+		sink += fn((const unsigned char *) requests[r], lens[r]);
+	}
+	t1 = now_ns();
+	printf("%-24s %8.1f ns/request\n", name, (t1 - t0) / iterations);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int lens[NUM_REQUESTS];
+	long iterations = 10000000;
+	unsigned int i;
+
+	if (argc > 1)
+		iterations = atol(argv[1]);
+
+	for (i = 0; i < NUM_REQUESTS; i++)
+		lens[i] = strlen(requests[i]);
+
+	run("memmem() chain:", method_memmem, iterations, lens);
+	run("HttpMethod_parse():", method_hash, iterations, lens);
+
+	for (i = 0; i < NUM_REQUESTS; i++) {
+		if (method_hash((const unsigned char *) requests[i], lens[i]) < 0) {
+			printf("%s not classified\n", requests[i]);
+			return 1;
+		}
+	}
+	return 0;
+}
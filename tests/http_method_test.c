@@ -0,0 +1,152 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+* Every enum http_method value through HttpMethod_parse(), plus request
+* lines that must not match.  Prints each failure, exits 1 if any.
+*
+* usage: http_method_test
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "HttpMethod.h"
+
+int debug_level = 0;
+
+static const struct {
+	enum http_method method;
+	const char *token;
+} methods[] = {
+	{ http_method_options, "OPTIONS" },
+	{ http_method_get, "GET" },
+	{ http_method_head, "HEAD" },
+	{ http_method_post, "POST" },
+	{ http_method_put, "PUT" },
+	{ http_method_delete, "DELETE" },
+	{ http_method_trace, "TRACE" },
+	{ http_method_connect, "CONNECT" },
+	{ http_method_propfind, "PROPFIND" },
+	{ http_method_proppatch, "PROPPATCH" },
+	{ http_method_mkcol, "MKCOL" },
+	{ http_method_copy, "COPY" },
+	{ http_method_move, "MOVE" },
+	{ http_method_lock, "LOCK" },
+	{ http_method_unlock, "UNLOCK" },
+	{ http_method_report, "REPORT" },
+	{ http_method_version_control, "VERSION-CONTROL" },
+	{ http_method_checkout, "CHECKOUT" },
+	{ http_method_checkin, "CHECKIN" },
+	{ http_method_uncheckout, "UNCHECKOUT" },
+	{ http_method_mkworkspace, "MKWORKSPACE" },
+};
+
+/** request lines with no method */
+static const char *bad[] = {
+	"",
+	"GET",
+	"GET/ HTTP/1.1\r\n",
+	"get / HTTP/1.1\r\n",
+	"GETS / HTTP/1.1\r\n",
+	"PROPFINDX / HTTP/1.1\r\n",
+	"PROPPATCHED / HTTP/1.1\r\n",
+	"VERSION-CONTROLS / HTTP/1.1\r\n",
+	"VERSION-CONTROX / HTTP/1.1\r\n",
+	"MKWORKSPACE",
+	" GET / HTTP/1.1\r\n",
+	"HTTP/1.1 200 OK\r\n",
+	"\x16\x03\x01\x02\x00\x01\x00\x01\xfc\x03\x03",
+};
+
+static int check(const char *line, unsigned int len, int expect, unsigned int expect_off)
+{
+	enum http_method m = http_method_max;
+	unsigned int off;
+
+	off = HttpMethod_parse((const unsigned char *) line, len, &m);
+	if (expect < 0) {
+		if (off) {
+			printf("FAIL '%.*s' parsed as %s\n", len, line, HttpMethod_name(m));
+			return 1;
+		}
+		return 0;
+	}
+	if (off != expect_off || (int) m != expect) {
+		printf("FAIL '%.*s' got %s offset %u, expected %s offset %u\n", len, line,
+			off ? HttpMethod_name(m) : "none", off, HttpMethod_name(expect), expect_off);
+		return 1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	char line[128];
+	unsigned int i, tok_len;
+	int failed = 0;
+
+	if (sizeof(methods) / sizeof(methods[0]) != http_method_max) {
+		printf("FAIL table has %u methods, enum has %u\n",
+			(unsigned int) (sizeof(methods) / sizeof(methods[0])), http_method_max);
+		failed++;
+	}
+
+	for (i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+		tok_len = strlen(methods[i].token);
+
+		if (strcmp(HttpMethod_name(methods[i].method), methods[i].token)) {
+			printf("FAIL name of %u is %s\n", methods[i].method,
+				HttpMethod_name(methods[i].method));
+			failed++;
+		}
+
+		snprintf(line, sizeof(line), "%s /index.html HTTP/1.1\r\n", methods[i].token);
+		failed += check(line, strlen(line), methods[i].method, tok_len + 1);
+
+		// shortest request, and cut right after the space
+		snprintf(line, sizeof(line), "%s /", methods[i].token);
+		failed += check(line, strlen(line), methods[i].method, tok_len + 1);
+		failed += check(line, tok_len + 1, methods[i].method, tok_len + 1);
+
+		// cut before the space
+		failed += check(line, tok_len, -1, 0);
+
+		// empty line of a previous request first
+		snprintf(line, sizeof(line), "\r\n%s / HTTP/1.1\r\n", methods[i].token);
+		failed += check(line, strlen(line), methods[i].method, tok_len + 3);
+
+		// one character wrong in each position
+		snprintf(line, sizeof(line), "%s / HTTP/1.1\r\n", methods[i].token);
+		for (tok_len = 0; tok_len < strlen(methods[i].token); tok_len++) {
+			line[tok_len] ^= 0x01;
+			failed += check(line, strlen(line), -1, 0);
+			line[tok_len] ^= 0x01;
+		}
+	}
+
+	for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+		failed += check(bad[i], strlen(bad[i]), -1, 0);
+
+	printf("%s, %d failures\n", failed ? "FAILED" : "ok", failed);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,150 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+* Cost of finding the line breaks of a request header block, a byte at a
+* time as HttpReq_processHeaderLine() used to, and with each HttpScan
+* classifier the CPU has.  Every classifier must find the same lines.
+*
+* usage: http_scan_bench [iterations]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "HttpScan.h"
+
+int debug_level = 0;
+
+static const char *header =
+	"GET /images/branding/googlelogo/2x/googlelogo_color_272x92dp.png HTTP/1.1\r\n"
+	"Host: www.google.com\r\n"
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+	"Accept: image/avif,image/webp,image/png,image/svg+xml,image/*;q=0.8,*/*;q=0.5\r\n"
+	"Accept-Language: en-US,en;q=0.5\r\n"
+	"Accept-Encoding: gzip, deflate\r\n"
+	"Referer: http://www.google.com/search?q=nfqueue+web+filter&ie=utf-8&oe=utf-8\r\n"
+	"Cookie: NID=511=Xk2ZqHk8C1d4aJ0u3o4hLr9wz0-Qm7PZ6S3l0f4Vt5sJ9rYb1dA2Qe7uWcK8xNp3Lm6Bv0Hg;"
+	" AEC=AVYB7cpQ0l2mF3n4o5p6q7r8s9t0u1v2w3x4y5z6A7B8C9D0E1F2G3H4I5J6K7L8M9N0\r\n"
+	"Connection: keep-alive\r\n"
+	"content-length: 0\r\n"
+	"\r\n";
+
+/** the old loop, byte at a time */
+static unsigned int lines_bytewise(const unsigned char *p, unsigned int len)
+{
+	unsigned int lines = 0;
+
+	while (len) {
+		while (len && *p != '\n' && *p != '\r') {
+			p++;
+			len--;
+		}
+		while (len && (*p == '\n' || *p == '\r')) {
+			p++;
+			len--;
+		}
+		lines++;
+	}
+	return lines;
+}
+
+static unsigned int lines_scan(const unsigned char *p, unsigned int len)
+{
+	const unsigned char *end = p + len;
+	const unsigned char *eol;
+	struct HttpScan scan;
+	unsigned int lines = 0;
+
+	HttpScan_init(&scan, p, len);
+	while (p < end) {
+		eol = HttpScan_findEol(&scan, p);
+		if (!eol)
+			eol = end;
+		p = eol;
+		while (p < end && (*p == '\n' || *p == '\r'))
+			p++;
+		lines++;
+	}
+	return lines;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+	static const char *impls[] = { "scalar", "sse2", "avx2" };
+	const unsigned char *p = (const unsigned char *) header;
+	unsigned int len = strlen(header);
+	unsigned int expect, got, i, off;
+	long n, iterations = 1000000;
+	volatile unsigned int sink = 0;
+	double t0, t1;
+	int ret = 0;
+
+	if (argc > 1)
+		iterations = atol(argv[1]);
+
+	printf("header %u bytes, default classifier %s\n", len, HttpScan_impl());
+
+	expect = lines_bytewise(p, len);
+	t0 = now_ns();
+	for (n = 0; n < iterations; n++)
+		sink += lines_bytewise(p, len);
+	t1 = now_ns();
+	printf("bytewise: %8.1f ns/header %u lines\n", (t1 - t0) / iterations, expect);
+
+	for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+		if (HttpScan_setImpl(impls[i])) {
+			printf("%-8s: not supported\n", impls[i]);
+			continue;
+		}
+
+		// every start offset, so blocks end on every byte of the header
+		for (off = 0; off < len; off++) {
+			if (lines_scan(p + off, len - off) != lines_bytewise(p + off, len - off)) {
+				printf("%-8s: wrong line count at offset %u\n", impls[i], off);
+				ret = 1;
+			}
+		}
+
+		t0 = now_ns();
+		for (n = 0; n < iterations; n++)
+			sink += lines_scan(p, len);
+		t1 = now_ns();
+		got = lines_scan(p, len);
+		printf("%-8s: %8.1f ns/header %u lines\n", impls[i], (t1 - t0) / iterations, got);
+		if (got != expect)
+			ret = 1;
+	}
+
+	return ret;
+}
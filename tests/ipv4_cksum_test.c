@@ -0,0 +1,305 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+* The incremental checksum updates of the header rewrites, checked
+* against a full get_cksum16() resum of the rewritten packet: TCP flags
+* set and cleared, the reset of a connection, and the IP total length
+* fix-up of __gen_error_packet().  Random packets with even and odd
+* payloads, and packets made to have a checksum of 0x0000 before or
+* after the rewrite, also with the field given as 0xFFFF.
+* Prints each failure, exits 1 if any.
+*
+* usage: ipv4_cksum_test
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <arpa/inet.h>
+#include <linux/netfilter.h>
+
+#include "Ipv4Tcp.h"
+
+int debug_level = 0;
+
+#define IP_HDR_LEN 20
+#define TCP_HDR_LEN 20
+#define MAX_PAYLOAD 64
+#define N_RANDOM 2000
+
+#define TCP_CKSUM(b) ((uint16_t *) &(b)[IP_HDR_LEN + 16])
+#define TCP_URG_PTR(b) ((uint16_t *) &(b)[IP_HDR_LEN + 18])
+#define IP_CKSUM(b) ((uint16_t *) &(b)[10])
+
+/** a TCP/IP packet with random addresses, header fields and payload */
+static unsigned int mk_pkt(unsigned char *b, unsigned int payload_len)
+{
+	unsigned int len = IP_HDR_LEN + TCP_HDR_LEN + payload_len;
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		b[i] = rand();
+
+	b[0] = 0x45;
+	b[2] = len >> 8;
+	b[3] = len & 0xff;
+	b[6] = b[7] = 0; // no fragments
+	b[9] = IPPROTO_TCP;
+	b[IP_HDR_LEN + 12] = (TCP_HDR_LEN / 4) << 4;
+	b[IP_HDR_LEN + 13] &= 0x3f;
+
+	*IP_CKSUM(b) = 0;
+	*IP_CKSUM(b) = get_cksum16((unsigned short *) b, IP_HDR_LEN, 0);
+	Ipv4TcpPkt_resetTcpCksum(b, len, IP_HDR_LEN);
+	return len;
+}
+
+/** TCP checksum of the packet summed from scratch */
+static uint16_t full_tcp_cksum(const unsigned char *b, unsigned int len)
+{
+	unsigned char copy[IP_HDR_LEN + TCP_HDR_LEN + MAX_PAYLOAD];
+
+	memcpy(copy, b, len);
+	Ipv4TcpPkt_resetTcpCksum(copy, len, IP_HDR_LEN);
+	return *TCP_CKSUM(copy);
+}
+
+/** set the urgent pointer so the TCP checksum is 0x0000 */
+static int make_zero_cksum(unsigned char *b, unsigned int len)
+{
+	unsigned int u;
+
+	for (u = 0; u <= 0xffff; u++) {
+		*TCP_URG_PTR(b) = u;
+		Ipv4TcpPkt_resetTcpCksum(b, len, IP_HDR_LEN);
+		if (*TCP_CKSUM(b) == 0)
+			return 0;
+	}
+	return -1;
+}
+
+/** sum of the packet with its checksum, as the receiver checks it, 0 if right */
+static uint16_t verify_tcp_cksum(const unsigned char *b, unsigned int len)
+{
+	int sum;
+
+	sum = *(uint16_t *) &b[12] + *(uint16_t *) &b[14]
+		+ *(uint16_t *) &b[16] + *(uint16_t *) &b[18]
+		+ htons(IPPROTO_TCP) + htons(len - IP_HDR_LEN);
+	return get_cksum16((unsigned short *) &b[IP_HDR_LEN], len - IP_HDR_LEN, sum);
+}
+
+/**
+* The checksum must match a full resum.  A field that came in as 0xFFFF,
+* the other form of a 0x0000 checksum, is kept when the rewrite changed
+* nothing, so there it only has to verify.
+*/
+static int check_tcp(const char *name, unsigned int n, const unsigned char *b,
+	unsigned int len, bool ones)
+{
+	uint16_t full = full_tcp_cksum(b, len);
+
+	if (ones && *TCP_CKSUM(b) == 0xffff && full == 0) {
+		if (verify_tcp_cksum(b, len)) {
+			printf("FAIL %s packet %u len %u: cksum 0xffff does not verify\n",
+				name, n, len);
+			return 1;
+		}
+		return 0;
+	}
+
+	if (*TCP_CKSUM(b) != full) {
+		printf("FAIL %s packet %u len %u: cksum 0x%04hx full resum 0x%04hx\n",
+			name, n, len, ntohs(*TCP_CKSUM(b)), ntohs(full));
+		return 1;
+	}
+	return 0;
+}
+
+/** run the TCP header rewrites on one packet */
+static int run_tcp(unsigned int n, const unsigned char *orig, unsigned int len)
+{
+	unsigned char b[IP_HDR_LEN + TCP_HDR_LEN + MAX_PAYLOAD];
+	struct Ipv4TcpPkt *pkt;
+	bool ones = *TCP_CKSUM(orig) == 0xffff;
+	int failed = 0;
+
+	pkt = Ipv4TcpPkt_new(NULL, 0);
+	if (!pkt) {
+		printf("FAIL no memory\n");
+		exit(1);
+	}
+	pkt->ip_data = b;
+	pkt->ip_packet_length = len;
+
+	memcpy(b, orig, len);
+	Ipv4TcpPkt_parseIpPayload(pkt);
+	Ipv4TcpPkt_setTcpFlag(pkt, TCP_FLAG_PSH | TCP_FLAG_URG);
+	failed += check_tcp("setTcpFlag", n, b, len, ones);
+	// no change
+	Ipv4TcpPkt_setTcpFlag(pkt, TCP_FLAG_PSH);
+	failed += check_tcp("setTcpFlag again", n, b, len, ones);
+	Ipv4TcpPkt_clearTcpFlag(pkt, TCP_FLAG_ACK | TCP_FLAG_PSH);
+	failed += check_tcp("clearTcpFlag", n, b, len, ones);
+
+	memcpy(b, orig, len);
+	Ipv4TcpPkt_parseIpPayload(pkt);
+	Ipv4TcpPkt_resetTcpCon(pkt);
+	failed += check_tcp("resetTcpCon", n, b, len, ones);
+
+	Ipv4TcpPkt_del(&pkt);
+	return failed;
+}
+
+/** the IP total length fix-up of __gen_error_packet() */
+static int run_ip_len(unsigned int n, unsigned char *b, uint16_t new_len)
+{
+	uint16_t *len_field = (uint16_t *) &b[2];
+	uint16_t old_len = *len_field;
+	uint16_t full;
+
+	*len_field = htons(new_len);
+	*IP_CKSUM(b) = adjust_cksum16(*IP_CKSUM(b), old_len, *len_field);
+
+	full = get_cksum16((unsigned short *) b, IP_HDR_LEN, 0);
+	if (full) {
+		printf("FAIL ip length packet %u len %u: cksum 0x%04hx does not verify\n",
+			n, new_len, ntohs(*IP_CKSUM(b)));
+		return 1;
+	}
+	return 0;
+}
+
+/** the words before and after give a sum of 0xFFFF, checksum 0x0000 */
+static int run_helpers(void)
+{
+	uint16_t words[4] = { 0x1234, 0xabcd, 0x0f0f, 0 };
+	uint16_t cksum, full, old_val;
+	uint32_t old32, new32;
+	int failed = 0;
+
+	cksum = get_cksum16(words, sizeof(words), 0);
+	old_val = words[3];
+	// 0x1234 + 0xabcd + 0x0f0f + x == 0xffff
+	words[3] = 0xffff - 0x1234 - 0xabcd - 0x0f0f;
+	full = get_cksum16(words, sizeof(words), 0);
+	cksum = adjust_cksum16(cksum, old_val, words[3]);
+	if (full != 0 || cksum != full) {
+		printf("FAIL adjust_cksum16 to 0x0000: 0x%04hx full resum 0x%04hx\n", cksum, full);
+		failed++;
+	}
+
+	// and back, from a checksum of 0x0000 and from the same sum as 0xFFFF
+	old_val = words[3];
+	words[3] = 0x5555;
+	full = get_cksum16(words, sizeof(words), 0);
+	cksum = adjust_cksum16(0x0000, old_val, words[3]);
+	if (cksum != full) {
+		printf("FAIL adjust_cksum16 from 0x0000: 0x%04hx full resum 0x%04hx\n", cksum, full);
+		failed++;
+	}
+	cksum = adjust_cksum16(0xffff, old_val, words[3]);
+	if (cksum != full) {
+		printf("FAIL adjust_cksum16 from 0xFFFF: 0x%04hx full resum 0x%04hx\n", cksum, full);
+		failed++;
+	}
+
+	// a 32 bit field changing both words, the high one to 0x0000
+	memcpy(&old32, words, 4);
+	cksum = get_cksum16(words, sizeof(words), 0);
+	words[0] = 0;
+	words[1] = 0xffff;
+	memcpy(&new32, words, 4);
+	full = get_cksum16(words, sizeof(words), 0);
+	cksum = adjust_cksum32(cksum, old32, new32);
+	if (cksum != full) {
+		printf("FAIL adjust_cksum32: 0x%04hx full resum 0x%04hx\n", cksum, full);
+		failed++;
+	}
+	return failed;
+}
+
+int main(void)
+{
+	unsigned char b[IP_HDR_LEN + TCP_HDR_LEN + MAX_PAYLOAD];
+	unsigned char r[IP_HDR_LEN + TCP_HDR_LEN + MAX_PAYLOAD];
+	unsigned int n, len;
+	struct Ipv4TcpPkt *pkt;
+	int failed = 0;
+
+	srand(1);
+	failed += run_helpers();
+
+	for (n = 0; n < N_RANDOM; n++) {
+		len = mk_pkt(b, rand() % (MAX_PAYLOAD + 1));
+		failed += run_tcp(n, b, len);
+		failed += run_ip_len(n, b, rand() % 0x10000);
+	}
+
+	// checksum 0x0000 before the rewrite, and the same sum given as 0xFFFF
+	for (n = 0; n < 16; n++) {
+		len = mk_pkt(b, n);
+		b[IP_HDR_LEN + 13] |= 0x10; // ACK, cleared by the rewrite
+		if (make_zero_cksum(b, len)) {
+			printf("FAIL packet %u: no checksum of 0x0000\n", n);
+			failed++;
+			continue;
+		}
+		failed += run_tcp(n, b, len);
+		*TCP_CKSUM(b) = 0xffff;
+		failed += run_tcp(n, b, len);
+	}
+
+	// checksum 0x0000 after the reset
+	for (n = 0; n < 16; n++) {
+		len = mk_pkt(b, n);
+		b[IP_HDR_LEN + 13] &= ~0x05; // FIN and RST, set by the reset
+		memcpy(r, b, len);
+		r[IP_HDR_LEN + 13] |= 0x05;
+		if (make_zero_cksum(r, len)) {
+			printf("FAIL packet %u: no checksum of 0x0000\n", n);
+			failed++;
+			continue;
+		}
+		*TCP_URG_PTR(b) = *TCP_URG_PTR(r);
+		Ipv4TcpPkt_resetTcpCksum(b, len, IP_HDR_LEN);
+
+		pkt = Ipv4TcpPkt_new(NULL, 0);
+		pkt->ip_data = b;
+		pkt->ip_packet_length = len;
+		Ipv4TcpPkt_parseIpPayload(pkt);
+		Ipv4TcpPkt_resetTcpCon(pkt);
+		if (*TCP_CKSUM(b) != 0) {
+			printf("FAIL reset to 0x0000 packet %u: cksum 0x%04hx\n",
+				n, ntohs(*TCP_CKSUM(b)));
+			failed++;
+		}
+		failed += check_tcp("reset to 0x0000", n, b, len, false);
+		Ipv4TcpPkt_del(&pkt);
+	}
+
+	printf("%s, %d failures\n", failed ? "FAILED" : "ok", failed);
+	return failed ? 1 : 0;
+}
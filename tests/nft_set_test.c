@@ -0,0 +1,74 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+* Export the IP only reject rules of a config to its nftables set.
+* Prints the networks exported.  nft_set_test.sh runs it in a
+* network namespace and checks the set contents with nft.
+*
+* usage: nft_set_test config.xml
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+
+#include "WfConfig.h"
+#include "ContentFilter.h"
+#include "NftSet.h"
+
+int debug_level = 0;
+
+int main(int argc, char *argv[])
+{
+	struct WfConfig *conf;
+	struct Ipv4Net *nets;
+	char addr[INET_ADDRSTRLEN];
+	char mask[INET_ADDRSTRLEN];
+	unsigned int count, i;
+	int ret;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s config.xml\n", argv[0]);
+		return 2;
+	}
+
+	conf = WfConfig_new();
+	if (WfConfig_loadConfig(conf, argv[1])) {
+		fprintf(stderr, "can not load %s\n", argv[1]);
+		return 2;
+	}
+
+	count = ContentFilter_getRejectNets(WfConfig_getContentFilter(conf), &nets);
+	for (i = 0; i < count; i++) {
+		printf("reject %s/%s\n",
+			inet_ntop(AF_INET, &nets[i].addr, addr, sizeof(addr)),
+			inet_ntop(AF_INET, &nets[i].mask, mask, sizeof(mask)));
+	}
+	free(nets);
+
+	ret = NftSet_exportConfig(conf);
+	printf("export %s\n", ret ? "failed" : "ok");
+
+	WfConfig_put(&conf);
+	return ret ? 1 : 0;
+}
@@ -0,0 +1,41 @@
+#!/bin/sh
+# Export tests/config_nft.xml to an nftables set in a throw away network
+# namespace, then check the set holds the expected intervals.
+# Needs nft and unprivileged user namespaces, or root.
+#
+# usage: tests/nft_set_test.sh [path to nft_set_test]
+
+TEST=${1:-$(dirname $0)/nft_set_test}
+CONFIG=$(dirname $0)/config_nft.xml
+
+if [ -z "$NFT_SET_TEST_NS" ]; then
+	NFT_SET_TEST_NS=1 exec unshare -rn "$0" "$@"
+fi
+
+set -e
+
+nft add table inet nfqwf
+nft add set inet nfqwf reject_nets '{ type ipv4_addr; flags interval; }'
+# stale element, must be flushed
+nft add element inet nfqwf reject_nets '{ 10.200.0.1 }'
+
+$TEST $CONFIG
+# the export replaces the set contents, so it can run again
+$TEST $CONFIG
+
+OUT=$(nft list set inet nfqwf reject_nets)
+echo "$OUT"
+
+fail() {
+	echo "FAIL: $1"
+	exit 1
+}
+
+echo "$OUT" | grep -q "10.1.0.0/16" || fail "10.1.0.0/16 missing"
+echo "$OUT" | grep -q "192.168.7.9" || fail "192.168.7.9 missing"
+echo "$OUT" | grep -q "10.1.128.0" && fail "10.1.128.0/24 not merged"
+echo "$OUT" | grep -q "10.200.0.1" && fail "old element not flushed"
+echo "$OUT" | grep -q "10.9.0.0" && fail "rule with a time filter exported"
+echo "$OUT" | grep -q "172.16.0.0" && fail "rule after an accept exported"
+
+echo "PASS"
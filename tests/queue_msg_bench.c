@@ -0,0 +1,210 @@
+/*
+Copyright (C) <2010-2011> Karl Hiramoto <karl@hiramoto.org>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+* Cost per packet of decoding a NF_QUEUE packet message and encoding its
+* verdict, with libnl nfnl_queue_msg objects and with the NfQueueMsg codec.
+* No socket is used, only the user space work is measured.
+*
+* usage: queue_msg_bench [iterations]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <linux/netfilter.h>
+
+/*note this check for older kernels */
+#ifndef aligned_be64
+#define aligned_be64 u_int64_t __attribute__((aligned(8)))
+#endif
+
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_queue.h>
+#include <netlink/msg.h>
+#include <netlink/netfilter/nfnl.h>
+#include <netlink/netfilter/queue_msg.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "NfQueueMsg.h"
+
+int debug_level = 0;
+
+#define PAYLOAD_LEN 1400
+
+static uint8_t msg_buf[4096] __attribute__((aligned(8)));
+
+static void put_attr(struct nlmsghdr *nlh, uint16_t type, const void *data, int len)
+{
+	struct nlattr *attr = (struct nlattr *) ((uint8_t *) nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+
+	attr->nla_type = type;
+	attr->nla_len = NLA_HDRLEN + len;
+	memcpy((uint8_t *) attr + NLA_HDRLEN, data, len);
+	nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + NLA_ALIGN(attr->nla_len);
+}
+
+/** a packet message like the kernel sends for a forwarded TCP segment */
+static struct nlmsghdr *build_pkt_msg(void)
+{
+	struct nlmsghdr *nlh = (struct nlmsghdr *) msg_buf;
+	struct nfgenmsg *nfg;
+	struct nfqnl_msg_packet_hdr ph = { .packet_id = htonl(1234), .hw_protocol = htons(0x0800), .hook = NF_INET_FORWARD };
+	struct nfqnl_msg_packet_hw hw = { .hw_addrlen = htons(6), .hw_addr = {0, 1, 2, 3, 4, 5} };
+	uint32_t val;
+	uint8_t payload[PAYLOAD_LEN];
+
+	memset(payload, 0x45, sizeof(payload));
+	nlh->nlmsg_type = (NFNL_SUBSYS_QUEUE << 8) | NFQNL_MSG_PACKET;
+	nlh->nlmsg_flags = 0;
+	nlh->nlmsg_len = NLMSG_SPACE(sizeof(struct nfgenmsg));
+	nfg = NLMSG_DATA(nlh);
+	nfg->nfgen_family = AF_INET;
+	nfg->version = NFNETLINK_V0;
+	nfg->res_id = htons(0);
+
+	put_attr(nlh, NFQA_PACKET_HDR, &ph, sizeof(ph));
+	val = htonl(0x10);
+	put_attr(nlh, NFQA_MARK, &val, sizeof(val));
+	val = htonl(2);
+	put_attr(nlh, NFQA_IFINDEX_INDEV, &val, sizeof(val));
+	val = htonl(3);
+	put_attr(nlh, NFQA_IFINDEX_OUTDEV, &val, sizeof(val));
+	put_attr(nlh, NFQA_HWADDR, &hw, sizeof(hw));
+	put_attr(nlh, NFQA_PAYLOAD, payload, sizeof(payload));
+	return nlh;
+}
+
+static struct nla_policy queue_policy[NFQA_MAX+1] = {
+	[NFQA_PACKET_HDR]		= { .minlen = sizeof(struct nfqnl_msg_packet_hdr) },
+	[NFQA_MARK]			= { .type = NLA_U32 },
+	[NFQA_IFINDEX_INDEV]		= { .type = NLA_U32 },
+	[NFQA_IFINDEX_OUTDEV]		= { .type = NLA_U32 },
+	[NFQA_HWADDR]			= { .minlen = sizeof(struct nfqnl_msg_packet_hw) },
+};
+
+/** what Ipv4TcpPkt_parseNlHdrMsg() and the verdict used to do per packet */
+static void run_libnl(struct nlmsghdr *nlh)
+{
+	struct nlattr *tb[NFQA_MAX+1];
+	struct nfnl_queue_msg *qmsg;
+	struct nfqnl_msg_packet_hdr *hdr;
+	struct nfqnl_msg_packet_hw *hw;
+	struct nl_msg *nlmsg;
+
+	qmsg = nfnl_queue_msg_alloc();
+	nlmsg_parse(nlh, sizeof(struct nfgenmsg), tb, NFQA_MAX, queue_policy);
+	nfnl_queue_msg_set_group(qmsg, nfnlmsg_res_id(nlh));
+	nfnl_queue_msg_set_family(qmsg, nfnlmsg_family(nlh));
+	hdr = nla_data(tb[NFQA_PACKET_HDR]);
+	nfnl_queue_msg_set_packetid(qmsg, ntohl(hdr->packet_id));
+	nfnl_queue_msg_set_hwproto(qmsg, hdr->hw_protocol);
+	nfnl_queue_msg_set_hook(qmsg, hdr->hook);
+	nfnl_queue_msg_set_mark(qmsg, ntohl(nla_get_u32(tb[NFQA_MARK])));
+	nfnl_queue_msg_set_indev(qmsg, ntohl(nla_get_u32(tb[NFQA_IFINDEX_INDEV])));
+	nfnl_queue_msg_set_outdev(qmsg, ntohl(nla_get_u32(tb[NFQA_IFINDEX_OUTDEV])));
+	hw = nla_data(tb[NFQA_HWADDR]);
+	nfnl_queue_msg_set_hwaddr(qmsg, hw->hw_addr, ntohs(hw->hw_addrlen));
+
+	nfnl_queue_msg_set_verdict(qmsg, NF_ACCEPT);
+	nlmsg = nfnl_queue_msg_build_verdict(qmsg);
+	nlmsg_free(nlmsg);
+	nfnl_queue_msg_put(qmsg);
+}
+
+static void run_codec(struct nlmsghdr *nlh, struct NfQueueMsgTx *tx)
+{
+	struct NfQueuePktMsg msg;
+	struct NfQueueVerdict v = { .verdict = NF_ACCEPT };
+
+	NfQueueMsg_parsePkt(nlh, &msg);
+	v.packet_id = msg.packet_id;
+	v.set_mark = true;
+	v.mark = msg.mark;
+	NfQueueMsgTx_addVerdict(tx, &v);
+
+	// drop it, we only measure the encoding
+	tx->len = 0;
+	tx->pending = 0;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t now_cycles(void)
+{
+#ifdef HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+	struct nlmsghdr *nlh = build_pkt_msg();
+	struct NfQueueMsgTx tx;
+	long i, iterations = 1000000;
+	double t0, t1;
+	uint64_t c0, c1;
+
+	if (argc > 1)
+		iterations = atol(argv[1]);
+
+	if (NfQueueMsgTx_init(&tx, -1, 0, 64 * 1024)) {
+		fprintf(stderr, "no memory\n");
+		return 1;
+	}
+
+	t0 = now_ns();
+	c0 = now_cycles();
+	for (i = 0; i < iterations; i++)
+		run_libnl(nlh);
+	c1 = now_cycles();
+	t1 = now_ns();
+	printf("libnl nfnl_queue_msg: %8.1f ns/pkt %8.1f cycles/pkt\n",
+		(t1 - t0) / iterations, (double) (c1 - c0) / iterations);
+
+	t0 = now_ns();
+	c0 = now_cycles();
+	for (i = 0; i < iterations; i++)
+		run_codec(nlh, &tx);
+	c1 = now_cycles();
+	t1 = now_ns();
+	printf("NfQueueMsg codec:     %8.1f ns/pkt %8.1f cycles/pkt\n",
+		(t1 - t0) / iterations, (double) (c1 - c0) / iterations);
+
+	NfQueueMsgTx_free(&tx);
+	return 0;
+}
@@ -111,6 +111,7 @@ we modify the HTTP response to inject the error page into the packet.</li>
 
 #include "WfConfig.h"
 #include "NfQueue.h"
+#include "NftSet.h"
 #include "FilterType.h"
 #include "nfq_wf_private.h"
 
@@ -125,6 +126,9 @@ we modify the HTTP response to inject the error page into the packet.</li>
 /**Current configuration */
 static struct WfConfig *conf = NULL;
 static bool keep_running = true;
+static volatile sig_atomic_t print_stats = 0;
+/** a reloaded config has nft sets to export, netlink I/O is not done in the handler */
+static volatile sig_atomic_t export_nft_sets = 0;
 static int exit_pipe[2] = { 0, 0};
 static char *pid_file = NULL;
 static char *config_file = NULL;
@@ -160,6 +164,7 @@ static void sig_HUP_Handler(int sig)
 	}
 
 	conf = new_conf;
+	export_nft_sets = 1;
 
 	for(i = 0; nfq_wf && nfq_wf[i]; i++) {
 		DBG(1," reloading config in thread %d\n", i);
@@ -168,6 +173,11 @@ static void sig_HUP_Handler(int sig)
 	DBG(1," Finished SIG HUP reload config\n");
 }
 
+static void sig_USR1_Handler(int sig)
+{
+	print_stats = 1;
+}
+
 static void sig_PIPE_Handler(int sig)
 {
 	//FIXME this is for testing
@@ -306,6 +316,7 @@ static void print_help(void)
 	printf("             Default value 1 \n");
 	printf(" -Q N    High queue number.  The higher number in --queue-balance q:Q\n");
 	printf("             Default value is low queue number \n");
+	printf(" Send SIGUSR1 to print per queue counters to stderr\n");
 	printf("\n");
 }
 
@@ -441,11 +452,15 @@ int main(int argc, char *argv[])
 
 	signal(SIGPIPE, sig_PIPE_Handler);
 
+	/* dump queue counters */
+	signal(SIGUSR1, sig_USR1_Handler);
+
 	ret = WfConfig_loadConfig(conf, config_file);
 	if (ret < 0) {
 		ERROR("Invalid config file\n");
 		return 1;
 	}
+	NftSet_exportConfig(conf);
 
 	cache_ctx = init_libnl_cache();
 
@@ -504,6 +519,17 @@ int main(int argc, char *argv[])
 			DBG(1,"select() returned = %d\n", ret);
 		}
 
+		if (print_stats) {
+			print_stats = 0;
+			for(i = 0; i < num_queues; i++)
+				NfQueue_printStats(nfq_wf[i], stderr);
+		}
+
+		if (export_nft_sets) {
+			export_nft_sets = 0;
+			NftSet_exportConfig(conf);
+		}
+
 		DBG(1," keep_running = %d\n", keep_running);
 	}
 